@@ -4,59 +4,103 @@
 #include <math.h>
 #include "writeMessages.h"
 #include "feedback.h"
+#include "hostPort.h"
 
 bool log_i21 = true;
+bool log_i07 = false;	// moves stretched by the motion limits, verbose servos always report them
+bool log_moveMetrics = true;	// end of move record of feedback servos
 
 // set up a servo with speed control
-void Mai3Servo::begin(int servoPin, int servoMin, int servoMax, int servoAutoDetachMs, bool servoInverted, int servoLastPos, int powerPin) {
+void Mai3Servo::begin(int servoPin, int servoMin, int servoMax, int servoRestPosition, int servoAutoDetachMs, bool servoInverted, int servoLastPos, int powerPin) {
 
 	assigned = true;
 	pin = servoPin;
 	servoPowerPin = powerPin;
-	min = servoMin;
-	max = servoMax;
+	config->min = servoMin;
+	config->max = servoMax;
+	config->restPosition = servoRestPosition;
 	autoDetachMs = servoAutoDetachMs;
 	inverted = servoInverted;
 	currentPosition = servoLastPos;
+	predictedPosition = servoLastPos;
 	inMoveRequest = false;
+	moveQueued = false;
 	thisServoVerbose = false;		// assume verbose off
 	servo.detach();
 }
 
+// set feedback definitions
+void Mai3Servo::setFeedbackValues(int multiplexerAddress, int multiplexerChannel,
+	int magnetOffset, bool isFeedbackInverted, float servoDegPerPos,
+	float pidKp, float pidKi, float pidKd) {
+
+	isFeedbackServo = true;
+	config->i2cMultiplexerAddress = multiplexerAddress;
+	config->i2cMultiplexerChannel = multiplexerChannel;
+	config->feedbackMagnetOffset = magnetOffset;
+	config->feedbackInverted = isFeedbackInverted;
+	config->degPerPos = servoDegPerPos;
+	config->kp = pidKp;
+	config->ki = pidKi;
+	config->kd = pidKd;
+	magnetRefValid = false;
+	magnetAbsoluteValid = false;
+}
+
+// velocity feedforward and anti-windup limits of the PID control
+void Mai3Servo::setPidLimits(float pidKv, float pidIntegralLimit, float pidOutputLimit) {
+	config->kv = pidKv;
+	config->integralLimit = pidIntegralLimit;
+	config->outputLimit = pidOutputLimit;
+}
+
 // powerUp
 void Mai3Servo::powerUp() {
 
 	// on power up set servo to the last known position
 	startMillis = millis();
+	servoWritePosition = currentPosition;
 	writeServoPosition(currentPosition, inverted);
+	predictedPosition = currentPosition;
+	lastModelMillis = millis();
 
 	if (thisServoVerbose) {
-		Serial.print("i14 powerUp, pin: "); Serial.print(pin);
-		Serial.print(", currentPosition: "); Serial.print(currentPosition);
-		Serial.print(", inverted: "); Serial.print(inverted);
-		Serial.println();
+		hostPort->print("i14 powerUp, pin: "); hostPort->print(pin);
+		hostPort->print(", currentPosition: "); hostPort->print(currentPosition);
+		hostPort->print(", inverted: "); hostPort->print(inverted);
+		hostPort->println();
 	}
 	attach();
 }
 
 // stop servo
-void Mai3Servo::stopServo() {
+void Mai3Servo::stopServo(int endReason) {
 	numPartialSteps = 0;		// this will stop writing new positions to the servo
+	holding = false;
 	finalPositionRequestedMillis = millis();
 	arrivedMillis = millis();
+	if (moving) {
+		moveEnd = endReason;
+	}
+	if (moving && isFeedbackServo && autoTune == NULL) {
+		sendMoveMetrics(endReason);
+	}
 	moving = false;
 	inMoveRequest = false;
+	moveQueued = false;
+	autoTune = NULL;
 	if (!isFeedbackServo) {
-		currentPosition = wantedPosition;
+		// the joint has not reached the last written position yet, report the modelled position
+		followPositionModel();
 	}
 	if (log_i21 || thisServoVerbose) {
-		Serial.print("i21 servo stop received, ");
-		Serial.print(servoName);
-		Serial.print(", currentPosition: ");
-		Serial.print(currentPosition);
-		Serial.println();
+		hostPort->print("i21 servo stop received, ");
+		hostPort->print(config->servoName);
+		hostPort->print(", currentPosition: ");
+		hostPort->print(currentPosition);
+		hostPort->println();
 	}
-	byte status = buildStatusByte(assigned, moving, servo.attached(), autoDetachMs>0, thisServoVerbose, true);
+	byte status = buildStatusByte(assigned, moving, servo.attached(), autoDetachMs>0, thisServoVerbose, true, servoBlocked);
 	sendServoStatus(pin, status, currentPosition);
 	//loggedLastPos = lastPosition;
 	lastStatusUpdate = millis();
@@ -66,6 +110,8 @@ void Mai3Servo::stopServo() {
 // only update servoPosition, do not move the servo
 void Mai3Servo::setCurrentPosition(int newCurrentPosition) {
 	currentPosition = newCurrentPosition;
+	predictedPosition = newCurrentPosition;
+	magnetRefValid = false;		// the sensor angle of the new position is taken with the next read
 }
 
 
@@ -87,130 +133,446 @@ int Mai3Servo::adjustOutlierPosition(int targetPos) {
 	int adjustedPos = targetPos;
 
 	// adjust if smaller than min
-	if (targetPos < min) {
-		adjustedPos = min;
-		Serial.print("w01 ");
-		Serial.print(servoName);
-		Serial.print(", position adjusted, requested position: ");
-		Serial.print(targetPos);
-		Serial.print(" min pos: ");
-		Serial.print(min);
-		Serial.println();
+	if (targetPos < config->min) {
+		adjustedPos = config->min;
+		hostPort->print("w01 ");
+		hostPort->print(config->servoName);
+		hostPort->print(", position adjusted, requested position: ");
+		hostPort->print(targetPos);
+		hostPort->print(" min pos: ");
+		hostPort->print(config->min);
+		hostPort->println();
 	}
 
 	// .. or greater than max
-	if (targetPos > max) {
-		adjustedPos = max;
-		Serial.print("w02 ");
-		Serial.print(servoName);
-		Serial.print(", position adjusted, requested position: ");
-		Serial.print(targetPos);
-		Serial.print(" max pos: ");
-		Serial.print(max);
-		Serial.println();
+	if (targetPos > config->max) {
+		adjustedPos = config->max;
+		hostPort->print("w02 ");
+		hostPort->print(config->servoName);
+		hostPort->print(", position adjusted, requested position: ");
+		hostPort->print(targetPos);
+		hostPort->print(" max pos: ");
+		hostPort->print(config->max);
+		hostPort->println();
 	}
 
 	return adjustedPos;
 }
 
 
+int Mai3Servo::clampPosition(int targetPos) {
+	if (targetPos < config->min) {
+		return config->min;
+	}
+	if (targetPos > config->max) {
+		return config->max;
+	}
+	return targetPos;
+}
+
+
 // move to relative position
 void Mai3Servo::moveTo(int targetPos, int thisDuration) {
 
 	if (!assigned) {
-		Serial.println("e01 no action, servo not assigned yet");
+		hostPort->println("e01 no action, servo not assigned yet");
+		return;
+	}
+	if (teaching) {
+		hostPort->print("e09 move request rejected in teach mode, "); hostPort->print(config->servoName); hostPort->println();
 		return;
 	}
 
-	if (!attached()) {
+	bool wasAttached = attached();
+	if (wasAttached) {
+		followPositionModel();		// start from where a stopped servo has got to in the meantime
+	}
+	if (!wasAttached) {
 		// individual servos might get detached by reaching autodetach time after finished move
-		//Serial.print("e02 sequence error, servo not attached "); Serial.print(servoName); Serial.println();
+		//hostPort->print("e02 sequence error, servo not attached "); hostPort->print(servoName); hostPort->println();
 		attach();
 	}
 
 	targetPosition = adjustOutlierPosition(targetPos);
+	holding = false;			// the new request replaces the hold of the last target
+	blending = false;
+	moveEnd = MOVE_END_REACHED;
 
 	startMillis = millis();		// for realtime log
 	startPosition = currentPosition;
+
 	durationMs = thisDuration;
 
 	if (targetPosition == currentPosition ) {
 		// ignore move command to current position
 		//expectedPosition = currentPosition;		// make sure to report last position in servo update
 		if (thisServoVerbose) {
-			Serial.print("i01 request for move to current position, request ignored ");
-			Serial.print(servoName);
-			Serial.println();
+			hostPort->print("i01 request for move to current position, request ignored ");
+			hostPort->print(config->servoName);
+			hostPort->println();
+		}
+		// send target reached message to controller, for joint group members the group reports it
+		if (!inJointGroupMove) {
+			byte status = buildStatusByte(assigned, moving, servo.attached(), autoDetachMs > 0, thisServoVerbose, true);
+			sendServoStatus(pin, status, currentPosition);
 		}
-		// send target reached message to controller
-		byte status = buildStatusByte(assigned, moving, servo.attached(), autoDetachMs > 0, thisServoVerbose, true);
-		sendServoStatus(pin, status, currentPosition);
 		return;
 	}
 
+	// stretch the move to respect the servo speed and acceleration limits
+	int distance = abs(targetPosition - currentPosition);
+	durationMs = restMoveDurationMs(distance, thisDuration);
+	accelPhaseMs = 0;
+	if (config->maxAccel > 0 && distance > 0) {
+		// trapezoidal profile, acceleration phase for the given duration and distance
+		float t = durationMs / 1000.0;
+		float root = t * t - 4.0 * distance / config->maxAccel;
+		if (root < 0) {
+			root = 0;
+		}
+		accelPhaseMs = 1000 * (t - sqrt(root)) / 2;
+	}
+	reportStretchedDuration(thisDuration);
+
 	inMoveRequest = true;
+	if (moveRecord != NULL) {
+		moveRecordStart(moveRecord, startPosition, targetPosition);
+	}
+	moveMetricsStart(&moveMetrics, startPosition, targetPosition);
 
-	// for feedback servos: to calculate movedAngle we need to know how the sensor rotates in the requested move
-	if (feedbackInverted) {
-		isFeedbackClockwise = targetPosition > currentPosition;
-	} else {
-		isFeedbackClockwise = targetPosition < currentPosition;
+	// the position model runs from the last write, a detached servo has not followed it
+	if (!hasPositionModel() || !wasAttached) {
+		predictedPosition = currentPosition;
+		servoWritePosition = currentPosition;
 	}
+	lastModelMillis = millis();
+	setModelSettleMs(abs(targetPosition - currentPosition));
 
 	// break the move into partial requests in 20 ms intervalls
-	numPartialSteps = durationMs / 20;
+	// the input shaper adds the time of its last impulse
+	numPartialSteps = durationMs / 20 + (inputShaperDelayMs(&config->shaper) + 19) / 20;
+	totalPartialSteps = numPartialSteps;
 	stepIncrement = (targetPosition - currentPosition) / float(numPartialSteps);
 	// start with wanted position = currentPosition and request a linear move to the target
 	wantedPosition = currentPosition;
 
 	if (isFeedbackServo) {
 		// initialize variables for monitoring
-		magnetStartAngle = readCurrentMagnetAngle(i2cMultiplexerChannel, false);
-		magnetCurrentAngle = magnetStartAngle;
-		magnetPreviousAngle = magnetStartAngle;
-		magnetAngleToMove = (targetPosition - currentPosition) * degPerPos;
-		angleFromFullRotations = 0;
-		magnetAngleMoved = 0;
+		initFeedbackReference();
+		magnetAngleToMove = (targetPosition - currentPosition) * config->degPerPos;
 		//startupBoostActive = true;		// this requests the final position to get things going
-		//Serial.println("startupBoost activated");
+		//hostPort->println("startupBoost activated");
 		//boostPos = targetPos;
 
+		// initialize stall detection
+		servoBlocked = false;
+		stallTicks = 0;
+		stallPrevPosition = currentPosition;
+		stallPrevWanted = currentPosition;
+
 		// initialize PID controller
 		pidError = 0;
-		cumError = 0;
-		rateError = 0;		
-		prevStepMillis = millis();
-		pidLastError = targetPosition - currentPosition;
-
-		// set an initial servoWritePosition to force the start of the servo
-		servoWritePosition = wantedPosition - (2 * (startPosition - targetPosition));
+		pidIntegral = 0;
+		pidDerivative = 0;
+		pidOutput = 0;
+		pidSaturated = false;
+		prevPidMillis = millis();
+		pidPrevMeasured = currentPosition;
+		slackDirection = targetPosition > startPosition ? 1 : -1;
+
+		// set an initial servoWritePosition to force the start of the servo, within 0..180 (the byte wraps)
+		servoWritePosition = constrain(round(wantedPosition - 2 * (startPosition - targetPosition)), 0, 180);
 	}
 
 	moving = true;
 	lastStatusUpdate = millis();
 
 	if (thisServoVerbose) {
-		Serial.print("v01 ");
-		Serial.print(servoName);
-		Serial.print(", a"); Serial.print(arduinoId);
-		Serial.print(", moveTo"); 
-		Serial.print(", pin: "); Serial.print(pin);
-		Serial.print(", targ: "); Serial.print(targetPos);
-		Serial.print(", dur: "); Serial.print(durationMs);
-		Serial.print(", start: "); Serial.print(currentPosition);
-		Serial.print(", numSteps: "); Serial.print(numPartialSteps);
-		Serial.print(", stepInc: "); Serial.print(stepIncrement);
-		Serial.println();
+		hostPort->print("v01 ");
+		hostPort->print(config->servoName);
+		hostPort->print(", a"); hostPort->print(arduinoId);
+		hostPort->print(", moveTo"); 
+		hostPort->print(", pin: "); hostPort->print(pin);
+		hostPort->print(", targ: "); hostPort->print(targetPos);
+		hostPort->print(", dur: "); hostPort->print(durationMs);
+		hostPort->print(", start: "); hostPort->print(currentPosition);
+		hostPort->print(", numSteps: "); hostPort->print(numPartialSteps);
+		hostPort->print(", stepInc: "); hostPort->print(stepIncrement);
+		hostPort->println();
+	}
+}
+
+
+void Mai3Servo::setMotionLimits(int servoMaxSpeed, int servoMaxAccel) {
+	config->maxSpeed = servoMaxSpeed;
+	config->maxAccel = servoMaxAccel;
+}
+
+
+// a move stretched by the motion limits, reported with log_i07 or for verbose servos
+void Mai3Servo::reportStretchedDuration(int requestedMs) {
+
+	if ((config->maxSpeed == 0 && config->maxAccel == 0) || durationMs == requestedMs) {
+		return;
+	}
+	if (log_i07 || thisServoVerbose) {
+		hostPort->print("i07 effective duration, pin: "); hostPort->print(pin);
+		hostPort->print(", requested: "); hostPort->print(requestedMs);
+		hostPort->print(", duration: "); hostPort->print(durationMs);
+		hostPort->println();
+	}
+}
+
+
+// duration of a move from rest over distance positions, the requested duration stretched to the limits
+int Mai3Servo::restMoveDurationMs(int distance, int thisDuration) {
+
+	int minDurationMs = minMoveDurationMs(distance);
+	int duration = thisDuration;
+	if (duration < minDurationMs) {
+		duration = minDurationMs;
+	}
+	if (duration < 20) {
+		duration = 20;
+	}
+	return duration;
+}
+
+
+// duration a move request gets from moveTo or retarget, e.g. for the common duration of a joint group
+// a moving servo blends from its planned position and velocity, a servo at rest starts from currentPosition
+int Mai3Servo::effectiveDurationMs(int targetPos, int thisDuration) {
+
+	if (isBlendPossible()) {
+		float position, velocity;
+		blendStartState(&position, &velocity);
+		return blendDurationMs(clampPosition(targetPos) - position, velocity, thisDuration);
+	}
+	return restMoveDurationMs(abs(clampPosition(targetPos) - currentPosition), thisDuration);
+}
+
+
+// shortest move duration for distance positions within maxSpeed and maxAccel
+int Mai3Servo::minMoveDurationMs(int distance) {
+
+	float seconds = 0;
+
+	if (config->maxSpeed > 0 && config->maxAccel > 0) {
+		if (distance <= float(config->maxSpeed) * config->maxSpeed / config->maxAccel) {
+			seconds = 2 * sqrt(float(distance) / config->maxAccel);		// max speed not reached
+		} else {
+			seconds = float(distance) / config->maxSpeed + float(config->maxSpeed) / config->maxAccel;
+		}
+	} else if (config->maxSpeed > 0) {
+		seconds = float(distance) / config->maxSpeed;
+	} else if (config->maxAccel > 0) {
+		seconds = 2 * sqrt(float(distance) / config->maxAccel);
+	}
+
+	// round up to the 20 ms update period
+	int ms = ceil(seconds * 1000);
+	return ((ms + 19) / 20) * 20;
+}
+
+
+// part of the move distance done msInMove after the start (0..1)
+// trapezoidal speed with accelPhaseMs acceleration and deceleration, linear without acceleration limit
+float Mai3Servo::moveFraction(long msInMove) {
+
+	if (msInMove >= durationMs) {
+		return 1;
+	}
+	if (msInMove <= 0) {
+		return 0;
+	}
+	float cruiseSpeed = 1.0 / (durationMs - accelPhaseMs);	// fraction per ms
+	if (msInMove < accelPhaseMs) {
+		return 0.5 * cruiseSpeed * msInMove * msInMove / accelPhaseMs;
+	}
+	if (msInMove < durationMs - accelPhaseMs) {
+		return cruiseSpeed * (msInMove - accelPhaseMs / 2.0);
+	}
+	long msToGo = durationMs - msInMove;
+	return 1 - 0.5 * cruiseSpeed * msToGo * msToGo / accelPhaseMs;
+}
+
+
+// keep the move request until startQueuedMoves finds room in the power group current budget
+// a newer request replaces the queued one but keeps its place in the queue
+void Mai3Servo::queueMove(int targetPos, int thisDuration) {
+
+	if (!moveQueued) {
+		queuedMillis = millis();
+	}
+	moveQueued = true;
+	queuedPosition = targetPos;
+	queuedDurationMs = thisDuration;
+
+	if (thisServoVerbose) {
+		hostPort->print("i70 move queued by current budget, ");
+		hostPort->print(config->servoName);
+		hostPort->print(", targ: "); hostPort->print(targetPos);
+		hostPort->print(", dur: "); hostPort->print(thisDuration);
+		hostPort->println();
+	}
+}
+
+
+// estimated current of the servo, see currentBudget
+int Mai3Servo::estimatedCurrentMa() {
+	// a holding servo draws the run current
+	return estimatedServoCurrentMa(&config->servoCurrent, (inMoveRequest && moving) || holding, millis() - startMillis);
+}
+
+
+// run a relay feedback experiment to find PID values or the backlash sweep, see autoTune
+// the servo oscillates around its current position within min/max
+void Mai3Servo::startAutoTune(autoTuneType *tune, int experiment, int relayAmplitude, int cycles) {
+
+	if (!attached()) {
+		attach();
+	}
+
+	startMillis = millis();
+	startPosition = currentPosition;
+	initFeedbackReference();
+
+	autoTuneStart(tune, experiment, currentPosition, relayAmplitude, cycles, config->min, config->max, millis());
+	autoTune = tune;
+	inMoveRequest = true;
+	moving = true;
+
+	if (thisServoVerbose) {
+		hostPort->print("i84 autotune started, "); hostPort->print(config->servoName);
+		hostPort->print(", experiment: "); hostPort->print(experiment);
+		hostPort->print(", center: "); hostPort->print(tune->centerPosition);
+		hostPort->print(", amplitude: "); hostPort->print(relayAmplitude);
+		hostPort->print(", cycles: "); hostPort->print(cycles);
+		hostPort->println();
 	}
 }
 
 
+// one step of the autotune experiment, replaces the move logic of update()
+void Mai3Servo::autoTuneUpdate() {
+
+	readFeedbackPosition();
+	int ms = millis() - startMillis;
+
+	servoWritePosition = autoTuneStep(autoTune, currentPosition, millis());
+	writeServoPosition(servoWritePosition, inverted);
+
+	byte status = buildStatusByte(assigned, moving, servo.attached(), autoDetachMs > 0, thisServoVerbose, false);
+	sendFeedbackStatus(pin, status, currentPosition, ms, servoWritePosition, autoTune->centerPosition);
+
+	if (!autoTuneFinished(autoTune)) {
+		return;
+	}
+
+	if (autoTune->phase == AUTOTUNE_DONE && autoTune->experiment == AUTOTUNE_BACKLASH_SWEEP) {
+		hostPort->print("i85 backlash sweep result "); hostPort->print(config->servoName);
+		hostPort->print(", pin: "); hostPort->print(pin);
+		hostPort->print(", backlash: "); hostPort->print(autoTune->backlash);
+		hostPort->print(", deadband: "); hostPort->print(autoTune->deadband);
+		hostPort->print(", ramps:");
+		for (int i = 0; i < AUTOTUNE_SWEEP_RAMPS; i++) {
+			hostPort->print(" "); hostPort->print(autoTune->sweepOffset[i]);
+		}
+		hostPort->println();
+	} else if (autoTune->phase == AUTOTUNE_DONE) {
+		hostPort->print("i85 autotune result "); hostPort->print(config->servoName);
+		hostPort->print(", pin: "); hostPort->print(pin);
+		hostPort->print(", Ku: "); hostPort->print(autoTune->ultimateGain);
+		hostPort->print(", TuMs: "); hostPort->print(autoTune->ultimatePeriodMs);
+		hostPort->print(", kp: "); hostPort->print(autoTune->kp);
+		hostPort->print(", ki: "); hostPort->print(autoTune->ki);
+		hostPort->print(", kd: "); hostPort->print(autoTune->kd);
+		hostPort->print(", lagMs: "); hostPort->print(autoTune->lagMs);
+		hostPort->print(", deadband: "); hostPort->print(autoTune->deadband);
+		hostPort->println();
+	} else {
+		hostPort->print("e85 autotune failed "); hostPort->print(config->servoName);
+		hostPort->print(", pin: "); hostPort->print(pin);
+		hostPort->print(", reason: "); hostPort->print(autoTune->failReason);
+		hostPort->println();
+	}
+	stopServo();
+}
+
+
+// model of the physical position of a servo without feedback sensor
+// first order lag with time constant modelLagMs followed by a slew limit of modelMaxSpeed positions/s
+void Mai3Servo::setPositionModel(int lagMs, int speed) {
+	config->modelLagMs = lagMs;
+	config->modelMaxSpeed = speed;
+	predictedPosition = currentPosition;
+	lastModelMillis = millis();
+}
+
+
+bool Mai3Servo::hasPositionModel() {
+	return config->modelLagMs > 0 || config->modelMaxSpeed > 0;
+}
+
+
+// advance the model to now, the servo was following servoWritePosition since the last update
+void Mai3Servo::updatePositionModel() {
+
+	unsigned long now = millis();
+	unsigned long dtMs = now - lastModelMillis;
+	lastModelMillis = now;
+
+	if (!hasPositionModel()) {
+		predictedPosition = servoWritePosition;
+		return;
+	}
+
+	float delta = servoWritePosition - predictedPosition;
+	if (config->modelLagMs > 0) {
+		delta = delta * (1 - exp(-float(dtMs) / config->modelLagMs));
+	}
+	if (config->modelMaxSpeed > 0) {
+		float maxDelta = config->modelMaxSpeed * dtMs / 1000.0;
+		if (delta > maxDelta) delta = maxDelta;
+		if (delta < -maxDelta) delta = -maxDelta;
+	}
+	predictedPosition += delta;
+}
+
+
+// a servo without feedback sensor keeps moving towards the last written position after a stop,
+// advance the model to now and take the modelled position
+void Mai3Servo::followPositionModel() {
+	if (isFeedbackServo || moving || !servo.attached()) {
+		return;
+	}
+	updatePositionModel();
+	currentPosition = round(predictedPosition);
+}
+
+
+// modelled position close to the target
+bool Mai3Servo::isModelArrived() {
+	if (!hasPositionModel()) {
+		return true;
+	}
+	return fabs(predictedPosition - targetPosition) < 0.5;
+}
+
+
 // inverted flag is only treated here, do not include it in position calculation
+// a write calibration table maps the position to the servo value, the table includes the inversion
 void Mai3Servo::writeServoPosition(int position, bool inverted) {
 
 	if (thisServoVerbose)  {
-		Serial.print(millis()-startMillis); Serial.print(" ms ");
-		Serial.print("writeServoPosition: "), Serial.print(position); Serial.println();
+		hostPort->print(millis()-startMillis); hostPort->print(" ms ");
+		hostPort->print("writeServoPosition: "), hostPort->print(position); hostPort->println();
+	}
+
+	if (calibrationActive(&config->writeTable)) {
+		// values from 544 on are taken as pulse width in us by servo.write
+		servo.write(round(calibrationApply(&config->writeTable, position)));
+		return;
 	}
 
 	if (inverted) {
@@ -227,55 +589,685 @@ void Mai3Servo::detachServo(bool forceDetach) {
 		servo.detach();
 
 		if (thisServoVerbose) {
-			Serial.print("m14 pin: "); Serial.print(pin); 
-			Serial.print(", "); Serial.print(servoName); Serial.print(" detached");
-			Serial.println();
+			hostPort->print("m14 pin: "); hostPort->print(pin); 
+			hostPort->print(", "); hostPort->print(config->servoName); hostPort->print(" detached");
+			hostPort->println();
 		}
 	}
 }
 
+// with simulated feedback the joint follows the written position like the position model of
+// servos without feedback (m command) and the sensor angle changes by degPerPos per position
+void Mai3Servo::setSimulatedFeedback(bool simulated, int refAngle) {
+	simulatedFeedback = simulated;
+	simRefAngle = refAngle;
+	simRefPosition = currentPosition;
+	predictedPosition = currentPosition;
+	magnetAbsoluteValid = false;		// other sensor source
+	magnetRefValid = false;
+	servoWritePosition = currentPosition;
+	lastModelMillis = millis();
+}
+
+
+int Mai3Servo::readMagnetAngle(bool isVerbose) {
+	if (!simulatedFeedback) {
+		return readCurrentMagnetAngle(config->i2cMultiplexerChannel, isVerbose);
+	}
+	updatePositionModel();
+
+	// same relation as evalPositionFromFeedbackSensor: position increases with decreasing angle
+	int angle = simRefAngle - round((predictedPosition - simRefPosition) * config->degPerPos);
+	return ((angle % 360) + 360) % 360;
+}
+
+
+// follow the sensor angle over full turns with the shortest angular change since the last read
+// a change faster than maxMagnetSpeed is rejected as a fault (noise, missed turn), after
+// MAX_REJECTED_MAGNET_READS rejected reads in a row the new angle is accepted to resynchronize
+bool Mai3Servo::unwrapMagnetAngle(int angle) {
+
+	unsigned long now = millis();
+	if (!magnetAbsoluteValid) {
+		magnetAbsoluteAngle = angle;
+		if (calibrationActive(&config->sensorTable)) {
+			// the turn within the sensor table, its angle range must be less than a full turn
+			int center = (config->sensorTable.x[0] + config->sensorTable.x[config->sensorTable.numPoints - 1]) / 2;
+			while (magnetAbsoluteAngle < center - 180) magnetAbsoluteAngle += 360;
+			while (magnetAbsoluteAngle >= center + 180) magnetAbsoluteAngle -= 360;
+		}
+		magnetCurrentAngle = angle;
+		magnetReadMillis = now;
+		magnetRejectedReads = 0;
+		magnetAbsoluteValid = true;
+		return true;
+	}
+
+	int delta = ((angle - magnetCurrentAngle) % 360 + 540) % 360 - 180;		// -180..179
+	if (config->maxMagnetSpeed > 0 && magnetRejectedReads < MAX_REJECTED_MAGNET_READS) {
+		long maxDelta = (long)config->maxMagnetSpeed * (now - magnetReadMillis) / 1000 + MAGNET_NOISE_DEG;
+		if (abs(delta) > maxDelta) {
+			magnetRejectedReads++;
+			magnetFaults++;
+			if (thisServoVerbose || magnetRejectedReads == 1) {
+				hostPort->print("w06 magnet angle change too fast, "); hostPort->print(config->servoName);
+				hostPort->print(", angle: "); hostPort->print(angle);
+				hostPort->print(", previous: "); hostPort->print(magnetCurrentAngle);
+				hostPort->print(", faults: "); hostPort->print(magnetFaults);
+				hostPort->println();
+			}
+			return false;
+		}
+	}
+	magnetRejectedReads = 0;
+	magnetAbsoluteAngle += delta;
+	magnetCurrentAngle = angle;
+	magnetReadMillis = now;
+	return true;
+}
+
+
+// the absolute angle at the start of a move is the reference for the start detection of the move
+// the position reference (magnetRefAngle/magnetRefPosition) is kept across moves
+void Mai3Servo::initFeedbackReference() {
+	unwrapMagnetAngle(readMagnetAngle(false));
+	if (!magnetRefValid) {
+		magnetRefAngle = magnetAbsoluteAngle;
+		magnetRefPosition = currentPosition;
+		magnetRefValid = true;
+	}
+	magnetStartAngle = magnetAbsoluteAngle;
+	magnetAngleMoved = 0;
+}
+
+
+// read the magnet angle and update currentPosition
+void Mai3Servo::readFeedbackPosition() {
+
+	if (!unwrapMagnetAngle(readMagnetAngle(true))) {
+		return;		// keep the last position
+	}
+	if (!magnetRefValid) {
+		magnetRefAngle = magnetAbsoluteAngle;
+		magnetRefPosition = currentPosition;
+		magnetRefValid = true;
+	}
+	currentPosition = evalPositionFromFeedbackSensor();
+	idleReportedPosition = currentPosition;
+}
+
+
+// read the sensor of an idle feedback servo and follow position changes by external forces
+// a joint must not turn the magnet by more than 180 degrees between two reads
+void Mai3Servo::monitorIdlePosition() {
+
+	if (!magnetRefValid) {
+		readFeedbackPosition();
+		return;
+	}
+	if (!unwrapMagnetAngle(readMagnetAngle(false))) {
+		return;
+	}
+	currentPosition = evalPositionFromFeedbackSensor();
+
+	if (abs(currentPosition - idleReportedPosition) > config->driftThreshold) {
+		hostPort->print("w05 idle position drift, "); hostPort->print(config->servoName);
+		hostPort->print(", pin: "); hostPort->print(pin);
+		hostPort->print(", from: "); hostPort->print(idleReportedPosition);
+		hostPort->print(", to: "); hostPort->print(currentPosition);
+		hostPort->println();
+		idleReportedPosition = currentPosition;
+
+		byte status = buildStatusByte(assigned, moving, servo.attached(), autoDetachMs > 0, thisServoVerbose, false, servoBlocked);
+		sendServoStatus(pin, status, currentPosition);
+	}
+}
+
+
+// the position increases with decreasing magnet angle, a sensor calibration table maps the angle directly
 byte Mai3Servo::evalPositionFromFeedbackSensor() {
 
-	// magnet angle moved is a +/- angle)
-	if (isFeedbackClockwise) {
-		magnetAngleMoved = magnetStartAngle - magnetCurrentAngle + angleFromFullRotations;
+	magnetAngleMoved = magnetStartAngle - magnetAbsoluteAngle;		// +/- angle since move start
+	if (calibrationActive(&config->sensorTable)) {
+		int position = round(sensorPosition());
+		return constrain(position, 0, 180);
+	}
+	return round(sensorPosition());
+}
+
+
+// unrounded position of the last accepted sensor angle
+float Mai3Servo::sensorPosition() {
+	if (calibrationActive(&config->sensorTable)) {
+		return calibrationApply(&config->sensorTable, magnetAbsoluteAngle);
+	}
+	return magnetRefPosition + (magnetRefAngle - magnetAbsoluteAngle) / config->degPerPos;
+}
+
+
+// read the sensor of a servo without move request, updates currentPosition
+// returns the unrounded position for the finer resolution of the teach mode
+float Mai3Servo::readSensorPosition() {
+	if (!magnetRefValid) {
+		readFeedbackPosition();
+	} else if (unwrapMagnetAngle(readMagnetAngle(false))) {
+		currentPosition = evalPositionFromFeedbackSensor();
+	}
+	return sensorPosition();
+}
+
+
+// table 0: write table, 1: sensor table
+// the sensor angle is followed again from the next read to select the turn within the new table
+bool Mai3Servo::setCalibrationPoint(int table, int x, int y) {
+	if (table == 1) {
+		magnetAbsoluteValid = false;
+		magnetRefValid = false;
+		return calibrationAddPoint(&config->sensorTable, x, y);
+	}
+	return calibrationAddPoint(&config->writeTable, x, y);
+}
+
+
+void Mai3Servo::clearCalibration(int table) {
+	if (table == 1) {
+		magnetAbsoluteValid = false;
+		magnetRefValid = false;
+		calibrationClear(&config->sensorTable);
 	} else {
-		magnetAngleMoved = magnetStartAngle - magnetCurrentAngle - angleFromFullRotations;
+		calibrationClear(&config->writeTable);
+	}
+}
+
+
+// compact end of move record of a feedback servo
+// M<pin>,<endReason>,<durationMs>,<maxError>,<rmsError>,<overshoot>,<settleMs>,<saturatedTicks>,<ticks>
+void Mai3Servo::sendMoveMetrics(int endReason) {
+	if (!log_moveMetrics) {
+		return;
 	}
-	return startPosition + round(magnetAngleMoved / degPerPos);
+	hostPort->print("M"); hostPort->print(pin);
+	hostPort->print(","); hostPort->print(endReason);
+	hostPort->print(","); hostPort->print(moveMetrics.durationMs);
+	hostPort->print(","); hostPort->print(moveMetrics.maxError, 1);
+	hostPort->print(","); hostPort->print(moveMetricsRmsError(&moveMetrics), 1);
+	hostPort->print(","); hostPort->print(moveMetrics.overshoot, 1);
+	hostPort->print(","); hostPort->print(moveMetrics.settleMs);
+	hostPort->print(","); hostPort->print(moveMetrics.saturatedTicks);
+	hostPort->print(","); hostPort->print(moveMetrics.ticks);
+	hostPort->println();
 }
 
 
-int Mai3Servo::computePid() {
+// PID control of the servoWritePosition
+// dt is measured in units of the 20 ms update period, this keeps the meaning of the ki and kd values
+// the derivative is taken from the measured position to avoid kicks when wantedPosition jumps
+// the integral part is limited and frozen while the output is saturated (anti-windup)
+// plannedVelocity (positions per update period) is fed forward with kv
+// the gravity feedforward of the wanted position is added to the correction
+int Mai3Servo::computePid(float plannedVelocity) {
 
 	unsigned long currentTime = millis();
-    unsigned long elapsedTime = (currentTime - prevStepMillis) / 20;       //compute time elapsed from previous computation
-	int out;
+	float dt = (currentTime - prevPidMillis) / 20.0;	// time since last computation in update periods
 
-    pidError = wantedPosition - currentPosition;
+	// guard against a second call within the same millisecond and long gaps
+	if (dt <= 0) dt = 1;
+	if (dt > 5) dt = 5;
 
-	cumError += pidError * elapsedTime;               // compute integral
-	rateError = (pidError - pidLastError)/elapsedTime;   // compute derivative
+	pidError = wantedPosition - currentPosition;
+	pidDerivative = (currentPosition - pidPrevMeasured) / dt;
 
-	out = wantedPosition + int(kp*pidError + ki*cumError + kd*rateError);  //PID output      
+	float integral = pidIntegral + config->ki * pidError * dt;
+	if (integral > config->integralLimit) integral = config->integralLimit;
+	if (integral < -config->integralLimit) integral = -config->integralLimit;
 
-	if (out < 0) out = 0;
-	if (out > 180) out = 180;
-	
-	pidLastError = pidError;            //remember current error
-	prevStepMillis = currentTime;       //remember current time
+	float gravity = gravityFeedforward(wantedPosition);
+	float correction = config->kp * pidError + integral - config->kd * pidDerivative + config->kv * plannedVelocity + gravity;
+	correction += slackCompensation(correction);
+
+	pidSaturated = false;
+	if (correction > config->outputLimit) {correction = config->outputLimit; pidSaturated = true;}
+	if (correction < -config->outputLimit) {correction = -config->outputLimit; pidSaturated = true;}
+
+	int out = round(wantedPosition + correction);
+	if (out < 0) {out = 0; pidSaturated = true;}
+	if (out > 180) {out = 180; pidSaturated = true;}
+
+	// only integrate while the output is able to follow
+	if (!pidSaturated || (integral * pidError < 0)) {
+		pidIntegral = integral;
+	}
+
+	pidOutput = correction;
+	pidPrevMeasured = currentPosition;	//remember current measurement
+	prevPidMillis = currentTime;		//remember current time
 
 	if (thisServoVerbose) {
-		Serial.print("PID, pidError: "); Serial.print(pidError);
-		Serial.print(", cumError: "); Serial.print(cumError);
-		Serial.print(", rateError: "); Serial.print(rateError);
-		Serial.print(", out:"); Serial.print(out);
-		Serial.println();
+		hostPort->print("PID, pidError: "); hostPort->print(pidError);
+		hostPort->print(", integral: "); hostPort->print(pidIntegral);
+		hostPort->print(", derivative: "); hostPort->print(pidDerivative);
+		hostPort->print(", feedforward: "); hostPort->print(config->kv * plannedVelocity);
+		hostPort->print(", gravity: "); hostPort->print(gravity);
+		hostPort->print(", slackDir: "); hostPort->print(slackDirection);
+		hostPort->print(", out:"); hostPort->print(out);
+		hostPort->println();
 	}
 
 	return out;                         //return the new servoWritePosition
 }
 
+
+// gear backlash and servo deadband
+// after a reversal the servo has to take up the gear slack before the joint (and the sensor) moves,
+// the write position leads by half the backlash in the direction of the error.
+// Small corrections within the servo deadband get lost, as long as the error is at least one
+// position the write position keeps the deadband (beyond the slack) away from the joint.
+// returns the change of the PID correction
+float Mai3Servo::slackCompensation(float correction) {
+
+	if (config->backlash <= 0 && config->deadband <= 0) return 0;
+
+	// direction with hysteresis, errors below one position keep the last direction
+	if (pidError >= 1) slackDirection = 1;
+	if (pidError <= -1) slackDirection = -1;
+
+	float write = wantedPosition + correction + slackDirection * config->backlash / 2;
+	if (fabs(pidError) >= 1 && config->deadband > 0) {
+		float minWrite = currentPosition + slackDirection * (config->backlash / 2 + config->deadband);
+		if (slackDirection * (minWrite - write) > 0) {
+			write = minWrite;
+		}
+	}
+	return write - wantedPosition - correction;
+}
+
+
+void Mai3Servo::setSlackCompensation(float backlash, float deadband) {
+	config->backlash = backlash;
+	config->deadband = deadband;
+}
+
+
+// gravity feedforward at position, linear interpolation between the two neighbour bins
+float Mai3Servo::gravityFeedforward(float position) {
+
+	if (config->max <= config->min) return config->gravityFf[0];
+
+	float bin = (position - config->min) * (GRAVITY_BINS - 1) / (config->max - config->min);
+	if (bin <= 0) return config->gravityFf[0];
+	if (bin >= GRAVITY_BINS - 1) return config->gravityFf[GRAVITY_BINS - 1];
+
+	int lower = (int)bin;
+	float share = bin - lower;
+	return config->gravityFf[lower] * (1 - share) + config->gravityFf[lower + 1] * share;
+}
+
+
+// learn the gravity feedforward from the steady state PID output at the arrival
+// the integral part holds the load not covered by the table yet, gravityLearnPercent of it
+// is moved into the two bins around the position, weighted like the interpolation
+void Mai3Servo::learnGravityFeedforward() {
+
+	if (config->gravityLearnPercent <= 0 || config->ki <= 0 || pidSaturated) return;
+	if (config->max <= config->min) return;
+
+	float bin = (float)(currentPosition - config->min) * (GRAVITY_BINS - 1) / (config->max - config->min);
+	bin = constrain(bin, 0, GRAVITY_BINS - 1);
+	int lower = (int)bin;
+	if (lower > GRAVITY_BINS - 2) lower = GRAVITY_BINS - 2;
+	float share = bin - lower;
+
+	// a joint resting against an obstacle keeps adding its integral, the feedforward alone must not
+	// exceed the correction limit of the PID
+	float learned = pidIntegral * config->gravityLearnPercent / 100.0;
+	float limit = config->outputLimit;
+	config->gravityFf[lower] = constrain(config->gravityFf[lower] + learned * (1 - share), -limit, limit);
+	config->gravityFf[lower + 1] = constrain(config->gravityFf[lower + 1] + learned * share, -limit, limit);
+
+	if (thisServoVerbose) {
+		hostPort->print("i26 gravity feedforward learned, "); hostPort->print(config->servoName);
+		hostPort->print(", position: "); hostPort->print(currentPosition);
+		hostPort->print(", integral: "); hostPort->print(pidIntegral);
+		hostPort->print(", bins "); hostPort->print(lower); hostPort->print("/"); hostPort->print(lower + 1);
+		hostPort->print(": "); hostPort->print(config->gravityFf[lower]);
+		hostPort->print("/"); hostPort->print(config->gravityFf[lower + 1]);
+		hostPort->println();
+	}
+}
+
+// wanted position is a linear position between startPosition and targetPosition within the move duration time
+// with a sinusoidal part added for acceleration/deceleration
+float Mai3Servo::profilePosition(long msInMove) {
+
+	// if the move time has elapsed limit the wantedPositon to the targetPosition
+	if (msInMove >= durationMs) {
+		return targetPosition;
+	}
+	if (msInMove <= 0) {
+		return startPosition;
+	}
+
+	float xFactor = float(msInMove) / durationMs;
+	int yRange = targetPosition - startPosition;
+	float linearY = xFactor * yRange * 1.05;		// for compensating lag request a slightly ahead position
+
+	float sinePart = xFactor * 4 - 2;
+	int sineFactor = 8;
+	float sineYOffset =  sineFactor * sin(sinePart*3.1416/2);
+
+	if (targetPosition > startPosition) {
+		return startPosition + linearY + sineYOffset;
+	} else {
+		return startPosition + linearY - sineYOffset;
+	}
+}
+
+
+// planned position of the move msInMove after its start, without the input shaper
+float Mai3Servo::plannedPosition(long msInMove) {
+
+	if (blending) {
+		return blendPosition(msInMove);
+	}
+	if (isFeedbackServo) {
+		return profilePosition(msInMove);
+	}
+	return startPosition + (targetPosition - startPosition) * moveFraction(msInMove);
+}
+
+
+// the shaped move is the sum of the planned moves delayed by the shaper impulses
+// a blended move is not shaped: it starts with the shaped position and velocity of the interrupted
+// move, the delayed impulses of the blend would still be at its start and drop part of the velocity
+float Mai3Servo::shapedPosition(long msInMove) {
+
+	if (blending) {
+		return plannedPosition(msInMove);
+	}
+	const inputShaperType *shaper = &config->shaper;
+	float position = 0;
+	for (int i = 0; i < shaper->numImpulses; i++) {
+		position += shaper->amplitude[i] * plannedPosition(msInMove - shaper->impulseMs[i]);
+	}
+	return position;
+}
+
+
+// cubic hermite curve from the position and velocity of the interrupted move to the new target,
+// arriving with velocity 0. A start velocity away from the target overshoots the start position,
+// the curve is kept within min/max.
+float Mai3Servo::blendPosition(long msInMove) {
+
+	if (msInMove <= 0) {
+		return blendStartPosition;
+	}
+	if (msInMove >= durationMs) {
+		return targetPosition;
+	}
+	float s = float(msInMove) / durationMs;
+	float s2 = s * s;
+	float s3 = s2 * s;
+	float position = (2 * s3 - 3 * s2 + 1) * blendStartPosition
+		+ (s3 - 2 * s2 + s) * durationMs * blendStartVelocity
+		+ (-2 * s3 + 3 * s2) * targetPosition;
+	return constrain(position, config->min, config->max);
+}
+
+
+// true if the blend over durationMillis stays within maxSpeed and maxAccel, distance in positions,
+// startVelocity in positions per ms. The start velocity is the one of the interrupted move, only a
+// faster peak later in the blend is limited.
+bool Mai3Servo::isBlendWithinLimits(float distance, float startVelocity, long durationMillis) {
+
+	float t = durationMillis / 1000.0;
+	float v0 = startVelocity * 1000;		// positions per second
+
+	// the acceleration is linear over the curve, its peaks are at the start and the end
+	if (config->maxAccel > 0) {
+		float startAccel = 6 * distance / (t * t) - 4 * v0 / t;
+		float endAccel = -6 * distance / (t * t) + 2 * v0 / t;
+		if (fabs(startAccel) > config->maxAccel || fabs(endAccel) > config->maxAccel) {
+			return false;
+		}
+	}
+
+	// velocity (6s - 6s^2) * distance / t + (3s^2 - 4s + 1) * v0, peak where the acceleration is 0
+	if (config->maxSpeed > 0) {
+		float accelSlope = 12 * distance / t - 6 * v0;
+		if (accelSlope != 0) {
+			float s = (6 * distance / t - 4 * v0) / accelSlope;
+			if (s > 0 && s < 1) {
+				float peakSpeed = fabs((6 * s - 6 * s * s) * distance / t + (3 * s * s - 4 * s + 1) * v0);
+				if (peakSpeed > config->maxSpeed && peakSpeed > fabs(v0)) {
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+
+// a running move can be blended into a new target, autotune runs and queued requests are stopped instead
+bool Mai3Servo::isBlendPossible() {
+	return moving && autoTune == NULL && !moveQueued;
+}
+
+
+// the planned position and velocity (positions per ms) of the running move at the last written step
+void Mai3Servo::blendStartState(float *position, float *velocity) {
+
+	long msInMove = isFeedbackServo ? millis() - startMillis : (totalPartialSteps - numPartialSteps) * 20L;
+	*position = shapedPosition(msInMove);
+	*velocity = (*position - shapedPosition(msInMove - 20)) / 20;
+}
+
+
+// duration of a blend over distance positions from startVelocity, the requested duration stretched
+// until the curve fits maxSpeed and maxAccel, the cubic curve peaks higher than the trapezoid of
+// minMoveDurationMs
+int Mai3Servo::blendDurationMs(float distance, float startVelocity, int thisDuration) {
+
+	int duration = restMoveDurationMs(int(fabs(distance) + 0.5), thisDuration);
+	if (config->maxSpeed > 0 || config->maxAccel > 0) {
+		for (int i = 0; i < 100 && !isBlendWithinLimits(distance, startVelocity, duration); i++) {
+			duration += duration / 8 > 20 ? duration / 8 : 20;
+		}
+	}
+	return duration;
+}
+
+
+// new target for a moving servo: blend from the current planned position and velocity into the
+// new move instead of stopping and restarting from velocity 0. There is no stop status, no
+// new start phase for the current budget, and the PID, stall detection and sensor state continue.
+// The blend is not shaped by the input shaper, see shapedPosition.
+void Mai3Servo::retarget(int targetPos, int thisDuration) {
+
+	// the planned position and velocity of the interrupted move at the last written step
+	float position, velocity;
+	blendStartState(&position, &velocity);
+
+	targetPosition = adjustOutlierPosition(targetPos);
+	blending = true;
+	blendStartPosition = position;
+	blendStartVelocity = velocity;
+	startPosition = round(position);
+	startMillis = millis();
+
+	int distance = abs(targetPosition - startPosition);
+	durationMs = blendDurationMs(targetPosition - position, velocity, thisDuration);
+	accelPhaseMs = 0;
+	reportStretchedDuration(thisDuration);
+
+	numPartialSteps = durationMs / 20;
+	totalPartialSteps = numPartialSteps;
+	setModelSettleMs(distance);
+	magnetAngleToMove = (targetPosition - startPosition) * config->degPerPos;
+
+	// the metrics and the record keep the move, overshoot is measured against the new target
+	moveMetrics.targetPosition = targetPosition;
+	if (moveRecord != NULL) {
+		moveRecord->targetPosition = targetPosition;
+	}
+
+	if (thisServoVerbose) {
+		hostPort->print("w03 new move request while moving, blend into the new target "); hostPort->print(config->servoName);
+		hostPort->print(", from: "); hostPort->print(position);
+		hostPort->print(", velocity: "); hostPort->print(velocity * 1000);
+		hostPort->print(", target: "); hostPort->print(targetPosition);
+		hostPort->print(", dur: "); hostPort->print(durationMs);
+		hostPort->println();
+	}
+}
+
+
+// additional time the position model needs to arrive after the last write
+void Mai3Servo::setModelSettleMs(int distance) {
+	modelSettleMs = 0;
+	if (config->modelLagMs > 0) {
+		modelSettleMs += 5 * config->modelLagMs;
+	}
+	if (config->modelMaxSpeed > 0) {
+		modelSettleMs += 1000L * distance / config->modelMaxSpeed;
+	}
+}
+
+
+// closed loop hold after the arrival of a feedback servo
+// without the hold the servo keeps the last write position and loaded joints sag until the autoDetach
+void Mai3Servo::setHold(int newHoldMs, float kp, float ki, float deadband, int periodMs) {
+	config->holdMs = newHoldMs;
+	config->holdKp = kp;
+	config->holdKi = ki;
+	config->holdDeadband = deadband;
+	config->holdPeriodMs = periodMs;
+}
+
+
+// keep the servo in the motion task and its power group powered while holding
+void Mai3Servo::startHold() {
+	holding = true;
+	inMoveRequest = true;
+	holdStartMillis = millis();
+	holdPrevMillis = holdStartMillis;
+	holdCorrectionMillis = holdStartMillis;
+	holdIntegral = 0;
+	holdBaseWrite = servoWritePosition;
+}
+
+
+// one hold period: PI control of the write position on the measured position
+// corrections within holdDeadband are skipped to avoid hunting around the target
+// the status (current, written and target position) is sent when a value changed
+void Mai3Servo::holdUpdate() {
+
+	unsigned long now = millis();
+	if (config->holdMs > 0 && now - holdStartMillis >= (unsigned long) config->holdMs) {
+		endHold();
+		return;
+	}
+	if (now - holdPrevMillis < (unsigned long) config->holdPeriodMs) {
+		return;
+	}
+	float dt = float(now - holdPrevMillis) / config->holdPeriodMs;	// in hold periods
+	if (dt > 5) dt = 5;
+	holdPrevMillis = now;
+
+	int previousPosition = currentPosition;
+	byte previousWrite = servoWritePosition;
+	readFeedbackPosition();
+
+	float error = targetPosition - currentPosition;
+	if (fabs(error) > config->holdDeadband) {
+		holdIntegral += config->holdKi * error * dt;
+		if (holdIntegral > config->integralLimit) holdIntegral = config->integralLimit;
+		if (holdIntegral < -config->integralLimit) holdIntegral = -config->integralLimit;
+
+		float correction = config->holdKp * error + holdIntegral;
+		if (correction > config->outputLimit) correction = config->outputLimit;
+		if (correction < -config->outputLimit) correction = -config->outputLimit;
+
+		int out = round(holdBaseWrite + correction);
+		servoWritePosition = constrain(out, 0, 180);
+		writeServoPosition(servoWritePosition, inverted);
+	}
+	if (servoWritePosition != previousWrite) {
+		holdCorrectionMillis = now;
+	}
+
+	// the ms field holds the time since the last changed correction, it stays small in an endless hold
+	if (currentPosition != previousPosition || servoWritePosition != previousWrite) {
+		byte status = buildStatusByte(assigned, moving, servo.attached(), autoDetachMs > 0, thisServoVerbose, true);
+		sendFeedbackStatus(pin, status, currentPosition, now - holdCorrectionMillis, servoWritePosition, targetPosition);
+	}
+
+	if (thisServoVerbose) {
+		hostPort->print("hold, error: "); hostPort->print(error);
+		hostPort->print(", integral: "); hostPort->print(holdIntegral);
+		hostPort->print(", servoPos: "); hostPort->print(servoWritePosition);
+		hostPort->println();
+	}
+}
+
+
+// the servo keeps the last write position and leaves the motion task like after an arrival without hold
+void Mai3Servo::endHold() {
+	holding = false;
+	inMoveRequest = false;
+	finalPositionRequestedMillis = millis();
+
+	if (verbose || thisServoVerbose) {
+		hostPort->print("i13 servo "); hostPort->print(config->servoName);
+		hostPort->print(" hold ended, inMoveRequest cleared, position: "); hostPort->print(currentPosition);
+		hostPort->println();
+	}
+	byte status = buildStatusByte(assigned, moving, servo.attached(), autoDetachMs > 0, thisServoVerbose, true);
+	sendServoStatus(pin, status, currentPosition);
+}
+
+
+void Mai3Servo::setStallDetection(int windowTicks, int errorLimit, int velocityPercent) {
+	config->stallWindowTicks = windowTicks;
+	config->stallErrorLimit = errorLimit;
+	config->stallVelocityPercent = velocityPercent;
+}
+
+
+// call once per update with the new measured position
+// an update counts as stalled when the joint is behind the wanted position and it either moves
+// much slower than planned or the PID output is saturated without the joint moving
+// returns true when stallWindowTicks consecutive updates were stalled
+bool Mai3Servo::isStalled() {
+
+	float measuredVelocity = currentPosition - stallPrevPosition;
+	float plannedVelocity = wantedPosition - stallPrevWanted;
+	stallPrevPosition = currentPosition;
+	stallPrevWanted = wantedPosition;
+
+	if (config->stallWindowTicks <= 0) {
+		return false;
+	}
+
+	bool stalledUpdate = false;
+	if (fabs(wantedPosition - currentPosition) >= config->stallErrorLimit) {
+		if (fabs(measuredVelocity) * 100 < config->stallVelocityPercent * fabs(plannedVelocity)) {
+			stalledUpdate = true;
+		}
+		if (pidSaturated && fabs(measuredVelocity) < 1) {
+			stalledUpdate = true;
+		}
+	}
+
+	if (stalledUpdate) {
+		stallTicks += 1;
+	} else {
+		stallTicks = 0;
+	}
+	return stallTicks >= config->stallWindowTicks;
+}
+
+
 int Mai3Servo::computeBand() {
 	/*
 	compare wanted and current position
@@ -310,15 +1302,26 @@ void Mai3Servo::update()
 		return;
 	}
 
+	if (autoTune != NULL) {
+		autoTuneUpdate();
+		return;
+	}
+
+	if (holding) {
+		holdUpdate();
+		return;
+	}
+
 	if (thisServoVerbose) {
-		Serial.print("servo update ms: "); Serial.println(millis() - startMillis);
+		hostPort->print("servo update ms: "); hostPort->println(millis() - startMillis);
 	}
 
 	// limit duration in general (if we can't get to our position)
-	int maxDuration = 2 * durationMs + autoDetachMs;
-	if (millis() - startMillis > (2 * durationMs + autoDetachMs)) {
-		Serial.print("forced servo stop, maxDuration exceeded: "); Serial.println(maxDuration);
-		stopServo();
+	// servos with a position model get the additional time the model needs to settle
+	int maxDuration = 2 * durationMs + autoDetachMs + modelSettleMs + inputShaperDelayMs(&config->shaper);
+	if (millis() - startMillis > (unsigned long) maxDuration) {
+		hostPort->print("forced servo stop, maxDuration exceeded: "); hostPort->println(maxDuration);
+		stopServo(MOVE_END_TIMEOUT);
 	}	
 
 
@@ -326,49 +1329,62 @@ void Mai3Servo::update()
 
 	if (isFeedbackServo) {
 		if (thisServoVerbose) {
-			Serial.print(millis() - startMillis); Serial.print(" ms, ");
-			Serial.print("i60 read magnet, channel: "); Serial.print(i2cMultiplexerChannel);
-			Serial.println();
+			hostPort->print(millis() - startMillis); hostPort->print(" ms, ");
+			hostPort->print("i60 read magnet, channel: "); hostPort->print(config->i2cMultiplexerChannel);
+			hostPort->println();
 		}
-		magnetCurrentAngle = readCurrentMagnetAngle(i2cMultiplexerChannel, true);
-		//if (log_i6x) {Serial.print("i61 magnet position: "); Serial.println(magnet);}
+		readFeedbackPosition();
 		int ms = millis() - startMillis;
 
-		// detect overflow of magnet rotation
-		if (abs(magnetPreviousAngle - magnetCurrentAngle) > 180) {
-			// take special care when magnetCurrentAngle has hysteresis (moves forth and back over overflow position)
-			if (isFeedbackClockwise && magnetCurrentAngle > 180) {angleFromFullRotations += 360;}
-			if (isFeedbackClockwise && magnetCurrentAngle < 180) {angleFromFullRotations -= 360;}
-			if (!isFeedbackClockwise && magnetCurrentAngle > 180) {angleFromFullRotations -= 360;}
-			if (!isFeedbackClockwise && magnetCurrentAngle < 180) {angleFromFullRotations += 360;}
+		// stop and release a blocked joint
+		if (moving && isStalled()) {
+			servoBlocked = true;
+			hostPort->print("e10 servo blocked, "); hostPort->print(config->servoName);
+			hostPort->print(", pin: "); hostPort->print(pin);
+			hostPort->print(", currentPos: "); hostPort->print(currentPosition);
+			hostPort->print(", wantedPos: "); hostPort->print(wantedPosition);
+			hostPort->print(", ms: "); hostPort->print(ms);
+			hostPort->println();
+			stopServo(MOVE_END_STALLED);
+			detachServo(true);
+			return;
 		}
-		magnetPreviousAngle = magnetCurrentAngle;
 
 		// detect move started and stop boost
 		//if (startupBoostActive && abs(magnetStartAngle - magnetCurrentAngle) > 3) {
 		//	startupBoostActive = false;
-		//	Serial.println("startupBoost deactivated");
+		//	hostPort->println("startupBoost deactivated");
 		//}
 
-		currentPosition = evalPositionFromFeedbackSensor();
-
 		if (thisServoVerbose) {
-			Serial.print(ms); Serial.print(" ms");
-			Serial.print(", startPos: "); Serial.print(startPosition);
-			Serial.print(", targetPos: "); Serial.print(targetPosition);			
-			Serial.print(", currPos: "); Serial.print(currentPosition);			
-			Serial.print(", magStart: "); Serial.print(magnetStartAngle);
-			Serial.print(", magToMove: "); Serial.print(magnetAngleToMove);						
-			Serial.print(", magCurr: "); Serial.print(magnetCurrentAngle);
-			Serial.print(", fullRot: "); Serial.print(angleFromFullRotations);
-			Serial.print(", magMoved: "); Serial.print(magnetAngleMoved);
-			Serial.println();
+			hostPort->print(ms); hostPort->print(" ms");
+			hostPort->print(", startPos: "); hostPort->print(startPosition);
+			hostPort->print(", targetPos: "); hostPort->print(targetPosition);			
+			hostPort->print(", currPos: "); hostPort->print(currentPosition);			
+			hostPort->print(", magStart: "); hostPort->print(magnetStartAngle);
+			hostPort->print(", magToMove: "); hostPort->print(magnetAngleToMove);						
+			hostPort->print(", magCurr: "); hostPort->print(magnetCurrentAngle);
+			hostPort->print(", magAbs: "); hostPort->print(magnetAbsoluteAngle);
+			hostPort->print(", magMoved: "); hostPort->print(magnetAngleMoved);
+			hostPort->println();
 		}
 
 		sendFeedbackStatus(pin, status, currentPosition, ms, servoWritePosition, wantedPosition);
 
+		float plannedPosition = shapedPosition(ms);
+		moveMetricsAdd(&moveMetrics, ms, currentPosition, plannedPosition, pidSaturated);
+		if (moveRecord != NULL) {
+			moveRecordTick(moveRecord, ms, magnetCurrentAngle, currentPosition, plannedPosition, servoWritePosition);
+		}
+
 	} else {
+		// report the modelled physical position
+		updatePositionModel();
+		currentPosition = round(predictedPosition);
 		sendServoStatus(pin, status, currentPosition);
+		if (moveRecord != NULL) {
+			moveRecordTick(moveRecord, millis() - startMillis, -1, currentPosition, wantedPosition, servoWritePosition);
+		}
 	}
 	//loggedLastPos = int(nextPos);
 	lastStatusUpdate = millis();
@@ -389,29 +1405,42 @@ void Mai3Servo::update()
 			int ms = millis() - startMillis;
 
 			if (verbose || thisServoVerbose) {
-				Serial.print("i12 target reached "); Serial.print(servoName);
-				Serial.print(", currentPos: "); Serial.print(currentPosition);
-				Serial.println();
+				hostPort->print("i12 target reached "); hostPort->print(config->servoName);
+				hostPort->print(", currentPos: "); hostPort->print(currentPosition);
+				hostPort->println();
+			}
+			if (!inJointGroupMove) {
+				byte status = buildStatusByte(assigned, moving, servo.attached(), autoDetachMs > 0, thisServoVerbose, true);
+				sendFeedbackStatus(pin, status, currentPosition, ms, servoWritePosition, wantedPosition);
+			}
+			sendMoveMetrics(MOVE_END_REACHED);
+			learnGravityFeedforward();
+			if (config->holdMs != 0) {
+				startHold();
 			}
-			byte status = buildStatusByte(assigned, moving, servo.attached(), autoDetachMs > 0, thisServoVerbose, true);
-			sendFeedbackStatus(pin, status, currentPosition, ms, servoWritePosition, wantedPosition);
 			return;
 		}
 	} else {
 		// non feedback servo
 		// ==================
-		if (moving && numPartialSteps <= 0) {
+		// with a position model wait for the modelled arrival, not only for the last step written
+		if (moving && numPartialSteps <= 0 && isModelArrived()) {
 			moving = false;
 			arrivedMillis = millis();
 			currentPosition = wantedPosition;		// the assumed reached position
+			if (hasPositionModel()) {
+				finalPositionRequestedMillis = arrivedMillis;	// autoDetach time starts with the modelled arrival
+			}
 
 			if (verbose || thisServoVerbose) {
-				Serial.print("i11 target reached "); Serial.print(servoName);
-				Serial.print(", position: "); Serial.print(currentPosition);
-				Serial.println();
+				hostPort->print("i11 target reached "); hostPort->print(config->servoName);
+				hostPort->print(", position: "); hostPort->print(currentPosition);
+				hostPort->println();
+			}
+			if (!inJointGroupMove) {
+				byte status = buildStatusByte(assigned, moving, servo.attached(), autoDetachMs > 0, thisServoVerbose, true);
+				sendServoStatus(pin, status, currentPosition);
 			}
-			byte status = buildStatusByte(assigned, moving, servo.attached(), autoDetachMs > 0, thisServoVerbose, true);			
-			sendServoStatus(pin, status, currentPosition);
 			return;
 		}
 	}
@@ -420,16 +1449,16 @@ void Mai3Servo::update()
 	if (autoDetachMs > 0) {
 
 		// check for move ended and autoDetachMs expired
-		if ((!moving) && ((millis() - finalPositionRequestedMillis) > autoDetachMs)) {
+		if ((!moving) && ((millis() - finalPositionRequestedMillis) > (unsigned long)autoDetachMs)) {
 
 			// set servo's inMoveRequest to false
 			inMoveRequest = false;
 
 			if (thisServoVerbose) {
-				Serial.print("i13 servo "); Serial.print(servoName);
-				Serial.print(" inMoveRequest cleared, autoDetachMs "); Serial.print(autoDetachMs);
-				Serial.print(" ms after arrived: "); Serial.print((millis()-arrivedMillis));
-				Serial.println();
+				hostPort->print("i13 servo "); hostPort->print(config->servoName);
+				hostPort->print(" inMoveRequest cleared, autoDetachMs "); hostPort->print(autoDetachMs);
+				hostPort->print(" ms after arrived: "); hostPort->print((millis()-arrivedMillis));
+				hostPort->println();
 			}
 			return;
 		} 
@@ -442,46 +1471,28 @@ void Mai3Servo::update()
 	if (isFeedbackServo) {
 		int msInMove = millis() - startMillis;
 
-		// wanted position is a linear position between startPosition and targetPosition within the move duration time
-		wantedPosition = startPosition + ((targetPosition - startPosition) / float(durationMs) * msInMove);
-
-		// try to improve positioning by adding a sinusoidal part for acceleration/deceleration
-		float xFactor = float(msInMove) / durationMs;
-		int yRange = targetPosition - startPosition;
-		int linearY = xFactor * yRange * 1.05;		// for compensating lag request a slightly ahead position
+		wantedPosition = shapedPosition(msInMove);
 
-		float sinePart = xFactor * 4 - 2;
-		int sineFactor = 8;
-		float sineYOffset =  sineFactor * sin(sinePart*3.1416/2);
+		// planned position change per update period for the velocity feedforward
+		float plannedVelocity = shapedPosition(msInMove + 20) - wantedPosition;
 
-		int sinedY;
-		if (targetPosition > startPosition) {
-			sinedY = int(startPosition + linearY + sineYOffset);
-		} else {
-			sinedY = int(startPosition + linearY - sineYOffset);
-		}
-		Serial.print("startPosition: "); Serial.print(startPosition);
-		Serial.print(", linearY: "); Serial.print(linearY);
-		Serial.print(", sinePart: "); Serial.print(sinePart);
-		Serial.print(", sineYOffset: "); Serial.print(sineYOffset); 
-		Serial.print(", sinedY: "); Serial.print(sinedY);
-		Serial.println();
-
-		wantedPosition = sinedY;
-
-		// if the move time has elapsed limit the wantedPositon to the targetPosition
-		if (msInMove >= durationMs) {
-			wantedPosition = targetPosition;
+		if (thisServoVerbose) {
+			hostPort->print("startPosition: "); hostPort->print(startPosition);
+			hostPort->print(", wantedPosition: "); hostPort->print(wantedPosition);
+			hostPort->print(", plannedVelocity: "); hostPort->print(plannedVelocity);
+			hostPort->println();
 		}
 
 		if (usePidControl)  {
-			// until the joint starts to move give it kind of a far target
+			// until the joint starts to move give it kind of a far target, within 0..180 (the byte wraps)
 			if (abs(magnetAngleMoved) < 3) {
-				servoWritePosition = wantedPosition - (2 * (startPosition - targetPosition));
+				servoWritePosition = constrain(round(wantedPosition - 2 * (startPosition - targetPosition)), 0, 180);
+				prevPidMillis = millis();
+				pidPrevMeasured = currentPosition;
 			} else {
 				// during the rest of the move use the PID value based on the difference of the
 				// wanted position versus the current position
-				servoWritePosition = computePid();
+				servoWritePosition = computePid(plannedVelocity);
 			}
 		} 
 		
@@ -489,18 +1500,18 @@ void Mai3Servo::update()
 		// set start of autoDetach time when target is reached and stop the servo
 		if (abs(currentPosition - targetPosition) < 1) {
 			finalPositionRequestedMillis = millis();
-			stopServo();
+			stopServo(MOVE_END_REACHED);
 			return;
 		}
 		writeServoPosition(servoWritePosition, inverted);
 
 		if (thisServoVerbose) {
-			Serial.print("i17, millisInMove: "); Serial.print(msInMove);
-			Serial.print(", startPos: "); Serial.print(startPosition);
-			Serial.print(", targetPos: "); Serial.print(targetPosition);
-			Serial.print(", wantedPos: "); Serial.print(wantedPosition);
-			Serial.print(", servoPos: "); Serial.print(servoWritePosition);
-			Serial.println();
+			hostPort->print("i17, millisInMove: "); hostPort->print(msInMove);
+			hostPort->print(", startPos: "); hostPort->print(startPosition);
+			hostPort->print(", targetPos: "); hostPort->print(targetPosition);
+			hostPort->print(", wantedPos: "); hostPort->print(wantedPosition);
+			hostPort->print(", servoPos: "); hostPort->print(servoWritePosition);
+			hostPort->println();
 		}
 
 	} else {
@@ -509,14 +1520,15 @@ void Mai3Servo::update()
 		// ==================
 		if (numPartialSteps > 0) {
 
-			wantedPosition += stepIncrement;				// ... and nextPos as the next step position
 			numPartialSteps -= 1;
+			// next step position on the (trapezoidal) move profile, input shaper applied
+			wantedPosition = shapedPosition((totalPartialSteps - numPartialSteps) * 20L);
 			// if we have sent the target position to the servo note this time
 			// to limit the duration with feedback servos
 			if (numPartialSteps <= 0) {
 				finalPositionRequestedMillis = millis();
 				if (thisServoVerbose) {
-					Serial.println("finalPositionRequestedMillis set");
+					hostPort->println("finalPositionRequestedMillis set");
 				}
 			}
 			servoWritePosition = round(wantedPosition);
@@ -525,10 +1537,10 @@ void Mai3Servo::update()
 			//}
 			writeServoPosition(servoWritePosition, inverted);
 			if (thisServoVerbose) {
-				Serial.print("writeServoPosition, step: "); Serial.print(numPartialSteps);
-				Serial.print(", wantedPosition: "); Serial.print(wantedPosition); 
-				Serial.print(", servoWritePosition: "); Serial.print(servoWritePosition); 
-				Serial.println();
+				hostPort->print("writeServoPosition, step: "); hostPort->print(numPartialSteps);
+				hostPort->print(", wantedPosition: "); hostPort->print(wantedPosition); 
+				hostPort->print(", servoWritePosition: "); hostPort->print(servoWritePosition); 
+				hostPort->println();
 			}
 		}
 	}
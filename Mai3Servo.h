@@ -4,36 +4,121 @@
 
 #include "Arduino.h"
 #include <Servo.h>
+#include "currentBudget.h"
+#include "autoTune.h"
+#include "moveRecord.h"
+#include "inputShaper.h"
+#include "calibration.h"
+
+// end reasons of a move, kept in moveEnd and sent with the move metrics record
+#define MOVE_END_REACHED 0
+#define MOVE_END_STOPPED 1		// stop command
+#define MOVE_END_STALLED 2		// stall detection (e10)
+#define MOVE_END_TIMEOUT 3		// max duration exceeded
+
+#define MAGNET_NOISE_DEG 3				// sensor angle change always accepted
+#define MAX_REJECTED_MAGNET_READS 3		// resynchronize with the sensor after this many rejected reads
+
+#define GRAVITY_BINS 8		// position dependent feedforward values, spread evenly over min..max
 
 extern int arduinoId;
 extern bool verbose;
 
-class Mai3Servo 
+// servo definitions from the assign, feedback and tuning commands
+// only read by the control code, kept apart from the runtime data of Mai3Servo
+struct servoConfigType {
+	char servoName[20];
+	int min;
+	int max;
+	int restPosition;		// rest position from servo assign
+	int maxSpeed = 0;		// motion limits from servo assign, positions per second, 0 for no limit
+	int maxAccel = 0;		// positions per second^2, 0 for no limit
+
+	// input shaper of the planned move, suppresses the ringing of the joint after the move
+	inputShaperType shaper = {SHAPER_NONE, 0, 0, 1, {0, 0, 0}, {1, 0, 0}};
+
+	// definitions of feedback servo
+	byte i2cMultiplexerAddress;
+	byte i2cMultiplexerChannel;
+	bool feedbackInverted;
+	int feedbackMagnetOffset;
+	float degPerPos;
+	int maxMagnetSpeed = 4500;	// max accepted sensor rotation in degrees per second, 0 for no limit
+
+	// calibration tables, unused with less than 2 points
+	calibrationTableType writeTable = {0, {0}, {0}};	// joint position -> servo write value, degrees 0..180 or pulse width in us (>= 544)
+	calibrationTableType sensorTable = {0, {0}, {0}};	// sensor angle in degrees -> joint position, replaces degPerPos and the reference
+
+	// PID
+	float kp = 4;
+	float ki = 0;
+	float kd = 0;
+	float kv = 0;				// velocity feedforward, applied to the planned position change per update
+	float integralLimit = 20;	// anti-windup, max integral part in positions
+	float outputLimit = 60;		// max correction of wantedPosition in positions
+
+	// position dependent feedforward (gravity load of the pose) in positions, added to the PID output
+	// bin i is at min + i * (max - min) / (GRAVITY_BINS - 1), interpolated between the bins
+	float gravityFf[GRAVITY_BINS] = {0, 0, 0, 0, 0, 0, 0, 0};
+	int gravityLearnPercent = 0;	// share of the integral part moved into the table at each arrival, 0 for no learning
+
+	// gear slack and servo deadband of feedback servos in positions, see slackCompensation
+	float backlash = 0;			// write position lead after a reversal of the error direction
+	float deadband = 0;			// min distance of the write position from the joint for small corrections
+
+	// closed loop hold of feedback servos after the arrival, own gains at a lower rate
+	int holdMs = 0;				// hold time after the arrival, 0 no hold, -1 until the next request
+	float holdKp = 0.5;
+	float holdKi = 0.1;			// per hold period
+	float holdDeadband = 1;		// no correction while the joint is within this distance of the target
+	int holdPeriodMs = 100;
+
+	// stall detection, a joint not following the wanted position for stallWindowTicks updates is stopped
+	int stallWindowTicks = 10;		// 0 disables the stall detection
+	int stallErrorLimit = 5;		// min position error for a stalled update
+	int stallVelocityPercent = 25;	// measured speed below this percentage of the planned speed counts as stalled
+
+	// current budget of the power group
+	servoCurrentType servoCurrent = {0, 0, 0};
+
+	// idle feedback servos: position change by external forces reported as drift, 0 disables the monitoring
+	int driftThreshold = 3;
+
+	// position model of servos without feedback sensor
+	int modelLagMs = 0;			// first order lag time constant, 0 for no lag
+	int modelMaxSpeed = 0;		// slew limit in positions per second, 0 for no limit
+};
+
+// runtime data of a servo, one object per assigned servo in servoList, the definitions are in config.
+// The per tick data stays in the object instead of arrays per field: the SAM3X of the Due has no data
+// cache, so a field layout gains no memory locality, and update() works on all fields of one servo.
+// The per tick cost is kept proportional to the moving servos by the active servo list of the motion task.
+class Mai3Servo
 {
 private:
 
 	Servo servo;
 	//nt loggedLastPos;
 	int numPartialSteps;    // number of 20 milli steps
+	int totalPartialSteps;
 	float stepIncrement;
 	unsigned long lastStatusUpdate;  // millis of last status update
-	int min;
-	int max;
 
 	unsigned long finalPositionRequestedMillis;	// millis when final position requested
 	unsigned long arrivedMillis;	// non-feedback-servos: millis when final position requested
 									// feedback-servos: millis when final position reached
-	bool stopped;
 
 public:
-	float nextPos;
+	servoConfigType *config;	// definitions, owned by the servoConfigList of the sketch
 	bool assigned;
 	bool moving;
 	int autoDetachMs;
-	int durationMs;			// duration of the move in millis
+	int durationMs;			// duration of the move in millis, might be stretched by the motion limits
+	int accelPhaseMs;		// acceleration and deceleration time of the trapezoidal move profile
 	int startPosition;		// the current position when requesting the move	
 	int targetPosition;		// the move target position
-	int currentPosition;	// for non-feedback servos the wantedPosition as we do not know better
+	int currentPosition;	// for non-feedback servos the position of the position model
+							// (the last written position without a model)
 							// for feedback servos the measured position from the feedback sensor							
 	float wantedPosition;	// linear position progress in move
 							// currently a linear position between start and end over time
@@ -44,13 +129,10 @@ public:
 	//int lastPosition;		// servo.read did not work for me
 	bool inMoveRequest;
 	bool thisServoVerbose;
-	char servoName[20];
     unsigned long startMillis; // millis of moveTo initiated
 
 	// definitions of feedback servo
 	bool isFeedbackServo;
-	byte i2cMultiplexerAddress;
-	byte i2cMultiplexerChannel;
 	//int speedACalcType;
 	//float speedAFactor;
 	//float speedAOffset;
@@ -59,29 +141,37 @@ public:
 	//float speedBOffset;
 
 	// PID
-	bool pidEnabled = true;
-	float kp = 4;
-	float ki = 0;
-	float kd = 0;
-	float prevStepMillis;
+	unsigned long prevPidMillis;
 	float pidError;
-	float pidLastError;
-	float cumError;
-	float rateError;
+	float pidIntegral;			// integral part, ki already applied
+	float pidDerivative;		// derivative of the measured position
+	float pidPrevMeasured;
+	float pidOutput;			// correction added to wantedPosition
+	bool pidSaturated;			// correction limited by outputLimit or the 0..180 range
+	int slackDirection;			// +1/-1, side of the gear slack taken up by the write position
 
-	float degPerPos;
 	//int servoSpeedRange;
-	bool feedbackInverted;
 
 	// runtime data of feedback servo
-	int magnetStartAngle;		// 0..359
-	int magnetPreviousAngle;
-	int magnetCurrentAngle;		// 0..359
+	int magnetCurrentAngle;		// 0..359, last accepted sensor angle
+	long magnetAbsoluteAngle;	// sensor angle followed over full turns, kept across moves
+	bool magnetAbsoluteValid = false;
+	unsigned long magnetReadMillis;	// millis of the last accepted sensor angle
+	int magnetRejectedReads;	// rejected sensor angles in a row
+	unsigned long magnetFaults;	// sensor angles rejected by the rotation speed bound
+	long magnetRefAngle;		// absolute angle of magnetRefPosition
+	int magnetRefPosition;
+	bool magnetRefValid = false;
+	long magnetStartAngle;		// absolute angle at the move start
 	int magnetAngleToMove;		// can be more than 360
-	int angleFromFullRotations;
 	int magnetAngleMoved;
-	bool isFeedbackClockwise;
-	bool servoBlocked = false;
+	bool servoBlocked = false;		// set by the stall detection, cleared with the next move
+	int idleReportedPosition;		// position of the last drift report or of the end of the move
+
+	// stall detection runtime data
+	int stallTicks;
+	int stallPrevPosition;
+	float stallPrevWanted;
 	
 	// by controlling speed with small linear position updates the joints show a hefty lag and keep moving
 	// when the final requested target has been sent to the servo
@@ -89,15 +179,70 @@ public:
 	bool startupBoostActive = false;
 	int boostPos;
 
+	// current budget of the power group, a move request might have to wait for other servos
+	// in the group to pass their start phase
+	bool moveQueued = false;
+	int queuedPosition;
+	int queuedDurationMs;
+	unsigned long queuedMillis;		// millis of the queued move request
+
+	// position model of servos without feedback sensor
+	float predictedPosition;	// modelled physical position
+	unsigned long lastModelMillis;
+	int modelSettleMs = 0;		// additional time the modelled position may need to arrive
+
+	// move blended from an interrupted move into a new target, see retarget
+	bool blending = false;
+	float blendStartPosition;
+	float blendStartVelocity;		// positions per ms
+
+	// closed loop hold after the arrival
+	bool holding = false;
+	unsigned long holdStartMillis;
+	unsigned long holdPrevMillis;	// millis of the last hold period
+	unsigned long holdCorrectionMillis;	// millis of the last written hold correction, reported in the status
+	float holdIntegral;
+	int holdBaseWrite;			// write position at the arrival, the hold correction is added to it
+
+	// detached and sampled by the teach mode, move requests are rejected
+	bool teaching = false;
+
+	// member of a joint group move, the group reports the arrival instead of the servo
+	bool inJointGroupMove = false;
+	int moveEnd = MOVE_END_REACHED;	// how the last move ended, MOVE_END_*
+
+	// PID autotune experiment, NULL when not running
+	autoTuneType *autoTune = NULL;
+
+	// tracking metrics of the current move of a feedback servo, sent at the end of the move
+	moveMetricsType moveMetrics;
+
+	// record of the next or current move, NULL when not recording
+	moveRecordType *moveRecord = NULL;
+
+	// simulated feedback sensor, the position model replaces the joint and the AS5600 angle is
+	// derived from the modelled position, used to benchmark the control code without the robot
+	bool simulatedFeedback = false;
+	int simRefAngle;			// simulated magnet angle at simRefPosition
+	int simRefPosition;
+
 
 	// assign servo
-	void begin(int pin, int min, int max, int autoDetachMs, bool inverted, int lastPos, int servoPowerPin);
+	void begin(int pin, int min, int max, int restPosition, int autoDetachMs, bool inverted, int lastPos, int servoPowerPin);
+
+	// set feedback definitions
+	void setFeedbackValues(int i2cMultiplexerAddress, int i2cMultiplexerChannel,
+		int feedbackMagnetOffset, bool feedbackInverted, float degPerPos,
+		float kp, float ki, float kd);
+
+	// optional PID extensions of the feedback definitions
+	void setPidLimits(float kv, float integralLimit, float outputLimit);
 
 	// powerUp
 	void powerUp();
 
-	// stop servo
-	void stopServo();
+	// stop servo, endReason MOVE_END_* of a running move
+	void stopServo(int endReason = MOVE_END_STOPPED);
 
 	// detach servo
 	void detachServo(bool forceDetach);
@@ -114,6 +259,9 @@ public:
 	// check requested position for being in min/max range for the servo
 	int adjustOutlierPosition(int targetPos);
 
+	// the position limited to min/max, without logs
+	int clampPosition(int targetPos);
+
 	// write servo position
 	void writeServoPosition(int position, bool inverted);
 
@@ -122,14 +270,90 @@ public:
 	// the commanding task needs to convert degrees to the relative range
 	void moveTo(int targetPos, int durationMillis);
 
+	// position model for servos without feedback
+	void setPositionModel(int lagMs, int speed);
+	bool hasPositionModel();
+	void updatePositionModel();
+	void followPositionModel();
+	bool isModelArrived();
+
+	// motion limits, requested move durations are stretched to respect them
+	void setMotionLimits(int maxSpeed, int maxAccel);
+	int minMoveDurationMs(int distance);
+	int restMoveDurationMs(int distance, int durationMillis);
+	int effectiveDurationMs(int targetPos, int durationMillis);
+	void reportStretchedDuration(int requestedMs);
+	float moveFraction(long msInMove);
+
+	// keep a move request until the power group current budget allows the start
+	void queueMove(int targetPos, int durationMillis);
+
+	// estimated current of the servo in its current move state
+	int estimatedCurrentMa();
+
+	// run a relay feedback experiment for PID tuning or the backlash sweep
+	void startAutoTune(autoTuneType *tune, int experiment, int relayAmplitude, int cycles);
+	void autoTuneUpdate();
+
+	// calibration tables
+	bool setCalibrationPoint(int table, int x, int y);
+	void clearCalibration(int table);
+
+	// feedback sensor reference and position read
+	void setSimulatedFeedback(bool simulated, int refAngle);
+	int readMagnetAngle(bool isVerbose);
+	bool unwrapMagnetAngle(int angle);
+	void initFeedbackReference();
+	void monitorIdlePosition();
+	void readFeedbackPosition();
+
 	byte evalPositionFromFeedbackSensor();
+	float sensorPosition();
+	float readSensorPosition();
+
+	// planned position of a feedback servo msInMove after the move start
+	float profilePosition(long msInMove);
+
+	// planned position with the input shaper applied, feedback and non-feedback servos
+	float plannedPosition(long msInMove);
+	float shapedPosition(long msInMove);
+
+	// new target for a moving servo with continuous position and velocity
+	bool isBlendPossible();
+	void retarget(int targetPos, int durationMillis);
+	void blendStartState(float *position, float *velocity);
+	int blendDurationMs(float distance, float startVelocity, int durationMillis);
+	float blendPosition(long msInMove);
+	bool isBlendWithinLimits(float distance, float startVelocity, long durationMillis);
+	void setModelSettleMs(int distance);
+
+	// end of move record
+	void sendMoveMetrics(int endReason);
 
 	// needs repeated call
     void update();
 
+	// closed loop hold of feedback servos after the arrival
+	void setHold(int holdMs, float kp, float ki, float deadband, int periodMs);
+	void startHold();
+	void holdUpdate();
+	void endHold();
+
+	// stall detection of feedback servos
+	void setStallDetection(int windowTicks, int errorLimit, int velocityPercent);
+	bool isStalled();
+
 	// PID control
 	bool usePidControl = true;
-	int computePid();
+	int computePid(float plannedVelocity);
+
+	// backlash and deadband compensation
+	void setSlackCompensation(float backlash, float deadband);
+	float slackCompensation(float correction);
+
+	// position dependent feedforward
+	float gravityFeedforward(float position);
+	void learnGravityFeedforward();
 
 	bool useBandControl = false;
 	int computeBand();
@@ -0,0 +1,262 @@
+#include <math.h>
+#include "autoTune.h"
+
+
+// direction of the backlash sweep ramps, two reversals and one continuation
+static const int sweepDirection[AUTOTUNE_SWEEP_RAMPS] = {1, -1, 1, 1};
+
+
+void autoTuneStart(autoTuneType *tune, int experiment, float centerPosition, int relayAmplitude, int cycles,
+	int minPosition, int maxPosition, unsigned long nowMs) {
+
+	// keep the relay outputs in the allowed range
+	// the sweep ends up to two ramps above the center
+	int maxAbove = experiment == AUTOTUNE_BACKLASH_SWEEP ? 2 * relayAmplitude : relayAmplitude;
+	if (centerPosition - relayAmplitude < minPosition) {
+		centerPosition = minPosition + relayAmplitude;
+	}
+	if (centerPosition + maxAbove > maxPosition) {
+		centerPosition = maxPosition - maxAbove;
+	}
+
+	tune->experiment = experiment;
+	tune->centerPosition = centerPosition;
+	tune->relayAmplitude = relayAmplitude;
+	tune->cycles = cycles;
+	tune->minPosition = minPosition;
+	tune->maxPosition = maxPosition;
+	tune->timeoutMs = AUTOTUNE_SETTLE_MS + (unsigned long) relayAmplitude * AUTOTUNE_RAMP_MS
+		+ (unsigned long)(cycles + AUTOTUNE_SKIP_HALF_CYCLES) * 5000;
+	if (experiment == AUTOTUNE_BACKLASH_SWEEP) {
+		tune->timeoutMs = AUTOTUNE_SETTLE_MS
+			+ AUTOTUNE_SWEEP_RAMPS * (AUTOTUNE_SETTLE_MS + (unsigned long) (relayAmplitude + 1) * AUTOTUNE_SWEEP_RAMP_MS);
+	}
+
+	tune->phase = AUTOTUNE_SETTLE;
+	tune->startMs = nowMs;
+	tune->phaseStartMs = nowMs;
+	tune->rampOffset = 0;
+	tune->deadbandOffset = 0;
+	tune->relayDirection = 1;
+	tune->halfCycles = 0;
+	tune->sumPeakToPeak = 0;
+	tune->numPeakToPeak = 0;
+	tune->sumPeriodMs = 0;
+	tune->numPeriods = 0;
+	tune->sumLagMs = 0;
+	tune->numLags = 0;
+	tune->sweepRamp = 0;
+	tune->rampBase = round(centerPosition);
+
+	tune->failReason = AUTOTUNE_OK;
+	tune->ultimateGain = 0;
+	tune->ultimatePeriodMs = 0;
+	tune->lagMs = 0;
+	tune->deadband = 0;
+	tune->backlash = 0;
+	tune->kp = 0;
+	tune->ki = 0;
+	tune->kd = 0;
+}
+
+
+static void autoTuneFail(autoTuneType *tune, int reason) {
+	tune->phase = AUTOTUNE_FAILED;
+	tune->failReason = reason;
+}
+
+
+// evaluate the limit cycle
+static void autoTuneEvaluate(autoTuneType *tune) {
+
+	float amplitude = tune->sumPeakToPeak / tune->numPeakToPeak / 2;
+	if (amplitude <= AUTOTUNE_HYSTERESIS) {
+		autoTuneFail(tune, AUTOTUNE_NO_OSCILLATION);
+		return;
+	}
+
+	// describing function of a relay with hysteresis
+	tune->ultimateGain = 4.0 * tune->relayAmplitude
+		/ (M_PI * sqrt(amplitude * amplitude - AUTOTUNE_HYSTERESIS * AUTOTUNE_HYSTERESIS));
+	tune->ultimatePeriodMs = tune->sumPeriodMs / tune->numPeriods;
+	if (tune->numLags > 0) {
+		tune->lagMs = tune->sumLagMs / tune->numLags;
+	}
+
+	// the ramp continued while the joint motion was on its way through the lag
+	tune->deadband = tune->deadbandOffset - tune->lagMs / AUTOTUNE_RAMP_MS;
+	if (tune->deadband < 0) {
+		tune->deadband = 0;
+	}
+
+	// Ziegler-Nichols PID with Ti = Tu/2, Td = Tu/8, times in 20 ms update periods
+	float tuPeriods = tune->ultimatePeriodMs / 20.0;
+	tune->kp = 0.6 * tune->ultimateGain;
+	tune->ki = tune->kp / (0.5 * tuPeriods);
+	tune->kd = tune->kp * 0.125 * tuPeriods;
+
+	tune->phase = AUTOTUNE_DONE;
+}
+
+
+// the continuation ramp needs the deadband only. The backlash is taken from the settled positions
+// around the reversal ramps, the write position moved the slack farther than the joint. The ramp
+// offsets would include the overrun of the ramp through the lag of the joint.
+static void autoTuneEvaluateSweep(autoTuneType *tune) {
+
+	tune->deadband = tune->sweepOffset[AUTOTUNE_SWEEP_RAMPS - 1];
+	float slack = 0;
+	int reversals = 0;
+	for (int r = 1; r < AUTOTUNE_SWEEP_RAMPS; r++) {
+		if (sweepDirection[r] != sweepDirection[r - 1]) {
+			slack += fabs(tune->sweepWrite[r + 1] - tune->sweepWrite[r])
+				- fabs(tune->sweepSettled[r + 1] - tune->sweepSettled[r]);
+			reversals += 1;
+		}
+	}
+	tune->backlash = slack / reversals;
+	if (tune->backlash < 0) {
+		tune->backlash = 0;
+	}
+	tune->phase = AUTOTUNE_DONE;
+}
+
+
+// relay switch, the extreme since the last switch is the peak of the past half cycle
+static void autoTuneSwitch(autoTuneType *tune, unsigned long nowMs) {
+
+	tune->halfCycles += 1;
+
+	if (tune->halfCycles > AUTOTUNE_SKIP_HALF_CYCLES) {
+		tune->sumLagMs += tune->peakMs - tune->switchMs;
+		tune->numLags += 1;
+		if (tune->halfCycles > AUTOTUNE_SKIP_HALF_CYCLES + 1) {
+			tune->sumPeakToPeak += fabs(tune->peak - tune->lastPeak);
+			tune->numPeakToPeak += 1;
+		}
+	}
+	tune->lastPeak = tune->peak;
+
+	tune->relayDirection = -tune->relayDirection;
+	if (tune->relayDirection > 0) {
+		if (tune->halfCycles > AUTOTUNE_SKIP_HALF_CYCLES) {
+			tune->sumPeriodMs += nowMs - tune->upSwitchMs;
+			tune->numPeriods += 1;
+		}
+		tune->upSwitchMs = nowMs;
+	}
+	tune->switchMs = nowMs;
+}
+
+
+int autoTuneStep(autoTuneType *tune, float measuredPosition, unsigned long nowMs) {
+
+	int center = round(tune->centerPosition);
+
+	if (autoTuneFinished(tune) || tune->phase == AUTOTUNE_IDLE) {
+		return center;
+	}
+
+	if (measuredPosition < tune->minPosition || measuredPosition > tune->maxPosition) {
+		autoTuneFail(tune, AUTOTUNE_OUT_OF_RANGE);
+		return center;
+	}
+	if (nowMs - tune->startMs > tune->timeoutMs) {
+		autoTuneFail(tune, AUTOTUNE_TIMEOUT);
+		return center;
+	}
+
+	switch (tune->phase) {
+
+	case AUTOTUNE_SETTLE:
+		if (nowMs - tune->phaseStartMs >= AUTOTUNE_SETTLE_MS) {
+			tune->phase = tune->experiment == AUTOTUNE_BACKLASH_SWEEP ? AUTOTUNE_SWEEP_RAMP : AUTOTUNE_DEADBAND;
+			tune->phaseStartMs = nowMs;
+			tune->startMeasured = measuredPosition;
+			tune->sweepWrite[0] = center;
+			tune->sweepSettled[0] = measuredPosition;
+		}
+		return center;
+
+	case AUTOTUNE_DEADBAND:
+		if (fabs(measuredPosition - tune->startMeasured) >= 1) {
+			// joint started to move, start the relay oscillation
+			tune->deadbandOffset = tune->rampOffset;
+			tune->phase = AUTOTUNE_RELAY;
+			tune->phaseStartMs = nowMs;
+			tune->relayDirection = measuredPosition > tune->centerPosition ? -1 : 1;
+			tune->switchMs = nowMs;
+			tune->upSwitchMs = nowMs;
+			tune->peak = measuredPosition;
+			tune->peakMs = nowMs;
+			return center + tune->relayDirection * tune->relayAmplitude;
+		}
+		tune->rampOffset = (nowMs - tune->phaseStartMs) / AUTOTUNE_RAMP_MS;
+		if (tune->rampOffset > tune->relayAmplitude) {
+			autoTuneFail(tune, AUTOTUNE_NO_MOTION);
+			return center;
+		}
+		return center + tune->rampOffset;
+
+	case AUTOTUNE_RELAY:
+		// track the extreme of the current half cycle
+		if ((tune->relayDirection < 0 && measuredPosition > tune->peak)
+			|| (tune->relayDirection > 0 && measuredPosition < tune->peak)) {
+			tune->peak = measuredPosition;
+			tune->peakMs = nowMs;
+		}
+
+		if ((tune->relayDirection > 0 && measuredPosition > tune->centerPosition + AUTOTUNE_HYSTERESIS)
+			|| (tune->relayDirection < 0 && measuredPosition < tune->centerPosition - AUTOTUNE_HYSTERESIS)) {
+			autoTuneSwitch(tune, nowMs);
+			tune->peak = measuredPosition;
+			tune->peakMs = nowMs;
+
+			if (tune->numPeriods >= tune->cycles && tune->numPeakToPeak > 0) {
+				autoTuneEvaluate(tune);
+				return center;
+			}
+		}
+		return center + tune->relayDirection * tune->relayAmplitude;
+
+	case AUTOTUNE_SWEEP_HOLD:
+		if (nowMs - tune->phaseStartMs >= AUTOTUNE_SETTLE_MS) {
+			tune->sweepWrite[tune->sweepRamp] = tune->rampBase;
+			tune->sweepSettled[tune->sweepRamp] = measuredPosition;
+			if (tune->sweepRamp >= AUTOTUNE_SWEEP_RAMPS) {
+				autoTuneEvaluateSweep(tune);
+				return tune->rampBase;
+			}
+			tune->phase = AUTOTUNE_SWEEP_RAMP;
+			tune->phaseStartMs = nowMs;
+			tune->startMeasured = measuredPosition;
+			tune->rampOffset = 0;
+		}
+		return tune->rampBase;
+
+	case AUTOTUNE_SWEEP_RAMP: {
+		int direction = sweepDirection[tune->sweepRamp];
+		if (direction * (measuredPosition - tune->startMeasured) >= 1) {
+			// joint moved, keep the write position and settle before the next ramp
+			tune->sweepOffset[tune->sweepRamp] = tune->rampOffset;
+			tune->rampBase += direction * tune->rampOffset;
+			tune->sweepRamp += 1;
+			tune->phase = AUTOTUNE_SWEEP_HOLD;
+			tune->phaseStartMs = nowMs;
+			return tune->rampBase;
+		}
+		tune->rampOffset = (nowMs - tune->phaseStartMs) / AUTOTUNE_SWEEP_RAMP_MS;
+		if (tune->rampOffset > tune->relayAmplitude) {
+			autoTuneFail(tune, AUTOTUNE_NO_MOTION);
+			return tune->rampBase;
+		}
+		return tune->rampBase + direction * tune->rampOffset;
+	}
+	}
+	return center;
+}
+
+
+bool autoTuneFinished(const autoTuneType *tune) {
+	return tune->phase == AUTOTUNE_DONE || tune->phase == AUTOTUNE_FAILED;
+}
@@ -0,0 +1,105 @@
+
+#ifndef autoTune_h
+#define autoTune_h
+
+// relay feedback experiment for tuning the PID values of a feedback servo
+// the servo position is switched between centerPosition +/- relayAmplitude whenever the measured
+// position crosses the center. The resulting limit cycle gives the ultimate gain and period.
+// Before the relay phase the write position is ramped up slowly to find the deadband.
+// The backlash sweep ramps the write position slowly up, down, up and up again from the center,
+// each ramp stops when the joint moves and the joint settles before the next ramp. A reversal needs
+// the gear slack plus the deadband, the last ramp in the same direction the deadband only.
+// kept free of arduino calls so the algorithm can also be run against a simulated servo on a host build
+// (host/testAutoTune with the joint model of host/servoPlant)
+
+enum autoTuneExperimentType {
+	AUTOTUNE_RELAY_FEEDBACK,	// PID values from the relay oscillation
+	AUTOTUNE_BACKLASH_SWEEP		// gear backlash and servo deadband
+};
+
+enum autoTunePhaseType {
+	AUTOTUNE_IDLE,
+	AUTOTUNE_SETTLE,		// hold the center position until the servo has settled
+	AUTOTUNE_DEADBAND,		// ramp up the write position until the joint starts to move
+	AUTOTUNE_RELAY,			// relay oscillation around the center
+	AUTOTUNE_SWEEP_HOLD,	// backlash sweep, hold the write position until the joint has settled
+	AUTOTUNE_SWEEP_RAMP,	// backlash sweep, ramp the write position until the joint moves
+	AUTOTUNE_DONE,
+	AUTOTUNE_FAILED
+};
+
+enum autoTuneFailType {
+	AUTOTUNE_OK,
+	AUTOTUNE_OUT_OF_RANGE,	// measured position left the min/max range
+	AUTOTUNE_NO_MOTION,		// no motion detected with the full relay amplitude
+	AUTOTUNE_NO_OSCILLATION,	// limit cycle amplitude within the hysteresis
+	AUTOTUNE_TIMEOUT
+};
+
+#define AUTOTUNE_SETTLE_MS 500
+#define AUTOTUNE_RAMP_MS 40			// ramp speed of the deadband phase, 1 position per AUTOTUNE_RAMP_MS
+#define AUTOTUNE_HYSTERESIS 1.0		// relay switching band around the center in positions
+#define AUTOTUNE_SKIP_HALF_CYCLES 2	// transient half cycles not used for the estimate
+#define AUTOTUNE_SWEEP_RAMP_MS 100	// slower ramp of the backlash sweep, less overrun through the lag
+#define AUTOTUNE_SWEEP_RAMPS 4
+
+typedef struct {
+	// experiment settings
+	int experiment;			// autoTuneExperimentType
+	float centerPosition;
+	int relayAmplitude;
+	int cycles;				// number of measured oscillation periods
+	int minPosition;
+	int maxPosition;
+	unsigned long timeoutMs;
+
+	// runtime data
+	int phase;
+	unsigned long startMs;
+	unsigned long phaseStartMs;
+	float startMeasured;		// position at the start of the deadband ramp
+	int rampOffset;
+	int deadbandOffset;			// ramp offset when the move was detected
+	int relayDirection;			// +1 / -1
+	unsigned long switchMs;		// last relay switch
+	unsigned long upSwitchMs;	// last switch to +1, for the period
+	float peak;					// extreme measured position since the last switch
+	unsigned long peakMs;
+	float lastPeak;
+	int halfCycles;
+	float sumPeakToPeak;
+	int numPeakToPeak;
+	float sumPeriodMs;
+	int numPeriods;
+	float sumLagMs;
+	int numLags;
+	int sweepRamp;				// index of the current backlash sweep ramp
+	int rampBase;				// write position at the start of the ramp
+	int sweepOffset[AUTOTUNE_SWEEP_RAMPS];	// ramp offsets when the joint moved
+	int sweepWrite[AUTOTUNE_SWEEP_RAMPS + 1];		// write position before the first and after each ramp
+	float sweepSettled[AUTOTUNE_SWEEP_RAMPS + 1];	// settled joint position before the first and after each ramp
+
+	// results
+	int failReason;
+	float ultimateGain;
+	float ultimatePeriodMs;
+	float lagMs;				// time from relay switch to reversal of the joint
+	float deadband;				// positions the write position has to change before the joint moves
+	float backlash;				// additional positions after a reversal (backlash sweep)
+	float kp;					// suggested PID values (Ziegler-Nichols), based on the 20 ms update period
+	float ki;
+	float kd;
+} autoTuneType;
+
+// initialize the experiment, the center is moved into the range if min/max does not allow the amplitude
+// the backlash sweep uses relayAmplitude as the max ramp offset, cycles are not used
+extern void autoTuneStart(autoTuneType *tune, int experiment, float centerPosition, int relayAmplitude, int cycles,
+	int minPosition, int maxPosition, unsigned long nowMs);
+
+// feed the measured position of the current update, returns the position to write to the servo
+extern int autoTuneStep(autoTuneType *tune, float measuredPosition, unsigned long nowMs);
+
+// true when the experiment has ended, check phase for AUTOTUNE_DONE or AUTOTUNE_FAILED
+extern bool autoTuneFinished(const autoTuneType *tune);
+
+#endif
@@ -0,0 +1,49 @@
+#include "calibration.h"
+
+
+void calibrationClear(calibrationTableType *table) {
+	table->numPoints = 0;
+}
+
+
+bool calibrationAddPoint(calibrationTableType *table, int x, int y) {
+
+	int i = 0;
+	while (i < table->numPoints && table->x[i] < x) {
+		i++;
+	}
+	if (i < table->numPoints && table->x[i] == x) {
+		table->y[i] = y;
+		return true;
+	}
+	if (table->numPoints >= CALIBRATION_POINTS) {
+		return false;
+	}
+
+	// keep the points sorted
+	for (int j = table->numPoints; j > i; j--) {
+		table->x[j] = table->x[j - 1];
+		table->y[j] = table->y[j - 1];
+	}
+	table->x[i] = x;
+	table->y[i] = y;
+	table->numPoints++;
+	return true;
+}
+
+
+bool calibrationActive(const calibrationTableType *table) {
+	return table->numPoints >= 2;
+}
+
+
+float calibrationApply(const calibrationTableType *table, float x) {
+
+	// segment containing x, the end segments for values outside the table
+	int i = 1;
+	while (i < table->numPoints - 1 && x > table->x[i]) {
+		i++;
+	}
+	float share = (x - table->x[i - 1]) / (table->x[i] - table->x[i - 1]);
+	return table->y[i - 1] + share * (table->y[i] - table->y[i - 1]);
+}
@@ -0,0 +1,27 @@
+
+#ifndef calibration_h
+#define calibration_h
+
+// piecewise linear calibration table of a servo, points sorted by x
+// between the points the value is interpolated, beyond the first and last point the end segments
+// are extended. Tables with less than 2 points are not used.
+// host/testCalibration.cpp covers the interpolation, the extended end segments and the point upload
+
+#define CALIBRATION_POINTS 10
+
+typedef struct {
+	int numPoints;
+	int x[CALIBRATION_POINTS];
+	int y[CALIBRATION_POINTS];
+} calibrationTableType;
+
+extern void calibrationClear(calibrationTableType *table);
+
+// add a point, the y value of an existing x is replaced, returns false with a full table
+extern bool calibrationAddPoint(calibrationTableType *table, int x, int y);
+
+extern bool calibrationActive(const calibrationTableType *table);
+
+extern float calibrationApply(const calibrationTableType *table, float x);
+
+#endif
@@ -0,0 +1,109 @@
+#include "currentBudget.h"
+
+/*
+ * Function: estimatedServoCurrentMa
+ * ---------------------------------
+ *   a simple two level model: startCurrentMa for the first startPhaseMs of a move
+ *   followed by runCurrentMa until the move has ended. An idle servo is counted with 0 mA.
+ */
+int estimatedServoCurrentMa(const servoCurrentType *servoCurrent, bool moving, unsigned long msInMove) {
+	if (!moving) {
+		return 0;
+	}
+	if (msInMove < (unsigned long) servoCurrent->startPhaseMs) {
+		return servoCurrent->startCurrentMa;
+	}
+	return servoCurrent->runCurrentMa;
+}
+
+/*
+ * Function: isMoveStartAdmitted
+ * -----------------------------
+ *   returns: true if the start current of a new move fits into the remaining budget of the group.
+ *   A move in an otherwise idle group is always admitted, even when its start current alone exceeds
+ *   the budget, it would wait forever otherwise.
+ */
+bool isMoveStartAdmitted(int groupCurrentMa, int startCurrentMa, int budgetMa) {
+	if (budgetMa <= 0) {
+		return true;
+	}
+	if (groupCurrentMa == 0) {
+		return true;
+	}
+	return groupCurrentMa + startCurrentMa <= budgetMa;
+}
+
+/*
+ * Function: isMoveStartQueued
+ * ---------------------------
+ *   requests are started in order of arrival: a new request has to wait when the servo already has a
+ *   queued request, when any other request of its power group is waiting or when its start current
+ *   does not fit into the budget.
+ */
+bool isMoveStartQueued(const queuedStartType *request, const groupAdmissionType *groups) {
+
+	if (request->queued) {
+		return true;
+	}
+	if (request->groupIndex == -1) {
+		return false;
+	}
+	const groupAdmissionType *group = &groups[request->groupIndex];
+	if (group->queued > 0) {
+		return true;
+	}
+	return !isMoveStartAdmitted(group->currentMa, request->startCurrentMa, group->budgetMa);
+}
+
+/*
+ * Function: nextQueuedStart
+ * -------------------------
+ *   returns: the index of the oldest queued request of a not blocked power group if it fits into
+ *   the budget, -1 if no request can be started.
+ *   The oldest request of a group that does not fit blocks the group, younger requests must not
+ *   overtake it. Call repeatedly with admitQueuedStart for each returned request.
+ */
+int nextQueuedStart(const queuedStartType *requests, int numRequests, groupAdmissionType *groups) {
+
+	while (true) {
+
+		int oldest = -1;
+		for (int r = 0; r < numRequests; r++) {
+			if (!requests[r].queued) {
+				continue;
+			}
+			if (requests[r].groupIndex != -1 && groups[requests[r].groupIndex].blocked) {
+				continue;
+			}
+			if (oldest == -1 || (long)(requests[r].queuedMillis - requests[oldest].queuedMillis) < 0) {
+				oldest = r;
+			}
+		}
+		if (oldest == -1) {
+			return -1;
+		}
+
+		int groupIndex = requests[oldest].groupIndex;
+		if (groupIndex == -1) {
+			return oldest;
+		}
+		groupAdmissionType *group = &groups[groupIndex];
+		if (isMoveStartAdmitted(group->currentMa, requests[oldest].startCurrentMa, group->budgetMa)) {
+			return oldest;
+		}
+		group->blocked = true;
+	}
+}
+
+/*
+ * Function: admitQueuedStart
+ * --------------------------
+ *   the started servo counts with its start current for the rest of the admission pass
+ */
+void admitQueuedStart(queuedStartType *request, groupAdmissionType *groups) {
+	request->queued = false;
+	if (request->groupIndex != -1) {
+		groups[request->groupIndex].currentMa += request->startCurrentMa;
+		groups[request->groupIndex].queued--;
+	}
+}
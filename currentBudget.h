@@ -0,0 +1,48 @@
+#ifndef currentBudget_h
+#define currentBudget_h
+
+// current estimate of a servo, used to limit the stall current peaks of a power group
+// kept free of arduino calls so the admission logic can also be run on a host build (see host/)
+typedef struct {
+	int startCurrentMa;		// estimated current while the servo accelerates (close to stall current)
+	int runCurrentMa;		// estimated current while the servo follows the move
+	int startPhaseMs;		// duration of the start phase
+} servoCurrentType;
+
+// move request of a servo waiting for room in the current budget of its power group
+typedef struct {
+	bool queued;
+	int groupIndex;				// power group of the servo, -1 for servos without power group
+	int startCurrentMa;
+	unsigned long queuedMillis;	// millis of the request, defines the start order
+} queuedStartType;
+
+// power group state for one admission pass over the queued requests
+typedef struct {
+	int currentMa;		// estimated current of the moving servos in the group
+	int budgetMa;		// 0 for no limit
+	bool blocked;		// the oldest queued request does not fit, younger requests have to wait
+	int queued;			// number of queued requests of the group
+} groupAdmissionType;
+
+// estimated current of a servo with a move started msInMove ago
+extern int estimatedServoCurrentMa(const servoCurrentType *servoCurrent, bool moving, unsigned long msInMove);
+
+// check whether a new move can be started in a power group without exceeding the budget
+// a budget of 0 means no limit
+extern bool isMoveStartAdmitted(int groupCurrentMa, int startCurrentMa, int budgetMa);
+
+// check whether a new move request has to be queued instead of started
+// the queued flag of the request tells about an already waiting request, the queued count of its group
+// about waiting requests of other servos, the group current is only needed with a budget and no waiting request
+extern bool isMoveStartQueued(const queuedStartType *request, const groupAdmissionType *groups);
+
+// index of the oldest queued request that can be started now, -1 if none
+// a request that does not fit blocks its power group for the rest of the pass
+extern int nextQueuedStart(const queuedStartType *requests, int numRequests, groupAdmissionType *groups);
+
+// remove an admitted request from the queue and add its start current to the power group
+// the queued count of the group is decremented
+extern void admitQueuedStart(queuedStartType *request, groupAdmissionType *groups);
+
+#endif
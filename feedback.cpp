@@ -1,6 +1,7 @@
 
 #include <Wire.h>
 #include "feedback.h"
+#include "hostPort.h"
 
 //int AS5600_ADDRESS=0x36;
 //int TCA9548_ADDRESS=0x70;
@@ -21,7 +22,7 @@ float calcPower(float base, float speed, float offset) {
 
 float calcLog(float base, float speed, float offset) {
   // calcType 3
-  Serial.print("calc log, base: "); Serial.print(base); Serial.print(" speed: ");Serial.print(speed);Serial.print(" offset: "); Serial.println(offset);  
+  hostPort->print("calc log, base: "); hostPort->print(base); hostPort->print(" speed: ");hostPort->print(speed);hostPort->print(" offset: "); hostPort->println(offset);  
   return (base * log(speed)) + offset;    // arduino log = ln, use log10 otherwise
 }
 
@@ -33,26 +34,26 @@ float calcLog(float base, float speed, float offset) {
  * The multiplexer has a fixed address 0x70 .. 0x77 (soldered on chip)
  */
 void selectChannel(byte channel) {
-  //Serial.print("i62 select channel: "); Serial.println(channel);
+  //hostPort->print("i62 select channel: "); hostPort->println(channel);
   Wire.beginTransmission(TCA9548_ADDRESS);
   Wire.write(1 << channel);
   Wire.endTransmission();
-  //Serial.println("i63 channel selected");
+  //hostPort->println("i63 channel selected");
 }
 
 
 int getRegisterValue(int registerAddr) {
   /* Read Low Byte */
-  //Serial.print("i64 getRegisterValue: "); Serial.println(registerAddr);
+  //hostPort->print("i64 getRegisterValue: "); hostPort->println(registerAddr);
   Wire.beginTransmission(AS5600_ADDRESS);
   Wire.write(registerAddr);
   Wire.endTransmission();
   Wire.requestFrom(AS5600_ADDRESS, 1);
   unsigned long timeout = millis() + 10;
   while (Wire.available() == 0 && millis() < timeout);
-  if (millis() >= timeout) {Serial.println("i65 no response from i2c"); return 0;}
+  if (millis() >= timeout) {hostPort->println("i65 no response from i2c"); return 0;}
   byte value = Wire.read();
-  //Serial.print("i66 value read "); Serial.print(registerAddr); Serial.print(": "); Serial.println(value);
+  //hostPort->print("i66 value read "); hostPort->print(registerAddr); hostPort->print(": "); hostPort->println(value);
   return value;
 }
 
@@ -61,18 +62,19 @@ int getRegisterValue(int registerAddr) {
  * Function: readCurrentMagnetAngle
  * --------------------------------
  *   returns: the absolut magnet angle as a value between 0 and 360 degrees.
+ *   the raw values are logged with log_i69, the verbose flag of the caller is not used
  */
-int readCurrentMagnetAngle(byte channel, bool isVerbose) {
+int readCurrentMagnetAngle(byte channel, bool /* isVerbose */) {
   selectChannel(channel);
   int raw_hi = getRegisterValue(RAW_ANGLE_HI);
   int raw_lo = getRegisterValue(RAW_ANGLE_LO);
   int raw = (raw_hi << 8) + raw_lo;
   int angle = int(raw / 4096.0 * 360);
   if (log_i69) {
-    Serial.print("i69 magnet hi: "); Serial.print(raw_hi); 
-    Serial.print(", lo: "); Serial.print(raw_lo); 
-    Serial.print(", total: "); Serial.print(raw);
-    Serial.print(", angle: "); Serial.println(angle);
+    hostPort->print("i69 magnet hi: "); hostPort->print(raw_hi); 
+    hostPort->print(", lo: "); hostPort->print(raw_lo); 
+    hostPort->print(", total: "); hostPort->print(raw);
+    hostPort->print(", angle: "); hostPort->println(angle);
   }
   return angle;
 }
@@ -0,0 +1,21 @@
+#ifndef check_h
+#define check_h
+
+// minimal checks for the host tests, a failed check is printed and counted, the test exits with the count
+#include <stdio.h>
+
+extern int checkFailures;
+
+#define CHECK(cond) do { if (!(cond)) { checkFailures++; \
+	printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); } } while (0)
+
+#define CHECK_EQ(a, b) do { long _a = (long)(a); long _b = (long)(b); if (_a != _b) { checkFailures++; \
+	printf("%s:%d: check failed: %s == %s (%ld != %ld)\n", __FILE__, __LINE__, #a, #b, _a, _b); } } while (0)
+
+#define CHECK_NEAR(a, b, tol) do { double _a = (double)(a); double _b = (double)(b); \
+	if (_a - _b > (tol) || _b - _a > (tol)) { checkFailures++; \
+	printf("%s:%d: check failed: %s ~ %s (%.3f != %.3f)\n", __FILE__, __LINE__, #a, #b, _a, _b); } } while (0)
+
+#define CHECK_DONE(name) (printf("%s: %s\n", name, checkFailures == 0 ? "ok" : "FAILED"), checkFailures == 0 ? 0 : 1)
+
+#endif
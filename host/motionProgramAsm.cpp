@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "motionProgramAsm.h"
+
+// operands of each opcode in the order of motionProgramOpType
+//   p: pin, b: position, r: register (1 byte), u: unsigned, s: signed, a: jump target (2 bytes)
+typedef struct {
+	const char *mnemonic;
+	const char *operands;
+} instructionType;
+
+static const instructionType instructions[] = {
+	{"END", ""}, {"MOVE", "pbu"}, {"MOVER", "pru"}, {"WAIT", "u"}, {"WAITR", "r"}, {"ARRIVE", "p"},
+	{"SET", "rs"}, {"ADD", "rs"}, {"RAND", "ru"}, {"POS", "rp"}, {"JMP", "a"}, {"DJNZ", "ra"},
+	{"JLT", "rsa"}, {"JGT", "rsa"}
+};
+#define NUMBER_OF_INSTRUCTIONS (int)(sizeof(instructions) / sizeof(instructions[0]))
+
+#define MAX_LABELS 64
+#define MAX_LABEL_LENGTH 24
+#define MAX_LINE_LENGTH 160
+#define MAX_TOKENS 8
+
+typedef struct {
+	char name[MAX_LABEL_LENGTH];
+	int address;
+} labelType;
+
+typedef struct {
+	labelType labels[MAX_LABELS];
+	int numLabels;
+	char *error;
+	int errorSize;
+	int lineNumber;
+} assemblerType;
+
+static int fail(assemblerType *as, const char *reason, const char *token) {
+	snprintf(as->error, as->errorSize, "line %d: %s%s%s", as->lineNumber, reason, token[0] ? " " : "", token);
+	return -1;
+}
+
+static int operandSize(char kind) {
+	return kind == 'u' || kind == 's' || kind == 'a' ? 2 : 1;
+}
+
+static int instructionSize(int op) {
+	int size = 1;
+	for (const char *kind = instructions[op].operands; *kind; kind++) {
+		size += operandSize(*kind);
+	}
+	return size;
+}
+
+static int findInstruction(const char *mnemonic) {
+	for (int op = 0; op < NUMBER_OF_INSTRUCTIONS; op++) {
+		if (strcasecmp(instructions[op].mnemonic, mnemonic) == 0) {
+			return op;
+		}
+	}
+	return -1;
+}
+
+static int findLabel(const assemblerType *as, const char *name) {
+	for (int l = 0; l < as->numLabels; l++) {
+		if (strcmp(as->labels[l].name, name) == 0) {
+			return l;
+		}
+	}
+	return -1;
+}
+
+static bool parseNumber(const char *token, long *value) {
+	char *end;
+	*value = strtol(token, &end, 0);
+	return token[0] != '\0' && *end == '\0';
+}
+
+// splits a source line into an optional label and the tokens of the instruction, comments removed
+static int splitLine(char *line, char **label, char **tokens) {
+	char *comment = strchr(line, ';');
+	if (comment != NULL) {
+		*comment = '\0';
+	}
+	for (char *c = line; *c; c++) {
+		if (*c == ',' || *c == '\t' || *c == '\r' || *c == '\n') {
+			*c = ' ';
+		}
+	}
+	*label = NULL;
+	int numTokens = 0;
+	char *save;
+	for (char *token = strtok_r(line, " ", &save); token != NULL; token = strtok_r(NULL, " ", &save)) {
+		int length = strlen(token);
+		if (numTokens == 0 && *label == NULL && token[length - 1] == ':') {
+			token[length - 1] = '\0';
+			*label = token;
+			continue;
+		}
+		if (numTokens < MAX_TOKENS) {
+			tokens[numTokens] = token;
+		}
+		numTokens++;
+	}
+	return numTokens;
+}
+
+static int encodeOperand(assemblerType *as, char kind, const char *token, unsigned char *code) {
+	long value;
+	if (kind == 'r') {
+		if ((token[0] != 'r' && token[0] != 'R') || !parseNumber(token + 1, &value)
+			|| value < 0 || value >= MOTION_PROGRAM_REGISTERS) {
+			return fail(as, "register r0..r7 expected:", token);
+		}
+	} else if (kind == 'a' && findLabel(as, token) != -1) {
+		value = as->labels[findLabel(as, token)].address;
+	} else if (!parseNumber(token, &value)) {
+		return fail(as, kind == 'a' ? "unknown label:" : "number expected:", token);
+	} else if ((kind == 'p' && (value < 0 || value > 255))
+		|| (kind == 'b' && (value < 0 || value > 180))
+		|| (kind == 'u' && (value < 0 || value > 65535))
+		|| (kind == 's' && (value < -32768 || value > 32767))
+		|| (kind == 'a' && (value < 0 || value >= MOTION_PROGRAM_SIZE))) {
+		return fail(as, "value out of range:", token);
+	}
+	code[0] = value & 0xFF;
+	if (operandSize(kind) == 2) {
+		code[1] = (value >> 8) & 0xFF;
+	}
+	return operandSize(kind);
+}
+
+// pass 0 collects the labels, pass 1 encodes the instructions
+static int assemblePass(assemblerType *as, int pass, const char *source, unsigned char *code, int maxLength) {
+
+	int length = 0;
+	as->lineNumber = 0;
+	const char *lineStart = source;
+	while (*lineStart != '\0') {
+		const char *lineEnd = strchr(lineStart, '\n');
+		int lineLength = lineEnd != NULL ? lineEnd - lineStart : strlen(lineStart);
+		as->lineNumber++;
+		if (lineLength >= MAX_LINE_LENGTH) {
+			return fail(as, "line too long", "");
+		}
+		char line[MAX_LINE_LENGTH];
+		memcpy(line, lineStart, lineLength);
+		line[lineLength] = '\0';
+		lineStart += lineEnd != NULL ? lineLength + 1 : lineLength;
+
+		char *label;
+		char *tokens[MAX_TOKENS];
+		int numTokens = splitLine(line, &label, tokens);
+
+		if (label != NULL && pass == 0) {
+			if (findLabel(as, label) != -1) {
+				return fail(as, "label defined twice:", label);
+			}
+			if (as->numLabels == MAX_LABELS || strlen(label) >= MAX_LABEL_LENGTH || label[0] == '\0') {
+				return fail(as, "invalid label:", label);
+			}
+			strcpy(as->labels[as->numLabels].name, label);
+			as->labels[as->numLabels].address = length;
+			as->numLabels++;
+		}
+		if (numTokens == 0) {
+			continue;
+		}
+
+		int op = findInstruction(tokens[0]);
+		if (op == -1) {
+			return fail(as, "unknown instruction:", tokens[0]);
+		}
+		const char *operands = instructions[op].operands;
+		if (numTokens - 1 != (int)strlen(operands)) {
+			char expected[32];
+			snprintf(expected, sizeof(expected), "%d", (int)strlen(operands));
+			return fail(as, "number of operands, expected:", expected);
+		}
+		if (length + instructionSize(op) > maxLength) {
+			return fail(as, "program too long", "");
+		}
+		if (pass == 0) {
+			length += instructionSize(op);
+			continue;
+		}
+		code[length++] = op;
+		for (int o = 0; operands[o] != '\0'; o++) {
+			int size = encodeOperand(as, operands[o], tokens[o + 1], &code[length]);
+			if (size < 0) {
+				return -1;
+			}
+			length += size;
+		}
+	}
+	return length;
+}
+
+int assembleMotionProgram(const char *source, unsigned char *code, int maxLength, char *error, int errorSize) {
+	assemblerType as;
+	as.numLabels = 0;
+	as.error = error;
+	as.errorSize = errorSize;
+	error[0] = '\0';
+	if (assemblePass(&as, 0, source, code, maxLength) < 0) {
+		return -1;
+	}
+	return assemblePass(&as, 1, source, code, maxLength);
+}
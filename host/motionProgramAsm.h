@@ -0,0 +1,24 @@
+#ifndef motionProgramAsm_h
+#define motionProgramAsm_h
+
+// assembler of the motion programs (motionProgram.h), used by mpasm and testMotionProgram
+//
+// one instruction per line, the mnemonics of motionProgram.h, operands separated by commas or blanks:
+//   ; wave pin 7 three times
+//           SET r0, 3
+//   wave:   MOVE 7, 70, 400
+//           ARRIVE 7
+//           MOVE 7, 110, 400
+//           ARRIVE 7
+//           DJNZ r0, wave
+//           END
+// registers r0..r7, numbers decimal or 0x hex, jump targets a label or a byte offset,
+// ; starts a comment, labels end with a colon
+
+#include "motionProgram.h"
+
+// returns the program length, -1 on an error with the line number and the reason in error
+extern int assembleMotionProgram(const char *source, unsigned char *code, int maxLength,
+	char *error, int errorSize);
+
+#endif
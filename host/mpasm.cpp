@@ -0,0 +1,76 @@
+// assembler of the motion programs, writes the commands that load a program on the board
+//
+//   mpasm [-p <program>] [-x] <source>
+//
+//   -p  program number of the z command, default 0
+//   -x  write the program as hex bytes only
+//   without -x the output is the clear command and the load commands, sent line by line they replace
+//   the program on the board, z,<program>,2 starts it:
+//     z,0,0
+//     z,0,1,0,060003000107469001...
+//   the source syntax is described in motionProgramAsm.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "motionProgramAsm.h"
+
+const int LOAD_CHUNK_BYTES = 32;		// the load command with sequence number fits the 100 byte receive buffer
+const int MAX_SOURCE_LENGTH = 64000;
+
+static void usage() {
+	fprintf(stderr, "usage: mpasm [-p <program>] [-x] <source>\n");
+}
+
+int main(int argc, char **argv) {
+
+	int program = 0;
+	bool hexOnly = false;
+	int option;
+	while ((option = getopt(argc, argv, "p:x")) != -1) {
+		switch (option) {
+		case 'p': program = atoi(optarg); break;
+		case 'x': hexOnly = true; break;
+		default: usage(); return 2;
+		}
+	}
+	if (optind != argc - 1) {
+		usage();
+		return 2;
+	}
+
+	FILE *file = fopen(argv[optind], "r");
+	if (file == NULL) {
+		fprintf(stderr, "mpasm: cannot read %s\n", argv[optind]);
+		return 2;
+	}
+	static char source[MAX_SOURCE_LENGTH + 1];
+	size_t sourceLength = fread(source, 1, MAX_SOURCE_LENGTH, file);
+	fclose(file);
+	source[sourceLength] = '\0';
+
+	unsigned char code[MOTION_PROGRAM_SIZE];
+	char error[120];
+	int length = assembleMotionProgram(source, code, MOTION_PROGRAM_SIZE, error, sizeof(error));
+	if (length < 0) {
+		fprintf(stderr, "%s: %s\n", argv[optind], error);
+		return 1;
+	}
+
+	if (hexOnly) {
+		for (int i = 0; i < length; i++) {
+			printf("%02X", code[i]);
+		}
+		printf("\n");
+		return 0;
+	}
+	printf("z,%d,0\n", program);
+	for (int offset = 0; offset < length; offset += LOAD_CHUNK_BYTES) {
+		printf("z,%d,1,%d,", program, offset);
+		for (int i = offset; i < length && i < offset + LOAD_CHUNK_BYTES; i++) {
+			printf("%02X", code[i]);
+		}
+		printf("\n");
+	}
+	return 0;
+}
@@ -0,0 +1,358 @@
+// replay of a traffic capture (command c) with the host build of the firmware
+//
+//   replay [-r] [-s <cpuScale>] [-w <windowMs>] [-p <positions>] [-o <capture>] <capture>
+//
+//   the H records of the capture are sent to the firmware at their recorded time offsets, the output
+//   of the firmware is compared with the recorded F records (status frames)
+//   -r  real time, the clock is the time of the host
+//       default is maximum speed: the clock is the cpu time spent in the firmware times cpuScale,
+//       scheduler passes without a due task skip to the next millisecond (not part of the idle time of i81)
+//   -s  cpuScale, run time of the firmware on the Due / run time on the host (default 25)
+//   -w  a recorded status frame matches a replayed frame of the pin within +-windowMs (default 60)
+//   -p  and within +-positions of the recorded position (default 1)
+//   -o  write the replayed traffic in capture format, e.g. as reference for a later replay
+//
+//   reports commands/s, loop overruns (task runs over budget and late runs from the scheduler
+//   statistics), output bytes/s of the firmware and the status frames without match in either stream
+//   exit code 0: no divergence, 1: divergence, 2: usage or capture error
+//
+//   the host build has no sensors, the feedback of servos with a sensor reads 0 and diverges
+
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "Arduino.h"
+#include "scheduler.h"
+
+void setup();
+void loop();
+
+const double DEFAULT_CPU_SCALE = 25;		// rough ratio of a desktop cpu to the 84 MHz Cortex-M3 of the Due
+const long DEFAULT_WINDOW_MS = 60;			// 3 servo update periods
+const int DEFAULT_POSITION_TOLERANCE = 1;
+const int MAX_REPORTED_DIVERGENCES = 10;
+
+typedef struct {
+	unsigned long us;		// offset to the first command
+	int pin;
+	int status;
+	int position;
+} frameType;
+
+typedef struct {
+	unsigned long us;
+	std::string line;
+} commandType;
+
+typedef struct {
+	std::vector<commandType> commands;
+	std::vector<frameType> frames;
+	unsigned long texts;
+	unsigned long bytes;		// board -> host bytes, frames and text messages with terminator
+	unsigned long endUs;
+} trafficType;
+
+static int hexValue(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+static void addFrame(trafficType *traffic, unsigned long us, const std::string &bytes) {
+	if (bytes.size() < 3) {
+		return;
+	}
+	frameType frame;
+	frame.us = us;
+	frame.pin = (uint8_t)bytes[0] & 0x3F;
+	frame.status = (uint8_t)bytes[1];
+	frame.position = (uint8_t)bytes[2] - 0x10;
+	traffic->frames.push_back(frame);
+}
+
+// reads the records of a capture, lines that are not records (e.g. debug output) are skipped
+// the time offsets start with the first command, the output before it belongs to earlier commands
+static bool readCapture(const char *fileName, trafficType *traffic) {
+
+	FILE *file = fopen(fileName, "r");
+	if (file == NULL) {
+		return false;
+	}
+	*traffic = trafficType();
+
+	bool haveStart = false;
+	unsigned long startUs = 0;
+	char line[512];
+	while (fgets(line, sizeof(line), file) != NULL) {
+		unsigned long us;
+		char type;
+		int payloadStart;
+		if (sscanf(line, "%lu %c %n", &us, &type, &payloadStart) != 2 || strchr("HBF", type) == NULL) {
+			continue;
+		}
+		if (!haveStart) {
+			if (type != 'H') {
+				continue;
+			}
+			startUs = us;
+			haveStart = true;
+		}
+		us -= startUs;
+		std::string payload = line + payloadStart;
+		while (!payload.empty() && (payload.back() == '\n' || payload.back() == '\r')) {
+			payload.pop_back();
+		}
+
+		if (type == 'H') {
+			traffic->commands.push_back({us, payload});
+		} else if (type == 'B') {
+			traffic->texts++;
+			traffic->bytes += payload.size() + 2;
+		} else {
+			std::string bytes;
+			for (size_t i = 0; i + 1 < payload.size(); i += 2) {
+				int high = hexValue(payload[i]);
+				int low = hexValue(payload[i + 1]);
+				if (high < 0 || low < 0) {
+					break;
+				}
+				bytes += (char)(high * 16 + low);
+			}
+			addFrame(traffic, us, bytes);
+			traffic->bytes += bytes.size() + 1;
+		}
+		traffic->endUs = us;
+	}
+	fclose(file);
+	return haveStart;
+}
+
+static bool isEarlier(const frameType &frame, unsigned long us) {
+	return frame.us < us;
+}
+
+// true if the frames of the pin, sorted by time, have one with the same status and position within the window
+static bool hasMatch(const std::vector<frameType> &frames, const frameType &frame, unsigned long windowUs, int tolerance) {
+	unsigned long fromUs = frame.us > windowUs ? frame.us - windowUs : 0;
+	std::vector<frameType>::const_iterator other = std::lower_bound(frames.begin(), frames.end(), fromUs, isEarlier);
+	for (; other != frames.end() && other->us <= frame.us + windowUs; ++other) {
+		if (other->status == frame.status && abs(other->position - frame.position) <= tolerance) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static std::vector<frameType> framesOfPin(const std::vector<frameType> &frames, int pin) {
+	std::vector<frameType> pinFrames;
+	for (size_t i = 0; i < frames.size(); i++) {
+		if (frames[i].pin == pin) {
+			pinFrames.push_back(frames[i]);
+		}
+	}
+	return pinFrames;
+}
+
+// returns the number of frames up to endUs without match, the first ones are printed
+static unsigned long unmatchedFrames(const char *name, const std::vector<frameType> &frames,
+	const std::vector<frameType> &others, unsigned long endUs, unsigned long windowUs, int tolerance, int *reported) {
+
+	unsigned long unmatched = 0;
+	for (int pin = 0; pin < 64; pin++) {
+		std::vector<frameType> pinFrames = framesOfPin(frames, pin);
+		std::vector<frameType> pinOthers = framesOfPin(others, pin);
+		for (size_t i = 0; i < pinFrames.size(); i++) {
+			if (pinFrames[i].us > endUs || hasMatch(pinOthers, pinFrames[i], windowUs, tolerance)) {
+				continue;
+			}
+			unmatched++;
+			if (*reported < MAX_REPORTED_DIVERGENCES) {
+				(*reported)++;
+				printf("  %s frame without match: %.3f s, pin %d, status 0x%02x, position %d\n",
+					name, pinFrames[i].us / 1e6, pin, pinFrames[i].status, pinFrames[i].position);
+			}
+		}
+	}
+	return unmatched;
+}
+
+// end of the first frame or text line, npos if it is not complete
+// the frames of servos without feedback have 4 bytes, the feedback frames 8 bytes, their ms bytes can be 0x0A
+static size_t frameOrLineEnd(const std::string &pending) {
+	if (!pending.empty() && (uint8_t)pending[0] >= 0xC0) {
+		if (pending.size() >= 4 && pending[3] == '\n') {
+			return 3;
+		}
+		return pending.size() >= 8 ? 7 : std::string::npos;
+	}
+	return pending.find('\n');
+}
+
+// one loop() of the firmware, the output is collected in replayed and optionally written as capture
+static void runLoop(trafficType *replayed, std::string *pending, std::vector<std::string> *texts,
+	unsigned long startUs, FILE *out) {
+
+	unsigned long idlePasses = schedulerIdlePasses;
+	stubEnterFirmware();
+	loop();
+	stubLeaveFirmware();
+	unsigned long us = micros() - startUs;
+
+	*pending += Serial.tx;
+	Serial.tx.clear();
+	size_t end;
+	while ((end = frameOrLineEnd(*pending)) != std::string::npos) {
+		std::string line = pending->substr(0, end);
+		pending->erase(0, end + 1);
+		replayed->bytes += line.size() + 1;
+		if (!line.empty() && (uint8_t)line[0] >= 0xC0) {
+			addFrame(replayed, us, line);
+			if (out != NULL) {
+				fprintf(out, "%lu F ", micros());
+				for (size_t i = 0; i < line.size(); i++) {
+					fprintf(out, "%02X", (uint8_t)line[i]);
+				}
+				fprintf(out, "\n");
+			}
+		} else {
+			if (!line.empty() && line.back() == '\r') {
+				line.pop_back();
+			}
+			replayed->texts++;
+			texts->push_back(line);
+			if (out != NULL) {
+				fprintf(out, "%lu B %s\n", micros(), line.c_str());
+			}
+		}
+	}
+
+	if (!stubRealTime && schedulerIdlePasses != idlePasses) {
+		stubSkipMicros(1000 - micros() % 1000);
+	}
+}
+
+static void sendCommand(const std::string &line, FILE *out) {
+	if (Serial.rxPos == Serial.rx.size()) {
+		Serial.rx.clear();
+		Serial.rxPos = 0;
+	}
+	Serial.rx += line;
+	Serial.rx += '\n';
+	if (out != NULL) {
+		fprintf(out, "%lu H %s\n", micros(), line.c_str());
+	}
+}
+
+static double hostSeconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage() {
+	fprintf(stderr, "usage: replay [-r] [-s <cpuScale>] [-w <windowMs>] [-p <positions>] [-o <capture>] <capture>\n");
+}
+
+int main(int argc, char **argv) {
+
+	long windowMs = DEFAULT_WINDOW_MS;
+	int tolerance = DEFAULT_POSITION_TOLERANCE;
+	const char *outName = NULL;
+	stubCpuScale = DEFAULT_CPU_SCALE;
+
+	int option;
+	while ((option = getopt(argc, argv, "rs:w:p:o:")) != -1) {
+		switch (option) {
+		case 'r': stubRealTime = true; break;
+		case 's': stubCpuScale = atof(optarg); break;
+		case 'w': windowMs = atol(optarg); break;
+		case 'p': tolerance = atoi(optarg); break;
+		case 'o': outName = optarg; break;
+		default: usage(); return 2;
+		}
+	}
+	if (optind != argc - 1 || stubCpuScale <= 0) {
+		usage();
+		return 2;
+	}
+
+	trafficType recorded;
+	if (!readCapture(argv[optind], &recorded)) {
+		fprintf(stderr, "replay: no capture records in %s\n", argv[optind]);
+		return 2;
+	}
+	FILE *out = NULL;
+	if (outName != NULL && (out = fopen(outName, "w")) == NULL) {
+		fprintf(stderr, "replay: cannot write %s\n", outName);
+		return 2;
+	}
+
+	// the boot messages are not part of a capture
+	stubEnterFirmware();
+	setup();
+	stubLeaveFirmware();
+	Serial.tx.clear();
+
+	trafficType replayed = trafficType();
+	std::string pending;
+	std::vector<std::string> texts;
+	double hostStart = hostSeconds();
+	unsigned long startUs = micros();
+	size_t next = 0;
+	// the firmware keeps running for the match window after the last record
+	while (next < recorded.commands.size() || micros() - startUs < recorded.endUs + windowMs * 1000) {
+		while (next < recorded.commands.size() && micros() - startUs >= recorded.commands[next].us) {
+			sendCommand(recorded.commands[next].line, out);
+			next++;
+		}
+		runLoop(&replayed, &pending, &texts, startUs, out);
+	}
+	replayed.endUs = micros() - startUs;
+	double hostDuration = hostSeconds() - hostStart;
+
+	// scheduler statistics of the whole replay
+	size_t replayTexts = texts.size();
+	sendCommand("t", NULL);
+	while (texts.empty() || texts.back().compare(0, 4, "i81 ") != 0) {
+		runLoop(&replayed, &pending, &texts, startUs, NULL);
+	}
+	unsigned long overruns = 0;
+	unsigned long lateRuns = 0;
+	for (size_t i = replayTexts; i < texts.size(); i++) {
+		const char *overrunText = strstr(texts[i].c_str(), "overruns: ");
+		const char *lateText = strstr(texts[i].c_str(), "late: ");
+		if (texts[i].compare(0, 4, "i80 ") == 0 && overrunText != NULL && lateText != NULL) {
+			overruns += atol(overrunText + 10);
+			lateRuns += atol(lateText + 6);
+		}
+	}
+
+	double seconds = replayed.endUs / 1e6;
+	double recordedSeconds = recorded.endUs > 0 ? recorded.endUs / 1e6 : 1e-6;
+	printf("replay of %s, %s\n", argv[optind], stubRealTime ? "real time" : "maximum speed");
+	printf("  duration: %.3f s, host: %.3f s\n", seconds, hostDuration);
+	printf("  commands: %zu, commands/s: %.1f\n", recorded.commands.size(), recorded.commands.size() / seconds);
+	printf("  loop overruns: %lu, late runs: %lu\n", overruns, lateRuns);
+	printf("  output bytes: %lu, bytes/s: %.1f, frames: %zu, texts: %lu\n",
+		replayed.bytes, replayed.bytes / seconds, replayed.frames.size(), replayTexts);
+	printf("  captured bytes: %lu, bytes/s: %.1f, frames: %zu, texts: %lu\n",
+		recorded.bytes, recorded.bytes / recordedSeconds, recorded.frames.size(), recorded.texts);
+	for (size_t i = replayTexts; i < texts.size(); i++) {
+		printf("  %s\n", texts[i].c_str());
+	}
+
+	int reported = 0;
+	unsigned long missing = unmatchedFrames("captured", recorded.frames, replayed.frames,
+		recorded.endUs, windowMs * 1000, tolerance, &reported);
+	unsigned long extra = unmatchedFrames("replayed", replayed.frames, recorded.frames,
+		recorded.endUs, windowMs * 1000, tolerance, &reported);
+	printf("  status stream divergence: %lu captured and %lu replayed frames without match\n", missing, extra);
+
+	if (out != NULL) {
+		fclose(out);
+	}
+	return missing == 0 && extra == 0 ? 0 : 1;
+}
@@ -0,0 +1,52 @@
+#include <math.h>
+#include "servoPlant.h"
+
+
+void servoPlantInit(servoPlantType *plant, float position, float lagMs, int deadTimeMs, float deadband,
+	float backlash, int stepMs) {
+
+	plant->lagMs = lagMs;
+	plant->deadTimeMs = deadTimeMs;
+	plant->deadband = deadband;
+	plant->backlash = backlash;
+	plant->stepMs = stepMs;
+
+	for (int i = 0; i < PLANT_MAX_DELAY_STEPS; i++) {
+		plant->delayed[i] = round(position);
+	}
+	plant->delayIndex = 0;
+	plant->servoTarget = position;
+	plant->horn = position;
+	plant->joint = position;
+}
+
+
+int servoPlantStep(servoPlantType *plant, int writePosition) {
+
+	// transport delay, a ring of the last write positions
+	int delaySteps = plant->deadTimeMs / plant->stepMs;
+	if (delaySteps >= PLANT_MAX_DELAY_STEPS) {
+		delaySteps = PLANT_MAX_DELAY_STEPS - 1;
+	}
+	plant->delayed[plant->delayIndex] = writePosition;
+	int target = plant->delayed[(plant->delayIndex - delaySteps + PLANT_MAX_DELAY_STEPS) % PLANT_MAX_DELAY_STEPS];
+	plant->delayIndex = (plant->delayIndex + 1) % PLANT_MAX_DELAY_STEPS;
+
+	// servo deadband
+	if (fabs(target - plant->servoTarget) >= plant->deadband) {
+		plant->servoTarget = target;
+	}
+
+	// first order lag of the horn
+	plant->horn += (plant->servoTarget - plant->horn) * (1 - exp(-plant->stepMs / plant->lagMs));
+
+	// gear slack, the joint is pushed by the horn at either end of the slack
+	float halfSlack = plant->backlash / 2;
+	if (plant->horn - plant->joint > halfSlack) {
+		plant->joint = plant->horn - halfSlack;
+	}
+	if (plant->joint - plant->horn > halfSlack) {
+		plant->joint = plant->horn + halfSlack;
+	}
+	return round(plant->joint);
+}
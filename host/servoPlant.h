@@ -0,0 +1,34 @@
+#ifndef servoPlant_h
+#define servoPlant_h
+
+// simulated feedback joint for the host tests
+// the write position reaches the servo after a dead time, the servo follows it with a first order lag
+// once the change exceeds its deadband, the joint follows the servo horn through the gear slack.
+// All positions in servo positions (0..180), the measured position is rounded like currentPosition.
+
+#define PLANT_MAX_DELAY_STEPS 32
+
+typedef struct {
+	// plant parameters
+	float lagMs;			// time constant of the first order lag
+	int deadTimeMs;			// transport delay of the write position, multiple of stepMs
+	float deadband;			// servo ignores target changes below the deadband
+	float backlash;			// total gear slack between horn and joint
+	int stepMs;				// update period
+
+	// plant state
+	int delayed[PLANT_MAX_DELAY_STEPS];
+	int delayIndex;
+	float servoTarget;		// target the servo electronics act on
+	float horn;
+	float joint;
+} servoPlantType;
+
+// initialize the plant at rest on position
+extern void servoPlantInit(servoPlantType *plant, float position, float lagMs, int deadTimeMs, float deadband,
+	float backlash, int stepMs);
+
+// advance the plant by one step with the new write position, returns the measured joint position
+extern int servoPlantStep(servoPlantType *plant, int writePosition);
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef Arduino_h
+#define Arduino_h
+
+// the part of the arduino core the sketch uses, for the host build of the firmware (host/replay)
+// time is the clock of the host build, see arduinoStubs.cpp
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdio.h>
+#include <string>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define FALLING 2
+#define RISING 3
+#define CHANGE 4
+#define LED_BUILTIN 13
+#define HEX 16
+#define DEC 10
+
+#define constrain(x, lo, hi) ((x) < (lo) ? (lo) : ((x) > (hi) ? (hi) : (x)))
+#define digitalPinToInterrupt(p) (p)
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+int digitalRead(int pin);
+int analogRead(int pin);
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+void attachInterrupt(int interrupt, void (*isr)(void), int mode);
+void detachInterrupt(int interrupt);
+void noInterrupts();
+void interrupts();
+
+class Print {
+public:
+	virtual size_t write(uint8_t c) = 0;
+	virtual size_t write(const uint8_t *buffer, size_t size) {
+		size_t n = 0;
+		for (size_t i = 0; i < size; i++) {
+			n += write(buffer[i]);
+		}
+		return n;
+	}
+	size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+	virtual void flush() {}
+
+	size_t print(const char *s) { return write(s); }
+	size_t print(char c) { return write((uint8_t)c); }
+	size_t print(int v, int base = DEC) { return printNumber(base == HEX ? "%x" : "%d", v); }
+	size_t print(unsigned int v, int base = DEC) { return printNumber(base == HEX ? "%x" : "%u", v); }
+	size_t print(long v, int base = DEC) { return printNumber(base == HEX ? "%lx" : "%ld", v); }
+	size_t print(unsigned long v, int base = DEC) { return printNumber(base == HEX ? "%lx" : "%lu", v); }
+	size_t print(unsigned char v, int base = DEC) { return print((unsigned int)v, base); }
+	size_t print(double v, int digits = 2) { return printNumber("%.*f", digits, v); }
+	size_t println() { return write("\r\n"); }
+	template<class T> size_t println(T v) { size_t n = print(v); return n + println(); }
+	template<class T> size_t println(T v, int base) { size_t n = print(v, base); return n + println(); }
+
+private:
+	template<class... T> size_t printNumber(const char *format, T... v) {
+		char text[40];
+		snprintf(text, sizeof(text), format, v...);
+		return write(text);
+	}
+};
+
+class Stream : public Print {
+public:
+	virtual int available() = 0;
+	virtual int read() = 0;
+	virtual int peek() = 0;
+};
+
+// serial port of the host build: received bytes are appended to rx by the test driver,
+// sent bytes are collected in tx
+class HostSerial : public Stream {
+public:
+	std::string rx;
+	size_t rxPos = 0;
+	std::string tx;
+	bool connected = true;
+
+	void begin(unsigned long baud) { (void)baud; }
+	int available() { return (int)(rx.size() - rxPos); }
+	int read() { return rxPos < rx.size() ? (uint8_t)rx[rxPos++] : -1; }
+	int peek() { return rxPos < rx.size() ? (uint8_t)rx[rxPos] : -1; }
+	size_t write(uint8_t c) { tx += (char)c; return 1; }
+	using Print::write;
+	operator bool() { return connected; }
+};
+
+extern HostSerial Serial;
+extern HostSerial SerialUSB;
+
+// clock of the host build
+// real time: micros() is the time of the host since the start
+// otherwise: micros() is the cpu time spent in the firmware, multiplied with stubCpuScale (the host is
+//   faster than the 84 MHz of the Due), plus the time skipped with stubSkipMicros and delay()
+extern bool stubRealTime;
+extern double stubCpuScale;
+void stubEnterFirmware();
+void stubLeaveFirmware();
+void stubSkipMicros(unsigned long us);
+
+#endif
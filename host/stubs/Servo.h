@@ -0,0 +1,27 @@
+#ifndef Servo_h
+#define Servo_h
+
+// servo library of the host build, keeps the last written position per pin
+
+#include "Arduino.h"
+
+#define STUB_PINS 80
+
+extern int stubServoWrites[STUB_PINS];
+
+class Servo {
+public:
+	uint8_t attach(int pin) { this->pin = pin; isAttached = true; return 0; }
+	uint8_t attach(int pin, int minUs, int maxUs) { (void)minUs; (void)maxUs; return attach(pin); }
+	void detach() { isAttached = false; }
+	void write(int value) { if (pin >= 0 && pin < STUB_PINS) { stubServoWrites[pin] = value; } }
+	void writeMicroseconds(int us) { (void)us; }
+	int read() { return pin >= 0 && pin < STUB_PINS ? stubServoWrites[pin] : 0; }
+	bool attached() { return isAttached; }
+
+private:
+	int pin = -1;
+	bool isAttached = false;
+};
+
+#endif
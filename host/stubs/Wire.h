@@ -0,0 +1,47 @@
+#ifndef Wire_h
+#define Wire_h
+
+// i2c of the host build, every device acknowledges and reads 0
+// except the raw angle registers of an AS5600 behind the TCA9548 multiplexer, they read
+// stubMagnetRaw[channel] (0..4095) of the last selected channel
+
+#include "Arduino.h"
+
+#define STUB_MUX_CHANNELS 8
+
+extern int stubMagnetRaw[STUB_MUX_CHANNELS];
+
+class TwoWire {
+public:
+	void begin() {}
+	void setClock(long clock) { (void)clock; }
+	void beginTransmission(int address) { this->address = address; }
+	size_t write(uint8_t c) {
+		if (address >= 0x70 && address <= 0x77) {
+			for (int ch = 0; ch < STUB_MUX_CHANNELS; ch++) {
+				if (c == (1 << ch)) channel = ch;
+			}
+		} else if (address == 0x36) {
+			reg = c;
+		}
+		return 1;
+	}
+	uint8_t endTransmission(bool sendStop = true) { (void)sendStop; return 0; }
+	uint8_t requestFrom(int address, int count) { this->address = address; return count; }
+	int available() { return 1; }
+	int read() {
+		if (address != 0x36) return 0;
+		if (reg == 0x0c) return (stubMagnetRaw[channel] >> 8) & 0x0f;
+		if (reg == 0x0d) return stubMagnetRaw[channel] & 0xff;
+		return 0;
+	}
+
+private:
+	int address = 0;
+	int channel = 0;
+	int reg = 0;
+};
+
+extern TwoWire Wire;
+
+#endif
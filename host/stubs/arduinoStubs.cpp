@@ -0,0 +1,94 @@
+// arduino core of the host build: clock, pins and ports
+#include <time.h>
+#include "Arduino.h"
+#include "Servo.h"
+#include "Wire.h"
+
+HostSerial Serial;
+HostSerial SerialUSB;
+TwoWire Wire;
+int stubServoWrites[STUB_PINS];
+int stubMagnetRaw[STUB_MUX_CHANNELS];
+
+bool stubRealTime = false;
+double stubCpuScale = 1;
+
+static unsigned long long skippedNs = 0;
+static unsigned long long firmwareNs = 0;	// cpu time spent in the firmware
+static unsigned long long enteredNs = 0;
+static bool inFirmware = false;
+static unsigned long long realTimeStartNs = 0;
+
+static unsigned long long clockNs(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void stubEnterFirmware() {
+	enteredNs = clockNs(CLOCK_THREAD_CPUTIME_ID);
+	inFirmware = true;
+}
+
+void stubLeaveFirmware() {
+	firmwareNs += clockNs(CLOCK_THREAD_CPUTIME_ID) - enteredNs;
+	inFirmware = false;
+}
+
+void stubSkipMicros(unsigned long us) {
+	skippedNs += 1000ULL * us;
+}
+
+unsigned long micros() {
+	if (stubRealTime) {
+		if (realTimeStartNs == 0) {
+			realTimeStartNs = clockNs(CLOCK_MONOTONIC);
+		}
+		return (unsigned long)((clockNs(CLOCK_MONOTONIC) - realTimeStartNs) / 1000);
+	}
+	unsigned long long ns = firmwareNs;
+	if (inFirmware) {
+		ns += clockNs(CLOCK_THREAD_CPUTIME_ID) - enteredNs;
+	}
+	return (unsigned long)((skippedNs + (unsigned long long)(ns * stubCpuScale)) / 1000);
+}
+
+unsigned long millis() {
+	return micros() / 1000;
+}
+
+void delayMicroseconds(unsigned int us) {
+	if (stubRealTime) {
+		unsigned long start = micros();
+		while (micros() - start < us) {
+		}
+		return;
+	}
+	stubSkipMicros(us);
+}
+
+void delay(unsigned long ms) {
+	delayMicroseconds(ms * 1000);
+}
+
+void pinMode(int, int) {}
+void digitalWrite(int, int) {}
+int digitalRead(int) { return HIGH; }
+int analogRead(int) { return 0; }
+
+long random(long max) {
+	return max > 0 ? rand() % max : 0;
+}
+
+long random(long min, long max) {
+	return max > min ? min + rand() % (max - min) : min;
+}
+
+void randomSeed(unsigned long seed) {
+	srand(seed);
+}
+
+void attachInterrupt(int, void (*)(void), int) {}
+void detachInterrupt(int) {}
+void noInterrupts() {}
+void interrupts() {}
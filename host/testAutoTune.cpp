@@ -0,0 +1,222 @@
+// host regression test of the autotune experiments (autoTune.cpp), relay feedback and backlash sweep,
+// against the simulated joint of servoPlant
+// the loop feeds the measured position of the previous update like Mai3Servo::autoTuneUpdate does it
+// in the 20 ms servo pass
+
+#include <math.h>
+#include "autoTune.h"
+#include "servoPlant.h"
+#include "check.h"
+
+int checkFailures = 0;
+
+const int STEP_MS = 20;
+const unsigned long MAX_EXPERIMENT_MS = 120000;
+
+// run an experiment from the joint resting at startPosition, returns the duration in ms
+unsigned long runExperiment(autoTuneType *tune, servoPlantType *plant, int experiment, float startPosition,
+	int amplitude, int cycles, int minPosition, int maxPosition) {
+
+	autoTuneStart(tune, experiment, startPosition, amplitude, cycles, minPosition, maxPosition, 0);
+	int measured = round(startPosition);
+	unsigned long ms;
+	for (ms = 0; ms < MAX_EXPERIMENT_MS && !autoTuneFinished(tune); ms += STEP_MS) {
+		int write = autoTuneStep(tune, measured, ms);
+		CHECK(write >= minPosition && write <= maxPosition);
+		measured = servoPlantStep(plant, write);
+	}
+	return ms;
+}
+
+// ultimate gain and period of the first order lag with dead time, the sampling adds about 1.5 periods
+void ultimateValues(float lagMs, int deadTimeMs, float *gain, float *periodMs) {
+	float delayMs = deadTimeMs + 1.5 * STEP_MS;
+	float low = 1e-5, high = 1;
+	for (int i = 0; i < 60; i++) {
+		float w = (low + high) / 2;
+		if (w * delayMs + atan(w * lagMs) < M_PI) {
+			low = w;
+		} else {
+			high = w;
+		}
+	}
+	*gain = sqrt(1 + low * lagMs * low * lagMs);
+	*periodMs = 2 * M_PI / low;
+}
+
+// golden values of the nominal joint, any change of the algorithm shows up here
+void testRelayNominal() {
+	autoTuneType tune;
+	servoPlantType plant;
+	servoPlantInit(&plant, 90, 150, 60, 2, 0, STEP_MS);
+	unsigned long ms = runExperiment(&tune, &plant, AUTOTUNE_RELAY_FEEDBACK, 90, 8, 4, 10, 170);
+
+	CHECK_EQ(tune.phase, AUTOTUNE_DONE);
+	CHECK_EQ(tune.failReason, AUTOTUNE_OK);
+	CHECK_NEAR(tune.ultimateGain, 2.63, 0.01);
+	CHECK_NEAR(tune.ultimatePeriodMs, 320, 0.5);
+	CHECK_NEAR(tune.lagMs, 60, 0.5);
+	CHECK_NEAR(tune.deadband, 2.5, 0.01);
+	CHECK(ms < 2500);
+
+	// Ziegler-Nichols on the 20 ms update period
+	CHECK_NEAR(tune.kp, 0.6 * tune.ultimateGain, 0.001);
+	CHECK_NEAR(tune.ki, tune.kp / (0.5 * tune.ultimatePeriodMs / 20), 0.001);
+	CHECK_NEAR(tune.kd, tune.kp * 0.125 * tune.ultimatePeriodMs / 20, 0.001);
+}
+
+// the relay estimate follows the ultimate values of the joint model within the describing function
+// and position quantisation error
+void testRelayFollowsPlant() {
+	const float lags[] = {100, 150, 300};
+	const int deadTimes[] = {40, 60, 100};
+	const int amplitudes[] = {6, 9, 12};
+
+	for (int p = 0; p < 3; p++) {
+		for (int a = 0; a < 3; a++) {
+			autoTuneType tune;
+			servoPlantType plant;
+			servoPlantInit(&plant, 90, lags[p], deadTimes[p], 1, 0, STEP_MS);
+			runExperiment(&tune, &plant, AUTOTUNE_RELAY_FEEDBACK, 90, amplitudes[a], 4, 10, 170);
+
+			float gain, periodMs;
+			ultimateValues(lags[p], deadTimes[p], &gain, &periodMs);
+			CHECK_EQ(tune.phase, AUTOTUNE_DONE);
+			CHECK(tune.ultimateGain > 0.6 * gain && tune.ultimateGain < 1.1 * gain);
+			CHECK(tune.ultimatePeriodMs > 0.8 * periodMs && tune.ultimatePeriodMs < 1.45 * periodMs);
+			CHECK_NEAR(tune.lagMs, deadTimes[p], 1.25 * STEP_MS);
+		}
+	}
+}
+
+// a slower joint gives a longer period and less gain margin
+void testRelayOrdering() {
+	autoTuneType fast, slow;
+	servoPlantType plant;
+	servoPlantInit(&plant, 90, 100, 40, 1, 0, STEP_MS);
+	runExperiment(&fast, &plant, AUTOTUNE_RELAY_FEEDBACK, 90, 8, 4, 10, 170);
+	servoPlantInit(&plant, 90, 300, 100, 1, 0, STEP_MS);
+	runExperiment(&slow, &plant, AUTOTUNE_RELAY_FEEDBACK, 90, 8, 4, 10, 170);
+	CHECK(slow.ultimatePeriodMs > fast.ultimatePeriodMs);
+	CHECK(slow.ki < fast.ki);
+	CHECK(slow.kd > fast.kd);
+}
+
+// the center is moved into min/max so the relay outputs stay in range
+void testRelayCenterInRange() {
+	autoTuneType tune;
+	servoPlantType plant;
+	servoPlantInit(&plant, 20, 150, 60, 1, 0, STEP_MS);
+	runExperiment(&tune, &plant, AUTOTUNE_RELAY_FEEDBACK, 20, 10, 3, 15, 170);
+	CHECK_NEAR(tune.centerPosition, 25, 0.01);
+	CHECK_EQ(tune.phase, AUTOTUNE_DONE);
+}
+
+// a deadband larger than the relay amplitude never moves the joint
+void testRelayNoMotion() {
+	autoTuneType tune;
+	servoPlantType plant;
+	servoPlantInit(&plant, 90, 150, 60, 12, 0, STEP_MS);
+	unsigned long ms = runExperiment(&tune, &plant, AUTOTUNE_RELAY_FEEDBACK, 90, 8, 4, 10, 170);
+	CHECK_EQ(tune.phase, AUTOTUNE_FAILED);
+	CHECK_EQ(tune.failReason, AUTOTUNE_NO_MOTION);
+	CHECK(ms <= AUTOTUNE_SETTLE_MS + 9 * AUTOTUNE_RAMP_MS + STEP_MS);
+}
+
+// a joint outside min/max stops the experiment
+void testRelayOutOfRange() {
+	autoTuneType tune;
+	servoPlantType plant;
+	servoPlantInit(&plant, 90, 150, 60, 0, 0, STEP_MS);
+	runExperiment(&tune, &plant, AUTOTUNE_RELAY_FEEDBACK, 90, 8, 4, 100, 170);
+	CHECK_EQ(tune.phase, AUTOTUNE_FAILED);
+	CHECK_EQ(tune.failReason, AUTOTUNE_OUT_OF_RANGE);
+}
+
+// golden values of the backlash sweep on the nominal joint
+void testSweepNominal() {
+	autoTuneType tune;
+	servoPlantType plant;
+	servoPlantInit(&plant, 90, 150, 60, 1, 4, STEP_MS);
+	unsigned long ms = runExperiment(&tune, &plant, AUTOTUNE_BACKLASH_SWEEP, 90, 10, 0, 10, 170);
+
+	CHECK_EQ(tune.phase, AUTOTUNE_DONE);
+	CHECK_NEAR(tune.backlash, 4, 0.01);
+	CHECK_NEAR(tune.deadband, 2, 0.01);
+	CHECK_EQ(tune.sweepOffset[0], 4);
+	CHECK_EQ(tune.sweepOffset[1], 7);
+	CHECK_EQ(tune.sweepOffset[2], 7);
+	CHECK_EQ(tune.sweepOffset[3], 2);
+	CHECK(ms < 5500);
+}
+
+// the sweep finds the gear slack of the joint model. The write positions are whole positions and the
+// servo ignores changes within its deadband, the horn settles up to deadband - 1 short of the write
+// position at either end of a reversal. The measured positions are rounded.
+void testSweepFollowsPlant() {
+	for (int lag = 100; lag <= 150; lag += 50) {
+		for (int deadTime = 0; deadTime <= 60; deadTime += 20) {
+			for (int deadband = 1; deadband <= 3; deadband++) {
+				for (float backlash = 0; backlash <= 6; backlash += 1.5) {
+					autoTuneType tune;
+					servoPlantType plant;
+					servoPlantInit(&plant, 90, lag, deadTime, deadband, backlash, STEP_MS);
+					runExperiment(&tune, &plant, AUTOTUNE_BACKLASH_SWEEP, 90, 12, 0, 10, 170);
+
+					CHECK_EQ(tune.phase, AUTOTUNE_DONE);
+					CHECK(tune.backlash >= backlash - 1 && tune.backlash <= backlash + deadband + 1);
+					CHECK(tune.deadband >= deadband - 2 && tune.deadband <= deadband + 1);
+				}
+			}
+		}
+	}
+}
+
+// more slack gives a larger estimate
+void testSweepOrdering() {
+	float last = -1;
+	for (float backlash = 0; backlash <= 8; backlash += 2) {
+		autoTuneType tune;
+		servoPlantType plant;
+		servoPlantInit(&plant, 90, 150, 40, 1, backlash, STEP_MS);
+		runExperiment(&tune, &plant, AUTOTUNE_BACKLASH_SWEEP, 90, 14, 0, 10, 170);
+		CHECK_EQ(tune.phase, AUTOTUNE_DONE);
+		CHECK(tune.backlash > last);
+		last = tune.backlash;
+	}
+}
+
+// the sweep stays in min/max, up to two ramps above the center
+void testSweepCenterInRange() {
+	autoTuneType tune;
+	servoPlantType plant;
+	servoPlantInit(&plant, 160, 150, 60, 1, 2, STEP_MS);
+	runExperiment(&tune, &plant, AUTOTUNE_BACKLASH_SWEEP, 160, 8, 0, 10, 170);
+	CHECK_NEAR(tune.centerPosition, 154, 0.01);
+	CHECK_EQ(tune.phase, AUTOTUNE_DONE);
+}
+
+// slack larger than the ramp never moves the joint
+void testSweepNoMotion() {
+	autoTuneType tune;
+	servoPlantType plant;
+	servoPlantInit(&plant, 90, 150, 60, 1, 12, STEP_MS);
+	runExperiment(&tune, &plant, AUTOTUNE_BACKLASH_SWEEP, 90, 8, 0, 10, 170);
+	CHECK_EQ(tune.phase, AUTOTUNE_FAILED);
+	CHECK_EQ(tune.failReason, AUTOTUNE_NO_MOTION);
+}
+
+int main() {
+	testRelayNominal();
+	testRelayFollowsPlant();
+	testRelayOrdering();
+	testRelayCenterInRange();
+	testRelayNoMotion();
+	testRelayOutOfRange();
+	testSweepNominal();
+	testSweepFollowsPlant();
+	testSweepOrdering();
+	testSweepCenterInRange();
+	testSweepNoMotion();
+	return CHECK_DONE("testAutoTune");
+}
@@ -0,0 +1,85 @@
+// host test of the calibration tables (calibration.cpp)
+
+#include "calibration.h"
+#include "check.h"
+
+int checkFailures = 0;
+
+void testInterpolation() {
+	calibrationTableType table;
+	calibrationClear(&table);
+	CHECK(calibrationAddPoint(&table, 0, 10));
+	CHECK(calibrationAddPoint(&table, 90, 100));
+	CHECK(calibrationAddPoint(&table, 180, 150));
+	CHECK(calibrationActive(&table));
+
+	CHECK_NEAR(calibrationApply(&table, 0), 10, 1e-4);
+	CHECK_NEAR(calibrationApply(&table, 45), 55, 1e-4);
+	CHECK_NEAR(calibrationApply(&table, 90), 100, 1e-4);
+	CHECK_NEAR(calibrationApply(&table, 135), 125, 1e-4);
+	CHECK_NEAR(calibrationApply(&table, 180), 150, 1e-4);
+	CHECK_NEAR(calibrationApply(&table, 22.5), 32.5, 1e-4);
+}
+
+// beyond the first and the last point the end segments are extended
+void testExtrapolation() {
+	calibrationTableType table;
+	calibrationClear(&table);
+	calibrationAddPoint(&table, 20, 544);
+	calibrationAddPoint(&table, 90, 1500);
+	calibrationAddPoint(&table, 160, 2300);
+
+	CHECK_NEAR(calibrationApply(&table, 0), 544 - 20 * 956 / 70.0, 1e-2);
+	CHECK_NEAR(calibrationApply(&table, 10), 544 - 10 * 956 / 70.0, 1e-2);
+	CHECK_NEAR(calibrationApply(&table, 170), 2300 + 10 * 800 / 70.0, 1e-2);
+	CHECK_NEAR(calibrationApply(&table, 180), 2300 + 20 * 800 / 70.0, 1e-2);
+}
+
+// points are kept sorted whatever the upload order, an existing x gets the new value
+void testReplacePoint() {
+	calibrationTableType table;
+	calibrationClear(&table);
+	calibrationAddPoint(&table, 180, 170);
+	calibrationAddPoint(&table, 0, 5);
+	calibrationAddPoint(&table, 90, 95);
+	CHECK_EQ(table.numPoints, 3);
+	CHECK_EQ(table.x[0], 0);
+	CHECK_EQ(table.x[1], 90);
+	CHECK_EQ(table.x[2], 180);
+
+	CHECK(calibrationAddPoint(&table, 90, 80));
+	CHECK_EQ(table.numPoints, 3);
+	CHECK_EQ(table.y[1], 80);
+	CHECK_NEAR(calibrationApply(&table, 90), 80, 1e-4);
+	CHECK_NEAR(calibrationApply(&table, 45), 42.5, 1e-4);
+}
+
+// a full table rejects new x values but still replaces existing ones, less than 2 points are not used
+void testLimits() {
+	calibrationTableType table;
+	calibrationClear(&table);
+	CHECK(!calibrationActive(&table));
+	calibrationAddPoint(&table, 90, 90);
+	CHECK(!calibrationActive(&table));
+
+	calibrationClear(&table);
+	for (int p = 0; p < CALIBRATION_POINTS; p++) {
+		CHECK(calibrationAddPoint(&table, p * 20, p * 20));
+	}
+	CHECK(!calibrationAddPoint(&table, 5, 5));
+	CHECK(calibrationAddPoint(&table, 40, 50));
+	CHECK_EQ(table.numPoints, CALIBRATION_POINTS);
+	CHECK_NEAR(calibrationApply(&table, 30), 35, 1e-4);
+
+	calibrationClear(&table);
+	CHECK_EQ(table.numPoints, 0);
+	CHECK(!calibrationActive(&table));
+}
+
+int main() {
+	testInterpolation();
+	testExtrapolation();
+	testReplacePoint();
+	testLimits();
+	return CHECK_DONE("testCalibration");
+}
@@ -0,0 +1,282 @@
+// host test of the power group current budget (currentBudget.cpp)
+// the servos of the groups are replaced by a simulated current model, moves are started like
+// startQueuedMoves of the sketch does it in the 20 ms servo pass
+
+#include "currentBudget.h"
+#include "check.h"
+
+int checkFailures = 0;
+
+const int MAX_SIM_SERVOS = 8;
+const int SIM_GROUPS = 2;
+const int SIM_STEP_MS = 20;
+
+typedef struct {
+	servoCurrentType current;
+	bool moving;
+	unsigned long startMillis;
+	int moveMs;
+	unsigned long requestMillis;	// 0 for no request
+	long startedMillis;				// -1 until started
+} simServoType;
+
+typedef struct {
+	simServoType servo[MAX_SIM_SERVOS];
+	queuedStartType request[MAX_SIM_SERVOS];
+	groupAdmissionType group[SIM_GROUPS];
+	int budgetMa[SIM_GROUPS];
+	int numServos;
+	int startOrder[MAX_SIM_SERVOS];
+	int numStarted;
+	int peakGroupMa[SIM_GROUPS];
+} simType;
+
+void simAddServo(simType *sim, int groupIndex, int startMa, int runMa, int startPhaseMs, int moveMs) {
+	simServoType *servo = &sim->servo[sim->numServos];
+	servo->current.startCurrentMa = startMa;
+	servo->current.runCurrentMa = runMa;
+	servo->current.startPhaseMs = startPhaseMs;
+	servo->moving = false;
+	servo->moveMs = moveMs;
+	servo->requestMillis = 0;
+	servo->startedMillis = -1;
+	sim->request[sim->numServos].queued = false;
+	sim->request[sim->numServos].groupIndex = groupIndex;
+	sim->request[sim->numServos].startCurrentMa = startMa;
+	sim->numServos++;
+}
+
+int simGroupCurrentMa(simType *sim, int groupIndex, unsigned long ms) {
+	int groupMa = 0;
+	for (int s = 0; s < sim->numServos; s++) {
+		if (sim->request[s].groupIndex == groupIndex) {
+			groupMa += estimatedServoCurrentMa(&sim->servo[s].current, sim->servo[s].moving, ms - sim->servo[s].startMillis);
+		}
+	}
+	return groupMa;
+}
+
+void simCollect(simType *sim, unsigned long ms) {
+	for (int g = 0; g < SIM_GROUPS; g++) {
+		sim->group[g].currentMa = simGroupCurrentMa(sim, g, ms);
+		sim->group[g].budgetMa = sim->budgetMa[g];
+		sim->group[g].blocked = false;
+	}
+}
+
+// the queued counts are taken from the requests at the start of the servo pass
+void simCountQueued(simType *sim) {
+	for (int g = 0; g < SIM_GROUPS; g++) {
+		sim->group[g].queued = 0;
+	}
+	for (int s = 0; s < sim->numServos; s++) {
+		if (sim->request[s].queued && sim->request[s].groupIndex != -1) {
+			sim->group[sim->request[s].groupIndex].queued++;
+		}
+	}
+}
+
+void simStart(simType *sim, int s, unsigned long ms) {
+	sim->servo[s].moving = true;
+	sim->servo[s].startMillis = ms;
+	sim->servo[s].startedMillis = ms;
+	sim->startOrder[sim->numStarted++] = s;
+}
+
+// move request of the host, started at once or queued like requestServoMove does it
+void simRequest(simType *sim, int s, unsigned long ms) {
+	simCollect(sim, ms);
+	sim->servo[s].requestMillis = ms;
+	if (isMoveStartQueued(&sim->request[s], sim->group)) {
+		if (!sim->request[s].queued) {
+			sim->request[s].queuedMillis = ms;
+			if (sim->request[s].groupIndex != -1) {
+				sim->group[sim->request[s].groupIndex].queued++;
+			}
+		}
+		sim->request[s].queued = true;
+		return;
+	}
+	simStart(sim, s, ms);
+}
+
+// one servo pass: end finished moves, start queued moves, record the group current
+void simTick(simType *sim, unsigned long ms) {
+	for (int s = 0; s < sim->numServos; s++) {
+		if (sim->servo[s].moving && ms - sim->servo[s].startMillis >= (unsigned long) sim->servo[s].moveMs) {
+			sim->servo[s].moving = false;
+		}
+	}
+	simCountQueued(sim);
+	simCollect(sim, ms);
+	int s;
+	while ((s = nextQueuedStart(sim->request, sim->numServos, sim->group)) != -1) {
+		admitQueuedStart(&sim->request[s], sim->group);
+		simStart(sim, s, ms);
+	}
+	for (int g = 0; g < SIM_GROUPS; g++) {
+		int groupMa = simGroupCurrentMa(sim, g, ms);
+		if (groupMa > sim->peakGroupMa[g]) {
+			sim->peakGroupMa[g] = groupMa;
+		}
+	}
+}
+
+void simRun(simType *sim, unsigned long fromMs, unsigned long toMs) {
+	for (unsigned long ms = fromMs; ms <= toMs; ms += SIM_STEP_MS) {
+		simTick(sim, ms);
+	}
+}
+
+void simInit(simType *sim, int budget0, int budget1) {
+	sim->numServos = 0;
+	sim->numStarted = 0;
+	sim->budgetMa[0] = budget0;
+	sim->budgetMa[1] = budget1;
+	sim->peakGroupMa[0] = 0;
+	sim->peakGroupMa[1] = 0;
+	sim->group[0].queued = 0;
+	sim->group[1].queued = 0;
+}
+
+
+void testEstimatedCurrent() {
+	servoCurrentType current = {900, 250, 200};
+	CHECK_EQ(estimatedServoCurrentMa(&current, false, 0), 0);
+	CHECK_EQ(estimatedServoCurrentMa(&current, true, 0), 900);
+	CHECK_EQ(estimatedServoCurrentMa(&current, true, 199), 900);
+	CHECK_EQ(estimatedServoCurrentMa(&current, true, 200), 250);
+}
+
+void testAdmission() {
+	CHECK(isMoveStartAdmitted(5000, 900, 0));		// no limit
+	CHECK(isMoveStartAdmitted(0, 3000, 1000));		// idle group admits any single start
+	CHECK(isMoveStartAdmitted(100, 900, 1000));
+	CHECK(!isMoveStartAdmitted(101, 900, 1000));
+}
+
+// a whole arm requested at once: the group current stays within the budget and the servos
+// start in order of the requests
+void testBurstStaysInBudget() {
+	simType sim;
+	simInit(&sim, 1500, 0);
+	for (int s = 0; s < 6; s++) {
+		simAddServo(&sim, 0, 700, 200, 200, 1000);
+	}
+	const int requestOrder[6] = {3, 0, 5, 1, 4, 2};
+	for (int i = 0; i < 6; i++) {
+		simRequest(&sim, requestOrder[i], 20 + i);
+	}
+	simRun(&sim, 40, 4000);
+
+	CHECK_EQ(sim.numStarted, 6);
+	for (int i = 0; i < 6; i++) {
+		CHECK_EQ(sim.startOrder[i], requestOrder[i]);
+	}
+	CHECK(sim.peakGroupMa[0] <= 1500);
+	CHECK(sim.peakGroupMa[0] >= 1100);		// the budget is used, not just one servo at a time
+
+	// 2 start at once, then one per start phase while the run currents add up,
+	// the last one has to wait for the end of the first moves
+	CHECK_EQ(sim.servo[3].startedMillis, 20);
+	CHECK_EQ(sim.servo[0].startedMillis, 21);
+	CHECK_EQ(sim.servo[5].startedMillis, 240);
+	CHECK_EQ(sim.servo[1].startedMillis, 440);
+	CHECK_EQ(sim.servo[4].startedMillis, 640);
+	CHECK_EQ(sim.servo[2].startedMillis, 1020);
+}
+
+// without a budget all moves start at once
+void testNoBudget() {
+	simType sim;
+	simInit(&sim, 0, 0);
+	for (int s = 0; s < 5; s++) {
+		simAddServo(&sim, 0, 900, 300, 200, 500);
+		simRequest(&sim, s, 100);
+	}
+	CHECK_EQ(sim.numStarted, 5);
+	simRun(&sim, 120, 200);
+	CHECK_EQ(sim.peakGroupMa[0], 4500);
+}
+
+// a waiting request of a group blocks younger requests of the same group even when they would fit,
+// requests of other groups and servos without power group are not affected
+void testOrderAndGroups() {
+	simType sim;
+	simInit(&sim, 1000, 1000);
+	simAddServo(&sim, 0, 600, 200, 200, 2000);		// 0 running
+	simAddServo(&sim, 0, 800, 200, 200, 500);		// 1 does not fit beside 0
+	simAddServo(&sim, 0, 100, 50, 200, 500);		// 2 would fit but must not overtake 1
+	simAddServo(&sim, 1, 800, 200, 200, 500);		// 3 other group
+	simAddServo(&sim, -1, 2000, 500, 200, 500);		// 4 no power group
+
+	simRequest(&sim, 0, 0);
+	simRequest(&sim, 1, 10);
+	simRequest(&sim, 2, 20);
+	simRequest(&sim, 3, 30);
+	simRequest(&sim, 4, 40);
+	CHECK(sim.request[1].queued);
+	CHECK(sim.request[2].queued);
+	CHECK(!sim.request[3].queued);
+	CHECK(!sim.request[4].queued);
+	CHECK_EQ(sim.group[0].queued, 2);
+	CHECK_EQ(sim.group[1].queued, 0);
+
+	simRun(&sim, 60, 180);
+	CHECK(sim.request[1].queued);
+	CHECK(sim.request[2].queued);
+
+	// start phase of 0 over: 200 + 800 fits, 2 waits for the start phase of 1
+	simRun(&sim, 200, 400);
+	CHECK_EQ(sim.servo[1].startedMillis, 200);
+	CHECK_EQ(sim.servo[2].startedMillis, 400);
+	CHECK(sim.peakGroupMa[0] <= 1000);
+	CHECK(sim.peakGroupMa[1] <= 1000);
+	CHECK_EQ(sim.group[0].queued, 0);
+}
+
+// a queued request dropped by a stop leaves the queued count of its group with the next servo pass
+void testStoppedRequest() {
+	simType sim;
+	simInit(&sim, 1000, 0);
+	simAddServo(&sim, 0, 900, 200, 200, 1000);
+	simAddServo(&sim, 0, 900, 200, 200, 1000);
+	simAddServo(&sim, 0, 100, 50, 200, 500);
+	simRequest(&sim, 0, 0);
+	simRequest(&sim, 1, 0);
+	CHECK(sim.request[1].queued);
+	CHECK_EQ(sim.group[0].queued, 1);
+
+	sim.request[1].queued = false;		// stop of servo 1
+	simRun(&sim, 20, 20);
+	CHECK_EQ(sim.group[0].queued, 0);
+	simRequest(&sim, 2, 30);			// 900 + 100 fits
+	CHECK(!sim.request[2].queued);
+	CHECK_EQ(sim.servo[2].startedMillis, 30);
+}
+
+// a single start current above the budget is admitted in an idle group only
+void testOversizedServo() {
+	simType sim;
+	simInit(&sim, 500, 0);
+	simAddServo(&sim, 0, 300, 100, 100, 300);
+	simAddServo(&sim, 0, 1200, 400, 100, 300);
+	simRequest(&sim, 0, 0);
+	simRequest(&sim, 1, 0);
+	CHECK(sim.request[1].queued);
+	simRun(&sim, 20, 280);
+	CHECK(sim.request[1].queued);
+	simRun(&sim, 300, 320);
+	CHECK_EQ(sim.servo[1].startedMillis, 300);
+}
+
+int main() {
+	testEstimatedCurrent();
+	testAdmission();
+	testBurstStaysInBudget();
+	testNoBudget();
+	testOrderAndGroups();
+	testOversizedServo();
+	testStoppedRequest();
+	return CHECK_DONE("testCurrentBudget");
+}
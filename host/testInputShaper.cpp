@@ -0,0 +1,120 @@
+// host test of the input shaper (inputShaper.cpp): impulse amplitudes and times and the residual
+// vibration of a damped oscillation after the shaped step
+
+#include <math.h>
+#include "inputShaper.h"
+#include "check.h"
+
+int checkFailures = 0;
+
+// residual vibration amplitude after the impulses relative to an unshaped step, oscillation of
+// frequencyHz and damping (the shaper may be designed for other values)
+double residualVibration(const inputShaperType *shaper, double frequencyHz, double damping) {
+	double w = 2 * M_PI * frequencyHz / 1000;		// per ms
+	double wd = w * sqrt(1 - damping * damping);
+	double lastMs = shaper->impulseMs[shaper->numImpulses - 1];
+	double c = 0, s = 0;
+	for (int i = 0; i < shaper->numImpulses; i++) {
+		double decay = exp(-damping * w * (lastMs - shaper->impulseMs[i]));
+		c += shaper->amplitude[i] * decay * cos(wd * shaper->impulseMs[i]);
+		s += shaper->amplitude[i] * decay * sin(wd * shaper->impulseMs[i]);
+	}
+	return sqrt(c * c + s * s);
+}
+
+double amplitudeSum(const inputShaperType *shaper) {
+	double sum = 0;
+	for (int i = 0; i < shaper->numImpulses; i++) {
+		sum += shaper->amplitude[i];
+	}
+	return sum;
+}
+
+void testNone() {
+	inputShaperType shaper;
+	CHECK(inputShaperSetup(&shaper, SHAPER_NONE, 0, 0));
+	CHECK_EQ(shaper.numImpulses, 1);
+	CHECK_EQ(shaper.impulseMs[0], 0);
+	CHECK_NEAR(shaper.amplitude[0], 1, 1e-6);
+	CHECK_EQ(inputShaperDelayMs(&shaper), 0);
+}
+
+// undamped 2 Hz: half period 250 ms, two equal impulses
+void testZvUndamped() {
+	inputShaperType shaper;
+	CHECK(inputShaperSetup(&shaper, SHAPER_ZV, 2, 0));
+	CHECK_EQ(shaper.type, SHAPER_ZV);
+	CHECK_EQ(shaper.numImpulses, 2);
+	CHECK_EQ(shaper.impulseMs[0], 0);
+	CHECK_EQ(shaper.impulseMs[1], 250);
+	CHECK_NEAR(shaper.amplitude[0], 0.5, 1e-6);
+	CHECK_NEAR(shaper.amplitude[1], 0.5, 1e-6);
+	CHECK_EQ(inputShaperDelayMs(&shaper), 250);
+}
+
+// the impulses follow each other by the damped half period, the amplitudes sum to 1 and the
+// oscillation of the design frequency is cancelled, up to about 1 % from the impulse times in ms at 8 Hz
+void testImpulseTimes() {
+	const float frequencies[] = {0.5, 1.5, 3, 8};
+	const float dampings[] = {0, 0.05, 0.2, 0.5};
+	for (int f = 0; f < 4; f++) {
+		for (int d = 0; d < 4; d++) {
+			double halfPeriodMs = 500 / (frequencies[f] * sqrt(1 - dampings[d] * dampings[d]));
+			for (int type = SHAPER_ZV; type <= SHAPER_ZVD; type++) {
+				inputShaperType shaper;
+				CHECK(inputShaperSetup(&shaper, type, frequencies[f], dampings[d]));
+				CHECK_EQ(shaper.numImpulses, type == SHAPER_ZV ? 2 : 3);
+				for (int i = 0; i < shaper.numImpulses; i++) {
+					CHECK_NEAR(shaper.impulseMs[i], i * halfPeriodMs, 0.5);
+				}
+				CHECK_NEAR(amplitudeSum(&shaper), 1, 1e-5);
+				CHECK(residualVibration(&shaper, frequencies[f], dampings[d]) < 0.02);
+			}
+		}
+	}
+}
+
+// ZVD: amplitudes 1:2k:k^2 with k the decay of a half period
+void testZvdAmplitudes() {
+	inputShaperType shaper;
+	CHECK(inputShaperSetup(&shaper, SHAPER_ZVD, 2, 0.1));
+	double k = exp(-0.1 * M_PI / sqrt(1 - 0.01));
+	CHECK_NEAR(shaper.amplitude[1] / shaper.amplitude[0], 2 * k, 1e-5);
+	CHECK_NEAR(shaper.amplitude[2] / shaper.amplitude[0], k * k, 1e-5);
+	CHECK(shaper.amplitude[0] > shaper.amplitude[2]);
+}
+
+// with the frequency 20 % off ZVD leaves less ringing than ZV, both less than the unshaped step
+void testRobustness() {
+	inputShaperType zv, zvd;
+	CHECK(inputShaperSetup(&zv, SHAPER_ZV, 2, 0.05));
+	CHECK(inputShaperSetup(&zvd, SHAPER_ZVD, 2, 0.05));
+	double zvResidual = residualVibration(&zv, 2.4, 0.05);
+	double zvdResidual = residualVibration(&zvd, 2.4, 0.05);
+	CHECK(zvdResidual < zvResidual);
+	CHECK(zvResidual < 0.5);
+	CHECK(zvdResidual < 0.1);
+}
+
+// invalid parameters switch the shaper off
+void testInvalid() {
+	inputShaperType shaper;
+	CHECK(!inputShaperSetup(&shaper, SHAPER_ZV, 0, 0.1));
+	CHECK_EQ(shaper.type, SHAPER_NONE);
+	CHECK_EQ(shaper.numImpulses, 1);
+	CHECK_EQ(inputShaperDelayMs(&shaper), 0);
+	CHECK(!inputShaperSetup(&shaper, SHAPER_ZVD, 2, 1));
+	CHECK(!inputShaperSetup(&shaper, SHAPER_ZV, 2, -0.1));
+	CHECK(!inputShaperSetup(&shaper, 3, 2, 0.1));
+	CHECK_EQ(shaper.type, SHAPER_NONE);
+}
+
+int main() {
+	testNone();
+	testZvUndamped();
+	testImpulseTimes();
+	testZvdAmplitudes();
+	testRobustness();
+	testInvalid();
+	return CHECK_DONE("testInputShaper");
+}
@@ -0,0 +1,375 @@
+// host test of the motion program interpreter (motionProgram.cpp) and its assembler (motionProgramAsm.cpp)
+// the servos are replaced by a table of pins, move requests are recorded, the program task is
+// run like motionProgramTask of the sketch does it every 20 ms
+
+#include <string.h>
+#include "motionProgram.h"
+#include "motionProgramAsm.h"
+#include "check.h"
+
+int checkFailures = 0;
+
+const int SIM_SERVOS = 3;
+const int simPins[SIM_SERVOS] = {5, 7, 9};
+int simPositions[SIM_SERVOS];
+int simMoving[SIM_SERVOS];
+
+const int MAX_SIM_MOVES = 16;
+typedef struct {
+	int pin;
+	int position;
+	int durationMs;
+} simMoveType;
+simMoveType simMoves[MAX_SIM_MOVES];
+int numSimMoves;
+long lastRandomMax;
+
+int simServoIndex(int pin) {
+	for (int s = 0; s < SIM_SERVOS; s++) {
+		if (simPins[s] == pin) {
+			return s;
+		}
+	}
+	return -1;
+}
+
+bool simMoveServo(int pin, int position, int durationMs) {
+	int s = simServoIndex(pin);
+	if (s == -1) {
+		return false;
+	}
+	if (numSimMoves < MAX_SIM_MOVES) {
+		simMoves[numSimMoves++] = {pin, position, durationMs};
+	}
+	simPositions[s] = position;
+	simMoving[s] = 1;
+	return true;
+}
+
+int simServoPosition(int pin) {
+	int s = simServoIndex(pin);
+	return s == -1 ? -1 : simPositions[s];
+}
+
+int simServoMoving(int pin) {
+	int s = simServoIndex(pin);
+	return s == -1 ? -1 : simMoving[s];
+}
+
+long simRandom(long max) {
+	lastRandomMax = max;
+	return max - 1;
+}
+
+const motionProgramHostType simHost = {simMoveServo, simServoPosition, simServoMoving, simRandom};
+
+void simReset() {
+	for (int s = 0; s < SIM_SERVOS; s++) {
+		simPositions[s] = 90;
+		simMoving[s] = 0;
+	}
+	numSimMoves = 0;
+	lastRandomMax = 0;
+}
+
+// assemble and start, fails the test on an assembler error
+void startSource(motionProgramType *prog, const char *source) {
+	unsigned char code[MOTION_PROGRAM_SIZE];
+	char error[120];
+	int length = assembleMotionProgram(source, code, MOTION_PROGRAM_SIZE, error, sizeof(error));
+	CHECK(length >= 0);
+	if (length < 0) {
+		printf("%s\n", error);
+		length = 0;
+	}
+	simReset();
+	motionProgramClear(prog);
+	CHECK(motionProgramLoad(prog, code, length));
+	motionProgramStart(prog);
+}
+
+void startBytes(motionProgramType *prog, const unsigned char *code, int length) {
+	simReset();
+	motionProgramClear(prog);
+	CHECK(motionProgramLoad(prog, code, length));
+	motionProgramStart(prog);
+}
+
+bool assembles(const char *source, const char *hex) {
+	unsigned char code[MOTION_PROGRAM_SIZE];
+	unsigned char expected[MOTION_PROGRAM_SIZE];
+	char error[120];
+	int length = assembleMotionProgram(source, code, MOTION_PROGRAM_SIZE, error, sizeof(error));
+	int expectedLength = motionProgramParseHex(hex, expected, MOTION_PROGRAM_SIZE);
+	return length == expectedLength && memcmp(code, expected, length) == 0;
+}
+
+bool rejects(const char *source, const char *reason) {
+	unsigned char code[MOTION_PROGRAM_SIZE];
+	char error[120];
+	return assembleMotionProgram(source, code, MOTION_PROGRAM_SIZE, error, sizeof(error)) == -1
+		&& strstr(error, reason) != NULL;
+}
+
+
+// every opcode with its operand layout, the example of the z command in the sketch header
+void testAssembler() {
+	CHECK(assembles("END", "00"));
+	CHECK(assembles("MOVE 7, 70, 400", "0107469001"));
+	CHECK(assembles("MOVER 7, r2, 0x1234", "0207023412"));
+	CHECK(assembles("WAIT 1000", "03E803"));
+	CHECK(assembles("WAITR r7", "0407"));
+	CHECK(assembles("ARRIVE 9", "0509"));
+	CHECK(assembles("SET r1, -2", "0601FEFF"));
+	CHECK(assembles("ADD r3, 300", "07032C01"));
+	CHECK(assembles("RAND r0, 40", "08002800"));
+	CHECK(assembles("POS r4, 5", "090405"));
+	CHECK(assembles("JMP 6", "0A0600"));
+	CHECK(assembles("DJNZ r0, 4", "0B000400"));
+	CHECK(assembles("JLT r2, -10, 0", "0C02F6FF0000"));
+	CHECK(assembles("JGT r2, 100, 0x20", "0D0264002000"));
+
+	CHECK(assembles(
+		"; wave pin 7 three times\n"
+		"        SET r0, 3\n"
+		"wave:   MOVE 7, 70, 400\n"
+		"        ARRIVE 7\n"
+		"        move 7 110 400\t; case and separators do not matter\n"
+		"        ARRIVE 7\n"
+		"        DJNZ r0, wave\n"
+		"        END\n",
+		"060003000107469001050701076E900105070B00040000"));
+
+	// labels before their use and alone on a line
+	CHECK(assembles("JMP done\nloop:\nJMP loop\ndone: END", "0A06000A030000"));
+}
+
+void testAssemblerErrors() {
+	CHECK(rejects("JUMP 0", "line 1: unknown instruction: JUMP"));
+	CHECK(rejects("END\nSET r8, 1", "line 2: register r0..r7 expected: r8"));
+	CHECK(rejects("SET 1, 1", "register r0..r7 expected: 1"));
+	CHECK(rejects("MOVE 7, 70", "number of operands, expected: 3"));
+	CHECK(rejects("MOVE 7, 181, 400", "value out of range: 181"));
+	CHECK(rejects("WAIT 70000", "value out of range: 70000"));
+	CHECK(rejects("SET r0, 40000", "value out of range: 40000"));
+	CHECK(rejects("JMP nowhere", "unknown label: nowhere"));
+	CHECK(rejects("a: END\na: END", "line 2: label defined twice: a"));
+	CHECK(rejects("WAIT 1x", "number expected: 1x"));
+
+	char tooLong[MOTION_PROGRAM_SIZE * 8];
+	tooLong[0] = '\0';
+	for (int i = 0; i < MOTION_PROGRAM_SIZE / 5 + 1; i++) {
+		strcat(tooLong, "MOVE 5 1 1\n");
+	}
+	CHECK(rejects(tooLong, "program too long"));
+}
+
+void testParseHex() {
+	unsigned char bytes[4];
+	CHECK_EQ(motionProgramParseHex("", bytes, 4), 0);
+	CHECK_EQ(motionProgramParseHex("0aFf", bytes, 4), 2);
+	CHECK_EQ(bytes[0], 0x0A);
+	CHECK_EQ(bytes[1], 0xFF);
+	CHECK_EQ(motionProgramParseHex("0a1", bytes, 4), -1);		// odd length
+	CHECK_EQ(motionProgramParseHex("0g", bytes, 4), -1);		// not a hex digit
+	CHECK_EQ(motionProgramParseHex("0a 1", bytes, 4), -1);
+	CHECK_EQ(motionProgramParseHex("0102030405", bytes, 4), -1);	// more than maxBytes
+}
+
+void testLoad() {
+	motionProgramType prog;
+	unsigned char code[MOTION_PROGRAM_SIZE] = {0};
+	motionProgramClear(&prog);
+	CHECK(motionProgramLoad(&prog, code, 200));
+	CHECK(motionProgramLoad(&prog, code, 56));
+	CHECK(!motionProgramLoad(&prog, code, 1));
+	CHECK_EQ(prog.length, MOTION_PROGRAM_SIZE);
+}
+
+void testMoves() {
+	motionProgramType prog;
+	startSource(&prog, "SET r2, 120\nMOVE 5, 70, 400\nMOVER 7, r2, 300\nEND");
+	CHECK_EQ(motionProgramRun(&prog, &simHost, 0), PROGRAM_ENDED);
+	CHECK_EQ(numSimMoves, 2);
+	CHECK_EQ(simMoves[0].pin, 5);
+	CHECK_EQ(simMoves[0].position, 70);
+	CHECK_EQ(simMoves[0].durationMs, 400);
+	CHECK_EQ(simMoves[1].pin, 7);
+	CHECK_EQ(simMoves[1].position, 120);
+	CHECK_EQ(simMoves[1].durationMs, 300);
+	CHECK_EQ(prog.instructions, 4);
+}
+
+void testWaits() {
+	motionProgramType prog;
+	startSource(&prog, "WAIT 100\nSET r1, 60\nWAITR r1\nSET r1, -5\nWAITR r1\nEND");
+	CHECK_EQ(motionProgramRun(&prog, &simHost, 1000), PROGRAM_WAITING);
+	CHECK_EQ(motionProgramRun(&prog, &simHost, 1099), PROGRAM_WAITING);
+	CHECK_EQ(motionProgramRun(&prog, &simHost, 1100), PROGRAM_WAITING);	// WAITR 60
+	CHECK_EQ(prog.wakeMs, 1160);
+	CHECK_EQ(motionProgramRun(&prog, &simHost, 1159), PROGRAM_WAITING);
+	CHECK_EQ(motionProgramRun(&prog, &simHost, 1160), PROGRAM_WAITING);	// negative wait is 0
+	CHECK_EQ(prog.wakeMs, 1160);
+	CHECK_EQ(motionProgramRun(&prog, &simHost, 1160), PROGRAM_ENDED);
+}
+
+void testArrive() {
+	motionProgramType prog;
+	startSource(&prog, "MOVE 9, 30, 500\nARRIVE 9\nSET r0, 1\nEND");
+	CHECK_EQ(motionProgramRun(&prog, &simHost, 0), PROGRAM_ARRIVING);
+	CHECK_EQ(motionProgramRun(&prog, &simHost, 20), PROGRAM_ARRIVING);
+	simMoving[simServoIndex(9)] = 0;
+	CHECK_EQ(motionProgramRun(&prog, &simHost, 40), PROGRAM_ENDED);
+	CHECK_EQ(prog.reg[0], 1);
+}
+
+void testRegisters() {
+	motionProgramType prog;
+	startSource(&prog, "SET r0, -300\nADD r0, 1000\nADD r0, -1\nSET r7, 32767\nRAND r3, 40\nRAND r4, 0\nPOS r5, 7\nEND");
+	simPositions[simServoIndex(7)] = 133;
+	CHECK_EQ(motionProgramRun(&prog, &simHost, 0), PROGRAM_ENDED);
+	CHECK_EQ(prog.reg[0], 699);
+	CHECK_EQ(prog.reg[7], 32767);
+	CHECK_EQ(prog.reg[3], 39);
+	CHECK_EQ(lastRandomMax, 40);
+	CHECK_EQ(prog.reg[4], 0);		// RAND with max 0 does not ask the host
+	CHECK_EQ(prog.reg[5], 133);
+}
+
+void testJumps() {
+	motionProgramType prog;
+
+	// DJNZ loop: 5 moves
+	startSource(&prog, "SET r0, 5\nloop: MOVE 5, 80, 100\nDJNZ r0, loop\nEND");
+	CHECK_EQ(motionProgramRun(&prog, &simHost, 0), PROGRAM_ENDED);
+	CHECK_EQ(numSimMoves, 5);
+	CHECK_EQ(prog.reg[0], 0);
+
+	// JLT / JGT take the branch only on a strict comparison, JMP skips
+	startSource(&prog,
+		"SET r1, 10\n"
+		"JLT r1, 10, bad\n"
+		"JGT r1, 10, bad\n"
+		"JLT r1, 11, lt\n"
+		"JMP bad\n"
+		"lt: JGT r1, -1, gt\n"
+		"JMP bad\n"
+		"gt: SET r2, 1\n"
+		"JMP done\n"
+		"bad: SET r2, 2\n"
+		"done: END\n");
+	CHECK_EQ(motionProgramRun(&prog, &simHost, 0), PROGRAM_ENDED);
+	CHECK_EQ(prog.reg[2], 1);
+}
+
+// each run executes at most MOTION_PROGRAM_BUDGET instructions
+void testBudget() {
+	motionProgramType prog;
+	startSource(&prog, "loop: ADD r0, 1\nJMP loop");
+	CHECK_EQ(motionProgramRun(&prog, &simHost, 0), PROGRAM_RUNNING);
+	CHECK_EQ(prog.instructions, MOTION_PROGRAM_BUDGET);
+	CHECK_EQ(motionProgramRun(&prog, &simHost, 20), PROGRAM_RUNNING);
+	CHECK_EQ(prog.reg[0], MOTION_PROGRAM_BUDGET);
+}
+
+// running off the end is an implicit END, a stopped program does not run
+void testEndAndStop() {
+	motionProgramType prog;
+	startSource(&prog, "SET r0, 1");
+	CHECK_EQ(motionProgramRun(&prog, &simHost, 0), PROGRAM_ENDED);
+
+	startSource(&prog, "MOVE 5, 10, 100\nEND");
+	motionProgramStop(&prog);
+	CHECK_EQ(motionProgramRun(&prog, &simHost, 0), PROGRAM_IDLE);
+	CHECK_EQ(numSimMoves, 0);
+}
+
+void checkFailure(motionProgramType *prog, int error, int errorPc) {
+	CHECK_EQ(prog->state, PROGRAM_FAILED);
+	CHECK_EQ(prog->error, error);
+	CHECK_EQ(prog->errorPc, errorPc);
+}
+
+// an invalid program is stopped with the error and the pc of the instruction
+void testBadPrograms() {
+	motionProgramType prog;
+
+	const unsigned char badOpcode[] = {OP_SET, 0, 1, 0, 0x0E};
+	startBytes(&prog, badOpcode, sizeof(badOpcode));
+	motionProgramRun(&prog, &simHost, 0);
+	checkFailure(&prog, PROGRAM_BAD_OPCODE, 4);
+
+	const unsigned char badOperand[] = {OP_WAIT, 0x10, 0x00, OP_MOVE, 5, 70};	// MOVE cut off
+	startBytes(&prog, badOperand, sizeof(badOperand));
+	motionProgramRun(&prog, &simHost, 0);
+	motionProgramRun(&prog, &simHost, 100);
+	checkFailure(&prog, PROGRAM_BAD_OPERAND, 3);
+
+	const unsigned char badRegisters[][5] = {
+		{OP_SET, 8, 1, 0, OP_END}, {OP_ADD, 9, 1, 0, OP_END}, {OP_RAND, 8, 1, 0, OP_END},
+		{OP_POS, 8, 5, OP_END, OP_END}, {OP_WAITR, 8, OP_END, OP_END, OP_END}, {OP_MOVER, 5, 8, 0, 0},
+		{OP_DJNZ, 8, 0, 0, OP_END}
+	};
+	for (unsigned int i = 0; i < sizeof(badRegisters) / sizeof(badRegisters[0]); i++) {
+		startBytes(&prog, badRegisters[i], 5);
+		CHECK_EQ(motionProgramRun(&prog, &simHost, 0), PROGRAM_FAILED);
+		checkFailure(&prog, PROGRAM_BAD_REGISTER, 0);
+	}
+	const unsigned char badCompareRegister[] = {OP_JLT, 8, 0, 0, 0, 0, OP_JGT, 8, 0, 0, 0, 0};
+	startBytes(&prog, badCompareRegister, sizeof(badCompareRegister));
+	motionProgramRun(&prog, &simHost, 0);
+	checkFailure(&prog, PROGRAM_BAD_REGISTER, 0);
+
+	const unsigned char badJump[] = {OP_SET, 0, 1, 0, OP_JMP, 7, 0};	// target == length
+	startBytes(&prog, badJump, sizeof(badJump));
+	motionProgramRun(&prog, &simHost, 0);
+	checkFailure(&prog, PROGRAM_BAD_JUMP, 4);
+
+	const unsigned char badBranch[] = {OP_SET, 0, 2, 0, OP_DJNZ, 0, 0xFF, 0};
+	startBytes(&prog, badBranch, sizeof(badBranch));
+	motionProgramRun(&prog, &simHost, 0);
+	checkFailure(&prog, PROGRAM_BAD_JUMP, 4);
+
+	// a jump that is not taken is not checked
+	const unsigned char untakenBranch[] = {OP_JGT, 0, 0, 0, 0xFF, 0, OP_END};
+	startBytes(&prog, untakenBranch, sizeof(untakenBranch));
+	CHECK_EQ(motionProgramRun(&prog, &simHost, 0), PROGRAM_ENDED);
+
+	startSource(&prog, "MOVE 5, 10, 100\nMOVE 6, 10, 100");
+	motionProgramRun(&prog, &simHost, 0);
+	checkFailure(&prog, PROGRAM_BAD_SERVO, 5);
+
+	startSource(&prog, "SET r0, 1\nMOVER 6, r0, 100");
+	motionProgramRun(&prog, &simHost, 0);
+	checkFailure(&prog, PROGRAM_BAD_SERVO, 4);
+
+	startSource(&prog, "POS r0, 6");
+	motionProgramRun(&prog, &simHost, 0);
+	checkFailure(&prog, PROGRAM_BAD_SERVO, 0);
+
+	// the servo of ARRIVE is checked on the next run, the error points to the ARRIVE
+	startSource(&prog, "SET r0, 1\nARRIVE 6\nEND");
+	CHECK_EQ(motionProgramRun(&prog, &simHost, 0), PROGRAM_ARRIVING);
+	CHECK_EQ(motionProgramRun(&prog, &simHost, 20), PROGRAM_FAILED);
+	checkFailure(&prog, PROGRAM_BAD_SERVO, 4);
+
+	// a restart clears the error
+	motionProgramStart(&prog);
+	CHECK_EQ(prog.error, PROGRAM_OK);
+}
+
+int main() {
+	testAssembler();
+	testAssemblerErrors();
+	testParseHex();
+	testLoad();
+	testMoves();
+	testWaits();
+	testArrive();
+	testRegisters();
+	testJumps();
+	testBudget();
+	testEndAndStop();
+	testBadPrograms();
+	return CHECK_DONE("testMotionProgram");
+}
@@ -0,0 +1,121 @@
+// host test of the move metrics and the move record (moveRecord.cpp)
+
+#include <math.h>
+#include "moveRecord.h"
+#include "check.h"
+
+int checkFailures = 0;
+
+moveRecordType record;
+
+void testRmsError() {
+	moveMetricsType metrics;
+	moveMetricsStart(&metrics, 90, 120);
+	CHECK_NEAR(moveMetricsRmsError(&metrics), 0, 1e-6);
+
+	moveMetricsAdd(&metrics, 20, 90, 93, false);		// error 3
+	moveMetricsAdd(&metrics, 40, 95, 91, true);			// error -4
+	CHECK_EQ(metrics.ticks, 2);
+	CHECK_NEAR(moveMetricsRmsError(&metrics), sqrt(12.5), 1e-4);
+	CHECK_NEAR(metrics.maxError, 4, 1e-6);
+	CHECK_EQ(metrics.saturatedTicks, 1);
+	CHECK_EQ(metrics.durationMs, 40);
+}
+
+// overshoot counts in move direction only, a falling move overshoots below the target
+void testOvershoot() {
+	moveMetricsType metrics;
+	moveMetricsStart(&metrics, 90, 120);
+	moveMetricsAdd(&metrics, 20, 110, 110, false);
+	CHECK_NEAR(metrics.overshoot, 0, 1e-6);
+	moveMetricsAdd(&metrics, 40, 124, 120, false);
+	moveMetricsAdd(&metrics, 60, 121, 120, false);
+	CHECK_NEAR(metrics.overshoot, 4, 1e-6);
+
+	moveMetricsStart(&metrics, 120, 90);
+	moveMetricsAdd(&metrics, 20, 95, 95, false);
+	CHECK_NEAR(metrics.overshoot, 0, 1e-6);
+	moveMetricsAdd(&metrics, 40, 87, 90, false);
+	CHECK_NEAR(metrics.overshoot, 3, 1e-6);
+}
+
+// settled at the first update of the last stay within MOVE_SETTLE_BAND
+void testSettleReset() {
+	moveMetricsType metrics;
+	moveMetricsStart(&metrics, 90, 120);
+	CHECK_EQ(metrics.settleMs, -1);
+	moveMetricsAdd(&metrics, 20, 100, 110, false);
+	CHECK_EQ(metrics.settleMs, -1);
+	moveMetricsAdd(&metrics, 40, 120 - MOVE_SETTLE_BAND, 120, false);
+	CHECK_EQ(metrics.settleMs, 40);
+	moveMetricsAdd(&metrics, 60, 120 + MOVE_SETTLE_BAND, 120, false);
+	CHECK_EQ(metrics.settleMs, 40);
+	moveMetricsAdd(&metrics, 80, 120 + MOVE_SETTLE_BAND + 1, 120, false);
+	CHECK_EQ(metrics.settleMs, -1);
+	moveMetricsAdd(&metrics, 100, 119, 120, false);
+	moveMetricsAdd(&metrics, 120, 120, 120, false);
+	CHECK_EQ(metrics.settleMs, 100);
+}
+
+// the evaluation of the record gives the metrics of the same updates
+void testRecordEval() {
+	moveMetricsType live;
+	moveMetricsStart(&live, 50, 30);
+	moveRecordStart(&record, 50, 30);
+	const int positions[] = {50, 47, 41, 35, 31, 28, 29, 30};
+	for (int t = 0; t < 8; t++) {
+		float wanted = 50 - 20 * (t + 1) / 6.0;
+		if (wanted < 30) wanted = 30;
+		moveMetricsAdd(&live, 20 * t, positions[t], wanted, false);
+		moveRecordTick(&record, 20 * t, 100 + t, positions[t], wanted, positions[t] - 2);
+	}
+	CHECK_EQ(record.numTicks, 8);
+	CHECK_EQ(record.tick[3].magnetAngle, 103);
+	CHECK_EQ(record.tick[3].writePosition, 33);
+
+	moveMetricsType metrics;
+	evalMoveMetrics(&record, &metrics);
+	CHECK_EQ(metrics.ticks, live.ticks);
+	CHECK_NEAR(moveMetricsRmsError(&metrics), moveMetricsRmsError(&live), 1e-4);
+	CHECK_NEAR(metrics.maxError, live.maxError, 1e-4);
+	CHECK_NEAR(metrics.overshoot, 2, 1e-6);
+	CHECK_EQ(metrics.settleMs, 80);
+	CHECK_EQ(metrics.durationMs, 140);
+}
+
+// updates beyond MOVE_RECORD_TICKS are counted, a stopped record takes no more ticks or times
+void testDroppedTicks() {
+	moveRecordStart(&record, 10, 170);
+	for (int t = 0; t < MOVE_RECORD_TICKS + 5; t++) {
+		moveRecordTick(&record, 20 * t, 0, 10 + t / 2, 10 + t / 2, 10 + t / 2);
+	}
+	CHECK_EQ(record.numTicks, MOVE_RECORD_TICKS);
+	CHECK_EQ(record.droppedTicks, 5);
+	CHECK_EQ(record.tick[MOVE_RECORD_TICKS - 1].ms, 20 * (MOVE_RECORD_TICKS - 1));
+
+	record.recording = false;
+	moveRecordTick(&record, 0, 0, 0, 0, 0);
+	moveRecordUpdateTime(&record, 100);
+	CHECK_EQ(record.droppedTicks, 5);
+	CHECK_EQ(record.updates, 0);
+}
+
+void testUpdateTime() {
+	moveRecordStart(&record, 10, 20);
+	moveRecordUpdateTime(&record, 120);
+	moveRecordUpdateTime(&record, 300);
+	moveRecordUpdateTime(&record, 90);
+	CHECK_EQ(record.updates, 3);
+	CHECK_EQ(record.totalUpdateUs, 510);
+	CHECK_EQ(record.maxUpdateUs, 300);
+}
+
+int main() {
+	testRmsError();
+	testOvershoot();
+	testSettleReset();
+	testRecordEval();
+	testDroppedTicks();
+	testUpdateTime();
+	return CHECK_DONE("testMoveRecord");
+}
@@ -0,0 +1,163 @@
+// offline benchmark of the control loop of feedback servos: Mai3Servo::update against the simulated
+// joint of servoPlant, the AS5600 angle of the joint is served by the Wire stub
+// every move is recorded like with the r command, the metrics (evalMoveMetrics) and the cpu time per
+// update have to stay within the limits of the move, a change of the control code that makes a
+// move worse fails the test
+//
+// the loop is the 20 ms pass of the motion task: update reads the sensor and writes the next position,
+// the plant then runs one period with the written position
+// the firmware clock only advances by the update periods (stubCpuScale 0), the moves do not depend on
+// the speed of the host. The cpu time of update is measured apart and scaled like in replay.
+// after the arrival the joint is followed for SETTLE_WATCH_MS with the target as wanted position while
+// the hold corrects it, the overshoot and settle time include the joint coming to rest
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include "Arduino.h"
+#include "Wire.h"
+#include "Mai3Servo.h"
+#include "feedback.h"
+#include "servoPlant.h"
+#include "check.h"
+
+int checkFailures = 0;
+
+int arduinoId = 0;
+bool verbose = false;
+
+const int STEP_MS = 20;
+const int PIN = 8;
+const int CHANNEL = 2;
+const float DEG_PER_POS = 2;
+const int REF_ANGLE = 200;				// sensor angle at position 90
+const int SETTLE_WATCH_MS = 1500;
+// gains of a joint tuned for the nominal plant (ultimate gain 2.6, see testAutoTune), with the hold
+// after the arrival the joint comes to rest within MOVE_SETTLE_BAND
+const float KP = 1.2;
+const float KI = 0.1;
+const float KD = 0;
+const float KV = 3;
+const int HOLD_MS = 1000;
+const float HOLD_KP = 1.5;
+const float HOLD_KI = 0.5;
+const double CPU_SCALE = 25;			// like replay, run time on the Due / run time on the host
+const unsigned long MAX_AVG_UPDATE_US = 250;	// estimated cpu time on the Due per update of a moving servo
+
+typedef struct {
+	const char *name;
+	// joint
+	float lagMs;
+	int deadTimeMs;
+	float deadband;
+	float backlash;
+	// move
+	int startPosition;
+	int targetPosition;
+	int durationMs;
+	// limits of the metrics
+	float maxRmsError;
+	float maxOvershoot;
+	long maxSettleMs;		// from the move start
+} benchMoveType;
+
+// the limits leave a margin of about a third over the results of the current control code
+const benchMoveType benchMoves[] = {
+	{"nominal up",		150, 60, 2, 0,	90, 140, 1000,	10, 7, 1400},
+	{"nominal down",	150, 60, 2, 0,	140, 40, 1500,	12, 7, 2100},
+	{"short",			150, 60, 2, 0,	90, 100, 400,	8, 2, 1450},
+	{"slow joint",		300, 100, 2, 0,	60, 120, 1200,	13, 12, 2050},
+	{"gear slack",		150, 60, 2, 4,	120, 70, 1000,	12, 8, 1600},
+};
+
+servoConfigType config;
+Mai3Servo servo;
+moveRecordType record;
+
+static unsigned long long cpuNs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void setSensor(float jointPosition) {
+	float angle = REF_ANGLE - (jointPosition - 90) * DEG_PER_POS;
+	angle = fmod(fmod(angle, 360) + 360, 360);
+	// readCurrentMagnetAngle truncates the raw value to whole degrees
+	stubMagnetRaw[CHANNEL] = (int)ceil(angle * 4096 / 360) % 4096;
+}
+
+void runMove(const benchMoveType *move) {
+	config = servoConfigType();
+	servo = Mai3Servo();
+	servo.config = &config;
+	strcpy(config.servoName, "bench");
+
+	servoPlantType plant;
+	servoPlantInit(&plant, move->startPosition, move->lagMs, move->deadTimeMs, move->deadband, move->backlash, STEP_MS);
+	setSensor(plant.joint);
+	stubServoWrites[PIN] = move->startPosition;
+
+	servo.begin(PIN, 0, 180, 90, 0, false, move->startPosition, -1);
+	servo.setFeedbackValues(TCA9548_ADDRESS, CHANNEL, 0, false, DEG_PER_POS, KP, KI, KD);
+	servo.setPidLimits(KV, config.integralLimit, config.outputLimit);
+	servo.setHold(HOLD_MS, HOLD_KP, HOLD_KI, config.holdDeadband, config.holdPeriodMs);
+	servo.readFeedbackPosition();
+	CHECK_EQ(servo.currentPosition, move->startPosition);
+
+	servo.moveRecord = &record;
+	servo.moveTo(move->targetPosition, move->durationMs);
+
+	// motion task until the arrival or the timeout of the move, then watch the joint coming to rest
+	bool arrived = false;
+	unsigned int arrivedMs = 0;
+	for (int step = 0; step < 4 * move->durationMs / STEP_MS; step++) {
+		if (servo.inMoveRequest) {
+			bool wasMoving = servo.moving;
+			unsigned long long startNs = cpuNs();
+			servo.update();
+			if (wasMoving) {
+				moveRecordUpdateTime(&record, (cpuNs() - startNs) * CPU_SCALE / 1000);
+			}
+		}
+		Serial.tx.clear();
+
+		unsigned int ms = millis() - servo.startMillis;
+		if (arrived) {
+			moveRecordTick(&record, ms, -1, round(plant.joint), move->targetPosition, stubServoWrites[PIN]);
+			if (ms >= arrivedMs + SETTLE_WATCH_MS) {
+				break;
+			}
+		} else if (!servo.moving) {
+			arrived = true;
+			arrivedMs = ms;
+		}
+
+		servoPlantStep(&plant, stubServoWrites[PIN]);
+		setSensor(plant.joint);
+		stubSkipMicros(1000UL * STEP_MS);
+	}
+	CHECK(arrived);
+	CHECK_EQ(servo.moveEnd, MOVE_END_REACHED);
+
+	moveMetricsType metrics;
+	evalMoveMetrics(&record, &metrics);
+	float rms = moveMetricsRmsError(&metrics);
+	unsigned long avgUs = record.updates > 0 ? record.totalUpdateUs / record.updates : 0;
+	printf("  %-14s rms: %.2f, overshoot: %.1f, settleMs: %ld, arrivedMs: %u, avgUpdateUs: %lu, maxUpdateUs: %lu\n",
+		move->name, rms, metrics.overshoot, metrics.settleMs, arrivedMs, avgUs, record.maxUpdateUs);
+
+	CHECK_EQ(record.droppedTicks, 0);
+	CHECK(rms <= move->maxRmsError);
+	CHECK(metrics.overshoot <= move->maxOvershoot);
+	CHECK(metrics.settleMs >= 0 && metrics.settleMs <= move->maxSettleMs);
+	CHECK(avgUs <= MAX_AVG_UPDATE_US);
+}
+
+int main() {
+	stubCpuScale = 0;
+	for (unsigned int m = 0; m < sizeof(benchMoves) / sizeof(benchMoves[0]); m++) {
+		runMove(&benchMoves[m]);
+	}
+	return CHECK_DONE("testServoControl");
+}
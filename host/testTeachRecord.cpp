@@ -0,0 +1,145 @@
+// host test of the teach mode encoding (teachRecord.cpp): delta and =<count> runs, lines split at
+// gaps, the sample ring and the line by line sending of a block
+
+#include <string.h>
+#include "teachRecord.h"
+#include "check.h"
+
+int checkFailures = 0;
+
+const int PERIOD_MS = 10;
+
+void startRecord(teachRecordType *rec, int numServos) {
+	rec->numServos = numServos;
+	for (int s = 0; s < numServos; s++) {
+		rec->servoId[s] = s;
+		rec->pin[s] = 7 + s;
+	}
+	teachStart(rec, PERIOD_MS);
+}
+
+// samples of one servo, values in tenths
+void addTicks(teachRecordType *rec, unsigned long ms, const short *values, int numTicks) {
+	for (int t = 0; t < numTicks; t++) {
+		short tick[TEACH_MAX_SERVOS] = {values[t]};
+		CHECK(teachAddTick(rec, ms + t * PERIOD_MS, tick));
+	}
+}
+
+void checkLine(teachRecordType *rec, int numTicks, const char *expected) {
+	char line[TEACH_LINE_SIZE];
+	int len = teachEncodeLine(rec, 0, numTicks, line, TEACH_LINE_SIZE);
+	CHECK_EQ(len, strlen(expected));
+	if (strcmp(line, expected) != 0) {
+		checkFailures++;
+		printf("line: %s, expected: %s\n", line, expected);
+	}
+}
+
+void testDeltas() {
+	teachRecordType rec;
+	startRecord(&rec, 1);
+	const short values[] = {900, 900, 900, 905, 903, 903, 910};
+	addTicks(&rec, 1000, values, 7);
+	checkLine(&rec, 7, "W7,1000,900,=2,5,-2,0,7");
+	checkLine(&rec, 4, "W7,1000,900,=2,5");
+}
+
+// samples without change at the end of the line are written as a run as well
+void testRuns() {
+	teachRecordType rec;
+	startRecord(&rec, 1);
+	const short values[] = {-15, -14, -14, -14, -14, -14};
+	addTicks(&rec, 50, values, 6);
+	checkLine(&rec, 6, "W7,50,-15,1,=4");
+	checkLine(&rec, 3, "W7,50,-15,1,0");
+	checkLine(&rec, 1, "W7,50,-15");
+}
+
+// a line needs TEACH_LINE_TICKS samples unless flushed, a gap in the sample times ends it
+void testLineTicks() {
+	teachRecordType rec;
+	startRecord(&rec, 1);
+	short values[TEACH_RING_TICKS] = {0};
+	CHECK_EQ(teachLineTicks(&rec, true), 0);
+	addTicks(&rec, 0, values, TEACH_LINE_TICKS - 1);
+	CHECK_EQ(teachLineTicks(&rec, false), 0);
+	CHECK_EQ(teachLineTicks(&rec, true), TEACH_LINE_TICKS - 1);
+	addTicks(&rec, (TEACH_LINE_TICKS - 1) * PERIOD_MS + 4, values, 10);		// jitter within half a period
+	CHECK_EQ(teachLineTicks(&rec, false), TEACH_LINE_TICKS);
+
+	startRecord(&rec, 1);
+	addTicks(&rec, 0, values, 5);
+	addTicks(&rec, 5 * PERIOD_MS + 30, values, 30);		// 3 samples missing
+	CHECK_EQ(teachLineTicks(&rec, false), 5);
+	teachConsume(&rec, 5);
+	CHECK_EQ(teachLineTicks(&rec, false), TEACH_LINE_TICKS);
+	checkLine(&rec, 1, "W7,80,0");
+}
+
+// a full ring drops the new samples, the ring wraps after samples were sent
+void testRing() {
+	teachRecordType rec;
+	startRecord(&rec, 1);
+	short values[TEACH_RING_TICKS];
+	for (int t = 0; t < TEACH_RING_TICKS; t++) {
+		values[t] = t;
+	}
+	addTicks(&rec, 0, values, TEACH_RING_TICKS);
+	short tick[TEACH_MAX_SERVOS] = {0};
+	CHECK(!teachAddTick(&rec, TEACH_RING_TICKS * PERIOD_MS, tick));
+	CHECK_EQ(rec.droppedTicks, 1);
+	CHECK_EQ(rec.ticks, TEACH_RING_TICKS);
+
+	teachConsume(&rec, TEACH_RING_TICKS - 2);
+	const short next[] = {300, 300, 301};
+	addTicks(&rec, TEACH_RING_TICKS * PERIOD_MS, next, 3);
+	CHECK_EQ(rec.count, 5);
+	CHECK_EQ(rec.head, TEACH_RING_TICKS - 2);
+	checkLine(&rec, 5, "W7,1980,198,1,101,0,1");
+}
+
+// the lines of a block are returned until they are sent, the samples are dropped with the last line
+void testBlockLines() {
+	teachRecordType rec;
+	startRecord(&rec, 3);
+	char line[TEACH_LINE_SIZE];
+	CHECK_EQ(teachNextLine(&rec, false, line, TEACH_LINE_SIZE), 0);
+
+	for (int t = 0; t < TEACH_LINE_TICKS + 2; t++) {
+		short tick[TEACH_MAX_SERVOS] = {10, 20, 30};
+		CHECK(teachAddTick(&rec, t * PERIOD_MS, tick));
+	}
+	int len = teachNextLine(&rec, false, line, TEACH_LINE_SIZE);
+	CHECK(strcmp(line, "W7,0,10,=24") == 0);
+	CHECK_EQ(teachNextLine(&rec, false, line, TEACH_LINE_SIZE), len);
+	CHECK(strcmp(line, "W7,0,10,=24") == 0);
+	teachLineSent(&rec, len);
+	CHECK_EQ(rec.count, TEACH_LINE_TICKS + 2);
+
+	// new samples do not change the block being sent
+	short tick[TEACH_MAX_SERVOS] = {40, 50, 60};
+	CHECK(teachAddTick(&rec, (TEACH_LINE_TICKS + 2) * PERIOD_MS, tick));
+	len = teachNextLine(&rec, false, line, TEACH_LINE_SIZE);
+	CHECK(strcmp(line, "W8,0,20,=24") == 0);
+	teachLineSent(&rec, len);
+	len = teachNextLine(&rec, false, line, TEACH_LINE_SIZE);
+	CHECK(strcmp(line, "W9,0,30,=24") == 0);
+	teachLineSent(&rec, len);
+	CHECK_EQ(rec.count, 3);
+	CHECK_EQ(rec.lines, 3);
+	CHECK_EQ(rec.bytes, 3 * (len + 1));
+
+	CHECK_EQ(teachNextLine(&rec, false, line, TEACH_LINE_SIZE), 0);
+	len = teachNextLine(&rec, true, line, TEACH_LINE_SIZE);
+	CHECK(strcmp(line, "W7,250,10,0,30") == 0);
+}
+
+int main() {
+	testDeltas();
+	testRuns();
+	testLineTicks();
+	testRing();
+	testBlockLines();
+	return CHECK_DONE("testTeachRecord");
+}
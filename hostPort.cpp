@@ -0,0 +1,178 @@
+// 
+// 
+// 
+#include <Arduino.h>
+
+#include "hostPort.h"
+
+TrafficStream trafficPort;
+Stream *hostPort = &trafficPort;
+bool isHostPortUsb = false;
+
+void beginHostPort() {
+
+	trafficPort.port = &Serial;
+	trafficPort.resetStats();
+
+	// the programming port is always opened, with the native usb port selected it can be used for debugging
+	Serial.begin(HOST_PORT_BAUD);
+
+#if defined(ARDUINO_ARCH_SAM) && (HOST_PORT_SELECTION != HOST_PORT_SERIAL)
+	SerialUSB.begin(0);		// baud rate is ignored by the native usb port
+
+	// the native usb port reports true when a host has opened it (DTR set)
+	unsigned long waitStartMillis = millis();
+	while (!SerialUSB) {
+		if (HOST_PORT_SELECTION == HOST_PORT_AUTO && millis() - waitStartMillis > HOST_PORT_USB_WAIT_MS) {
+			break;
+		}
+	}
+	if (SerialUSB) {
+		trafficPort.port = &SerialUSB;
+		isHostPortUsb = true;
+	}
+#endif
+}
+
+bool setTrafficCapture(bool captureOn) {
+	if (captureOn && !isHostPortUsb) {
+		return false;
+	}
+	trafficPort.captureOn = captureOn;
+	return true;
+}
+
+void reportTrafficStats(bool resetStats) {
+
+	trafficStatsType *stats = &trafficPort.stats;
+	unsigned long periodMs = millis() - stats->startMillis;
+
+	hostPort->print("i97 traffic, periodMs: "); hostPort->print(periodMs);
+	hostPort->print(", rxBytes: "); hostPort->print(stats->rxBytes);
+	hostPort->print(", rxLines: "); hostPort->print(stats->rxLines);
+	hostPort->print(", txBytes: "); hostPort->print(stats->txBytes);
+	hostPort->print(", txFrames: "); hostPort->print(stats->txFrames);
+	hostPort->print(", txLines: "); hostPort->print(stats->txLines);
+	if (periodMs > 0) {
+		hostPort->print(", commands/s: "); hostPort->print(1000.0 * stats->rxLines / periodMs);
+		hostPort->print(", txBytes/s: "); hostPort->print(1000.0 * stats->txBytes / periodMs);
+	}
+	hostPort->println();
+
+	if (resetStats) {
+		trafficPort.resetStats();
+	}
+}
+
+
+void TrafficStream::resetStats() {
+	stats.rxBytes = 0;
+	stats.rxLines = 0;
+	stats.txBytes = 0;
+	stats.txFrames = 0;
+	stats.txLines = 0;
+	stats.startMillis = millis();
+}
+
+int TrafficStream::available() {
+	return port->available();
+}
+
+int TrafficStream::peek() {
+	return port->peek();
+}
+
+void TrafficStream::flush() {
+	port->flush();
+}
+
+int TrafficStream::read() {
+	int c = port->read();
+	if (c >= 0) {
+		stats.rxBytes++;
+		if (c == '\n') {
+			stats.rxLines++;
+		}
+		if (captureOn) {
+			captureRx(c);
+		}
+	}
+	return c;
+}
+
+size_t TrafficStream::write(uint8_t c) {
+	return write(&c, 1);
+}
+
+size_t TrafficStream::write(const uint8_t *buffer, size_t size) {
+	// a feedback status frame is always sent with one write, its ms bytes can be 0x0A
+	// therefore it is counted and captured as a whole and not split at the newline
+	if (size == 8 && buffer[0] >= 0xC0) {
+		stats.txBytes += size;
+		stats.txFrames++;
+		if (captureOn) {
+			captureRecord(buffer, size - 1);
+		}
+		return port->write(buffer, size);
+	}
+	for (size_t i = 0; i < size; i++) {
+		stats.txBytes++;
+		if (buffer[i] == '\n') {
+			if (txLen > 0 && txLine[0] >= 0xC0) {
+				stats.txFrames++;
+			} else {
+				stats.txLines++;
+			}
+		}
+		captureTx(buffer[i]);
+	}
+	return port->write(buffer, size);
+}
+
+void TrafficStream::captureRx(uint8_t c) {
+	if (c != '\n') {
+		if (rxLen < (int)sizeof(rxLine) - 1) {
+			rxLine[rxLen++] = c;
+		}
+		return;
+	}
+	rxLine[rxLen] = '\0';
+	Serial.print(micros()); Serial.print(" H "); Serial.println(rxLine);
+	rxLen = 0;
+}
+
+// the tx line is also needed for the frame count, it is collected with capture off
+void TrafficStream::captureTx(uint8_t c) {
+	if (c != '\n') {
+		if (txLen < (int)sizeof(txLine)) {
+			txLine[txLen++] = c;
+		}
+		return;
+	}
+	if (captureOn) {
+		captureRecord(txLine, txLen);
+	}
+	txLen = 0;
+}
+
+// a status frame or a text message without the newline terminator
+void TrafficStream::captureRecord(const uint8_t *bytes, int length) {
+	Serial.print(micros());
+	if (length > 0 && bytes[0] >= 0xC0) {
+		Serial.print(" F ");
+		for (int i = 0; i < length; i++) {
+			if (bytes[i] < 0x10) {
+				Serial.print("0");
+			}
+			Serial.print(bytes[i], HEX);
+		}
+	} else {
+		Serial.print(" B ");
+		for (int i = 0; i < length; i++) {
+			if (bytes[i] != '\r') {
+				Serial.write(bytes[i]);
+			}
+		}
+	}
+	Serial.println();
+}
@@ -0,0 +1,79 @@
+
+#ifndef hostPort_h
+#define hostPort_h
+
+#include "Arduino.h"
+
+// transport to skeletonControl
+// HOST_PORT_SERIAL: programming port, 115200 baud
+// HOST_PORT_USB: native usb port of the Due (SerialUSB), full usb speed
+// HOST_PORT_AUTO: the native usb port when the host opens it within HOST_PORT_USB_WAIT_MS after boot,
+//                 the programming port otherwise
+#define HOST_PORT_SERIAL 1
+#define HOST_PORT_USB 2
+#define HOST_PORT_AUTO 3
+
+#ifndef HOST_PORT_SELECTION
+#define HOST_PORT_SELECTION HOST_PORT_AUTO
+#endif
+
+#define HOST_PORT_BAUD 115200
+#define HOST_PORT_USB_WAIT_MS 1500
+
+// traffic counters of the host port
+typedef struct {
+	unsigned long rxBytes;
+	unsigned long rxLines;		// received command lines
+	unsigned long txBytes;
+	unsigned long txFrames;		// binary status frames (first byte 0xC0 | pin)
+	unsigned long txLines;		// text messages
+	unsigned long startMillis;	// start of the statistics period
+} trafficStatsType;
+
+// the selected port with traffic counters and the optional capture of all traffic
+// capture records are written to the programming port, one record per line:
+//   <micros> H <command line>			host -> board
+//   <micros> B <text message>			board -> host
+//   <micros> F <frame bytes as hex>	board -> host, status frame without the newline terminator
+class TrafficStream : public Stream {
+public:
+	Stream *port = &Serial;
+	trafficStatsType stats;
+	bool captureOn;
+
+	int available();
+	int read();
+	int peek();
+	void flush();
+	size_t write(uint8_t c);
+	size_t write(const uint8_t *buffer, size_t size);
+	using Print::write;
+
+	void resetStats();
+
+private:
+	char rxLine[100];
+	int rxLen;
+	uint8_t txLine[100];
+	int txLen;
+
+	void captureRx(uint8_t c);
+	void captureTx(uint8_t c);
+	void captureRecord(const uint8_t *bytes, int length);
+};
+
+// all messages to and from skeletonControl use this port
+extern Stream *hostPort;
+extern TrafficStream trafficPort;
+extern bool isHostPortUsb;
+
+// capture needs the programming port to be free, returns false when the host is connected to it
+extern bool setTrafficCapture(bool captureOn);
+
+// send the traffic counters and rates, optionally reset them
+extern void reportTrafficStats(bool resetStats);
+
+// open the port(s) and select the host port, needs to run before any message is sent
+extern void beginHostPort();
+
+#endif
@@ -0,0 +1,47 @@
+#include <math.h>
+#include "inputShaper.h"
+
+
+bool inputShaperSetup(inputShaperType *shaper, int type, float frequencyHz, float damping) {
+
+	shaper->type = SHAPER_NONE;
+	shaper->frequencyHz = frequencyHz;
+	shaper->damping = damping;
+	shaper->numImpulses = 1;
+	shaper->impulseMs[0] = 0;
+	shaper->amplitude[0] = 1;
+
+	if (type == SHAPER_NONE) {
+		return true;
+	}
+	if ((type != SHAPER_ZV && type != SHAPER_ZVD) || frequencyHz <= 0 || damping < 0 || damping >= 1) {
+		return false;
+	}
+
+	// half period of the damped oscillation and the decay of one half period
+	float root = sqrt(1 - damping * damping);
+	float halfPeriodMs = 500.0 / (frequencyHz * root);
+	float k = exp(-damping * M_PI / root);
+
+	shaper->type = type;
+	if (type == SHAPER_ZV) {
+		shaper->numImpulses = 2;
+		shaper->amplitude[0] = 1 / (1 + k);
+		shaper->amplitude[1] = k / (1 + k);
+	} else {
+		float sum = (1 + k) * (1 + k);
+		shaper->numImpulses = 3;
+		shaper->amplitude[0] = 1 / sum;
+		shaper->amplitude[1] = 2 * k / sum;
+		shaper->amplitude[2] = k * k / sum;
+	}
+	for (int i = 1; i < shaper->numImpulses; i++) {
+		shaper->impulseMs[i] = lround(i * halfPeriodMs);
+	}
+	return true;
+}
+
+
+long inputShaperDelayMs(const inputShaperType *shaper) {
+	return shaper->impulseMs[shaper->numImpulses - 1];
+}
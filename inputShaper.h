@@ -0,0 +1,34 @@
+
+#ifndef inputShaper_h
+#define inputShaper_h
+
+// input shaping of the planned move, suppresses the ringing of long and light limbs after a move
+// the planned position is replaced by the sum of time shifted and scaled copies (impulses),
+// the oscillation excited by one impulse is cancelled by the next one
+// ZV: 2 impulses within half a period of the damped oscillation
+// ZVD: 3 impulses within a full period, less sensitive to a wrong frequency
+// the move gets longer by the time of the last impulse
+// kept free of arduino calls, tested on the host (host/testInputShaper.cpp)
+
+#define SHAPER_NONE 0
+#define SHAPER_ZV 1
+#define SHAPER_ZVD 2
+
+#define SHAPER_MAX_IMPULSES 3
+
+typedef struct {
+	int type;				// SHAPER_NONE, SHAPER_ZV, SHAPER_ZVD
+	float frequencyHz;		// natural frequency of the oscillation
+	float damping;			// damping ratio 0..<1
+	int numImpulses;
+	long impulseMs[SHAPER_MAX_IMPULSES];
+	float amplitude[SHAPER_MAX_IMPULSES];	// sum of the amplitudes is 1
+} inputShaperType;
+
+// compute the impulses, returns false for invalid parameters (shaper off)
+extern bool inputShaperSetup(inputShaperType *shaper, int type, float frequencyHz, float damping);
+
+// additional move time of the shaped move
+extern long inputShaperDelayMs(const inputShaperType *shaper);
+
+#endif
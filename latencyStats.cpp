@@ -0,0 +1,60 @@
+// 
+// 
+// 
+#include <Arduino.h>
+
+#include "latencyStats.h"
+#include "hostPort.h"
+
+unsigned long latencyBinLowUs(int bin) {
+	if (bin == 0) {
+		return 0;
+	}
+	return 1UL << (bin + 5);
+}
+
+void addLatencySample(latencyHistogramType *histogram, unsigned long latencyUs) {
+
+	int bin = 0;
+	unsigned long limitUs = 64;
+	while (bin < LATENCY_BINS - 1 && latencyUs >= limitUs) {
+		bin++;
+		limitUs = limitUs << 1;
+	}
+	histogram->binCount[bin]++;
+	histogram->samples++;
+	histogram->totalUs += latencyUs;
+	if (latencyUs > histogram->maxUs) {
+		histogram->maxUs = latencyUs;
+	}
+}
+
+void reportLatencyHistogram(const char *logCode, const char *name, latencyHistogramType *histogram, bool resetStats) {
+
+	hostPort->print(logCode); hostPort->print(" "); hostPort->print(name);
+	hostPort->print(", samples: "); hostPort->print(histogram->samples);
+	hostPort->print(", maxUs: "); hostPort->print(histogram->maxUs);
+	hostPort->print(", avgUs: ");
+	if (histogram->samples > 0) {
+		hostPort->print(histogram->totalUs / histogram->samples);
+	} else {
+		hostPort->print(0);
+	}
+	hostPort->print(", bins: ");
+	for (int b = 0; b < LATENCY_BINS; b++) {
+		if (b > 0) {
+			hostPort->print(",");
+		}
+		hostPort->print(histogram->binCount[b]);
+	}
+	hostPort->println();
+
+	if (resetStats) {
+		for (int b = 0; b < LATENCY_BINS; b++) {
+			histogram->binCount[b] = 0;
+		}
+		histogram->samples = 0;
+		histogram->maxUs = 0;
+		histogram->totalUs = 0;
+	}
+}
@@ -0,0 +1,28 @@
+
+#ifndef latencyStats_h
+#define latencyStats_h
+
+#include "Arduino.h"
+
+// histogram of latencies in power of 2 bins, bin 0 counts latencies below 64 us,
+// bin n counts latencies of 2^(n+5) .. 2^(n+6)-1 us, the last bin everything above
+#define LATENCY_BINS 12
+
+typedef struct {
+	unsigned long binCount[LATENCY_BINS];
+	unsigned long samples;
+	unsigned long maxUs;
+	unsigned long totalUs;
+} latencyHistogramType;
+
+// lower limit in us of a histogram bin
+extern unsigned long latencyBinLowUs(int bin);
+
+// add a latency sample to the histogram
+extern void addLatencySample(latencyHistogramType *histogram, unsigned long latencyUs);
+
+// send the histogram as <logCode> <name>, samples, maxUs, avgUs, bins: <count>,..
+// optionally reset the counters
+extern void reportLatencyHistogram(const char *logCode, const char *name, latencyHistogramType *histogram, bool resetStats);
+
+#endif
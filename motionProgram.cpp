@@ -0,0 +1,225 @@
+#include "motionProgram.h"
+
+
+// bytes of the operands of each opcode
+static const int operandBytes[] = {0, 4, 4, 2, 1, 1, 3, 3, 3, 2, 2, 3, 5, 5};
+#define NUMBER_OF_OPCODES (int)(sizeof(operandBytes) / sizeof(operandBytes[0]))
+
+
+void motionProgramClear(motionProgramType *prog) {
+	prog->length = 0;
+	prog->state = PROGRAM_IDLE;
+	prog->error = PROGRAM_OK;
+}
+
+
+bool motionProgramLoad(motionProgramType *prog, const unsigned char *bytes, int numBytes) {
+	if (prog->length + numBytes > MOTION_PROGRAM_SIZE) {
+		return false;
+	}
+	for (int i = 0; i < numBytes; i++) {
+		prog->code[prog->length++] = bytes[i];
+	}
+	prog->state = PROGRAM_IDLE;		// a changed program is not ended or failed
+	return true;
+}
+
+
+static int hexDigit(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+int motionProgramParseHex(const char *hex, unsigned char *bytes, int maxBytes) {
+	int numBytes = 0;
+	for (int i = 0; hex[i] != '\0'; i += 2) {
+		int high = hexDigit(hex[i]);
+		int low = hex[i + 1] != '\0' ? hexDigit(hex[i + 1]) : -1;
+		if (high < 0 || low < 0 || numBytes >= maxBytes) {
+			return -1;
+		}
+		bytes[numBytes++] = high * 16 + low;
+	}
+	return numBytes;
+}
+
+
+void motionProgramStart(motionProgramType *prog) {
+	prog->state = PROGRAM_RUNNING;
+	prog->error = PROGRAM_OK;
+	prog->pc = 0;
+	prog->errorPc = 0;
+	prog->instructions = 0;
+	for (int r = 0; r < MOTION_PROGRAM_REGISTERS; r++) {
+		prog->reg[r] = 0;
+	}
+}
+
+
+void motionProgramStop(motionProgramType *prog) {
+	prog->state = PROGRAM_IDLE;
+}
+
+
+static int fail(motionProgramType *prog, int error, int pc) {
+	prog->state = PROGRAM_FAILED;
+	prog->error = error;
+	prog->errorPc = pc;
+	return prog->state;
+}
+
+
+static int operandU8(const motionProgramType *prog, int at) {
+	return prog->code[at];
+}
+
+static int operandU16(const motionProgramType *prog, int at) {
+	return prog->code[at] | (prog->code[at + 1] << 8);
+}
+
+static int operandS16(const motionProgramType *prog, int at) {
+	return (short)(prog->code[at] | (prog->code[at + 1] << 8));
+}
+
+
+int motionProgramRun(motionProgramType *prog, const motionProgramHostType *host, unsigned long nowMs) {
+
+	// wait conditions
+	if (prog->state == PROGRAM_WAITING) {
+		if ((long)(nowMs - prog->wakeMs) < 0) {
+			return prog->state;
+		}
+		prog->state = PROGRAM_RUNNING;
+	}
+	if (prog->state == PROGRAM_ARRIVING) {
+		int moving = host->servoMoving(prog->waitPin);
+		if (moving < 0) {
+			return fail(prog, PROGRAM_BAD_SERVO, prog->pc - 1 - operandBytes[OP_ARRIVE]);	// pc of the ARRIVE
+		}
+		if (moving) {
+			return prog->state;
+		}
+		prog->state = PROGRAM_RUNNING;
+	}
+
+	for (int budget = 0; budget < MOTION_PROGRAM_BUDGET && prog->state == PROGRAM_RUNNING; budget++) {
+
+		int pc = prog->pc;
+		if (pc >= prog->length) {
+			prog->state = PROGRAM_ENDED;	// running off the end is an implicit END
+			break;
+		}
+		int op = prog->code[pc];
+		if (op >= NUMBER_OF_OPCODES) {
+			return fail(prog, PROGRAM_BAD_OPCODE, pc);
+		}
+		int at = pc + 1;
+		if (at + operandBytes[op] > prog->length) {
+			return fail(prog, PROGRAM_BAD_OPERAND, pc);
+		}
+		prog->pc = at + operandBytes[op];
+		prog->instructions++;
+
+		// register operand, the first operand byte, the second one of MOVER
+		int r = 0;
+		bool usesRegister = op == OP_MOVER || op == OP_WAITR || (op >= OP_SET && op <= OP_POS)
+			|| op == OP_DJNZ || op == OP_JLT || op == OP_JGT;
+		if (usesRegister) {
+			r = operandU8(prog, op == OP_MOVER ? at + 1 : at);
+		}
+		if (r >= MOTION_PROGRAM_REGISTERS) {
+			return fail(prog, PROGRAM_BAD_REGISTER, pc);
+		}
+
+		int jump = -1;
+		switch (op) {
+
+		case OP_END:
+			prog->state = PROGRAM_ENDED;
+			break;
+
+		case OP_MOVE:
+			if (!host->moveServo(operandU8(prog, at), operandU8(prog, at + 1), operandU16(prog, at + 2))) {
+				return fail(prog, PROGRAM_BAD_SERVO, pc);
+			}
+			break;
+
+		case OP_MOVER:
+			if (!host->moveServo(operandU8(prog, at), prog->reg[r], operandU16(prog, at + 2))) {
+				return fail(prog, PROGRAM_BAD_SERVO, pc);
+			}
+			break;
+
+		case OP_WAIT:
+			prog->wakeMs = nowMs + operandU16(prog, at);
+			prog->state = PROGRAM_WAITING;
+			break;
+
+		case OP_WAITR:
+			prog->wakeMs = nowMs + (prog->reg[r] > 0 ? prog->reg[r] : 0);
+			prog->state = PROGRAM_WAITING;
+			break;
+
+		case OP_ARRIVE:
+			prog->waitPin = operandU8(prog, at);
+			prog->state = PROGRAM_ARRIVING;
+			break;
+
+		case OP_SET:
+			prog->reg[r] = operandS16(prog, at + 1);
+			break;
+
+		case OP_ADD:
+			prog->reg[r] += operandS16(prog, at + 1);
+			break;
+
+		case OP_RAND: {
+			int max = operandU16(prog, at + 1);
+			prog->reg[r] = max > 0 ? host->randomValue(max) : 0;
+			break;
+		}
+
+		case OP_POS: {
+			int position = host->servoPosition(operandU8(prog, at + 1));
+			if (position < 0) {
+				return fail(prog, PROGRAM_BAD_SERVO, pc);
+			}
+			prog->reg[r] = position;
+			break;
+		}
+
+		case OP_JMP:
+			jump = operandU16(prog, at);
+			break;
+
+		case OP_DJNZ:
+			prog->reg[r] -= 1;
+			if (prog->reg[r] != 0) {
+				jump = operandU16(prog, at + 1);
+			}
+			break;
+
+		case OP_JLT:
+			if (prog->reg[r] < operandS16(prog, at + 1)) {
+				jump = operandU16(prog, at + 3);
+			}
+			break;
+
+		case OP_JGT:
+			if (prog->reg[r] > operandS16(prog, at + 1)) {
+				jump = operandU16(prog, at + 3);
+			}
+			break;
+		}
+
+		if (jump >= 0) {
+			if (jump >= prog->length) {
+				return fail(prog, PROGRAM_BAD_JUMP, pc);
+			}
+			prog->pc = jump;
+		}
+	}
+	return prog->state;
+}
@@ -0,0 +1,93 @@
+
+#ifndef motionProgram_h
+#define motionProgram_h
+
+// on-board motion programs (idle breathing, blinking, waving) run by a small bytecode interpreter
+// independent of the host. Each run of the program task executes at most MOTION_PROGRAM_BUDGET
+// instructions, waits end the run. All operands, registers and jump targets are checked,
+// an invalid program is stopped with an error code instead of touching memory outside of it.
+// kept free of arduino calls, servos are accessed through motionProgramHostType
+// host/mpasm assembles programs from the mnemonics below, host/testMotionProgram tests the interpreter
+//
+// instructions, operands little endian, r: register 0..7, addr: byte offset in the program
+//   0x00 END
+//   0x01 MOVE pin, position, durationMs(16)	move request like command 1
+//   0x02 MOVER pin, r, durationMs(16)			move to the position in register r
+//   0x03 WAIT ms(16)
+//   0x04 WAITR r								wait the ms in register r
+//   0x05 ARRIVE pin								wait until the servo has arrived
+//   0x06 SET r, value(16 signed)
+//   0x07 ADD r, value(16 signed)
+//   0x08 RAND r, max(16)						r = random 0..max-1
+//   0x09 POS r, pin								r = current (measured) position of the servo
+//   0x0A JMP addr(16)
+//   0x0B DJNZ r, addr(16)						decrement r, jump while not zero (loops)
+//   0x0C JLT r, value(16 signed), addr(16)		jump if r < value
+//   0x0D JGT r, value(16 signed), addr(16)		jump if r > value
+
+#define MOTION_PROGRAM_SIZE 256
+#define MOTION_PROGRAM_REGISTERS 8
+#define MOTION_PROGRAM_BUDGET 32	// instructions per run
+
+enum motionProgramOpType {
+	OP_END, OP_MOVE, OP_MOVER, OP_WAIT, OP_WAITR, OP_ARRIVE, OP_SET, OP_ADD, OP_RAND, OP_POS,
+	OP_JMP, OP_DJNZ, OP_JLT, OP_JGT
+};
+
+enum motionProgramStateType {
+	PROGRAM_IDLE,			// loaded or stopped
+	PROGRAM_RUNNING,
+	PROGRAM_WAITING,		// until wakeMs
+	PROGRAM_ARRIVING,		// until the servo of waitPin has arrived
+	PROGRAM_ENDED,
+	PROGRAM_FAILED
+};
+
+enum motionProgramErrorType {
+	PROGRAM_OK,
+	PROGRAM_BAD_OPCODE,
+	PROGRAM_BAD_OPERAND,	// instruction beyond the end of the program
+	PROGRAM_BAD_REGISTER,
+	PROGRAM_BAD_JUMP,
+	PROGRAM_BAD_SERVO		// servo unknown or move request not accepted
+};
+
+typedef struct {
+	bool (*moveServo)(int pin, int position, int durationMs);
+	int (*servoPosition)(int pin);		// -1 for an unknown servo
+	int (*servoMoving)(int pin);		// 1 moving, 0 arrived, -1 unknown servo
+	long (*randomValue)(long max);
+} motionProgramHostType;
+
+typedef struct {
+	unsigned char code[MOTION_PROGRAM_SIZE];
+	int length;
+
+	// runtime data
+	int state;
+	int error;
+	int pc;
+	int errorPc;
+	long reg[MOTION_PROGRAM_REGISTERS];
+	unsigned long wakeMs;
+	int waitPin;
+	unsigned long instructions;		// executed since the start
+} motionProgramType;
+
+extern void motionProgramClear(motionProgramType *prog);
+
+// append bytes to the program, false when it does not fit
+extern bool motionProgramLoad(motionProgramType *prog, const unsigned char *bytes, int numBytes);
+
+// bytes of the load command, 2 hex digits per byte
+// returns the number of bytes, -1 for an odd number of digits, other characters or more than maxBytes
+extern int motionProgramParseHex(const char *hex, unsigned char *bytes, int maxBytes);
+
+extern void motionProgramStart(motionProgramType *prog);
+
+extern void motionProgramStop(motionProgramType *prog);
+
+// execute up to MOTION_PROGRAM_BUDGET instructions, returns the state
+extern int motionProgramRun(motionProgramType *prog, const motionProgramHostType *host, unsigned long nowMs);
+
+#endif
@@ -0,0 +1,109 @@
+#include <math.h>
+#include <stdlib.h>
+#include "moveRecord.h"
+
+
+void moveMetricsStart(moveMetricsType *metrics, int startPosition, int targetPosition) {
+	metrics->startPosition = startPosition;
+	metrics->targetPosition = targetPosition;
+	metrics->ticks = 0;
+	metrics->sumSquaredError = 0;
+	metrics->maxError = 0;
+	metrics->overshoot = 0;
+	metrics->settleMs = -1;
+	metrics->saturatedTicks = 0;
+	metrics->durationMs = 0;
+}
+
+
+void moveMetricsAdd(moveMetricsType *metrics, unsigned long ms, int currentPosition,
+	float wantedPosition, bool saturated) {
+
+	float error = wantedPosition - currentPosition;
+	metrics->ticks++;
+	metrics->sumSquaredError += error * error;
+	if (fabs(error) > metrics->maxError) {
+		metrics->maxError = fabs(error);
+	}
+
+	int direction = metrics->targetPosition >= metrics->startPosition ? 1 : -1;
+	float beyondTarget = (currentPosition - metrics->targetPosition) * direction;
+	if (beyondTarget > metrics->overshoot) {
+		metrics->overshoot = beyondTarget;
+	}
+
+	// the settle time restarts whenever the position leaves the band
+	if (abs(currentPosition - metrics->targetPosition) <= MOVE_SETTLE_BAND) {
+		if (metrics->settleMs < 0) {
+			metrics->settleMs = ms;
+		}
+	} else {
+		metrics->settleMs = -1;
+	}
+
+	if (saturated) {
+		metrics->saturatedTicks++;
+	}
+	metrics->durationMs = ms;
+}
+
+
+float moveMetricsRmsError(const moveMetricsType *metrics) {
+	if (metrics->ticks == 0) {
+		return 0;
+	}
+	return sqrt(metrics->sumSquaredError / metrics->ticks);
+}
+
+
+void moveRecordStart(moveRecordType *record, int startPosition, int targetPosition) {
+	record->recording = true;
+	record->startPosition = startPosition;
+	record->targetPosition = targetPosition;
+	record->numTicks = 0;
+	record->droppedTicks = 0;
+	record->updates = 0;
+	record->totalUpdateUs = 0;
+	record->maxUpdateUs = 0;
+}
+
+
+void moveRecordTick(moveRecordType *record, unsigned int ms, int magnetAngle, int currentPosition,
+	float wantedPosition, unsigned char writePosition) {
+
+	if (!record->recording) {
+		return;
+	}
+	if (record->numTicks >= MOVE_RECORD_TICKS) {
+		record->droppedTicks++;
+		return;
+	}
+	moveTickType *tick = &record->tick[record->numTicks++];
+	tick->ms = ms;
+	tick->magnetAngle = magnetAngle;
+	tick->currentPosition = currentPosition;
+	tick->wantedPosition = wantedPosition;
+	tick->writePosition = writePosition;
+}
+
+
+void moveRecordUpdateTime(moveRecordType *record, unsigned long updateUs) {
+	if (!record->recording) {
+		return;
+	}
+	record->updates++;
+	record->totalUpdateUs += updateUs;
+	if (updateUs > record->maxUpdateUs) {
+		record->maxUpdateUs = updateUs;
+	}
+}
+
+
+void evalMoveMetrics(const moveRecordType *record, moveMetricsType *metrics) {
+
+	moveMetricsStart(metrics, record->startPosition, record->targetPosition);
+	for (int t = 0; t < record->numTicks; t++) {
+		const moveTickType *tick = &record->tick[t];
+		moveMetricsAdd(metrics, tick->ms, tick->currentPosition, tick->wantedPosition, false);
+	}
+}
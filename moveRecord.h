@@ -0,0 +1,65 @@
+
+#ifndef moveRecord_h
+#define moveRecord_h
+
+// tracking metrics of a move, accumulated per 20 ms update in constant memory
+// and the per update record of one move for judging changes of the control code by numbers
+// no arduino calls: host/testMoveRecord.cpp checks the metrics, host/testServoControl.cpp evaluates
+// recorded moves of Mai3Servo against a simulated joint
+
+#define MOVE_RECORD_TICKS 250		// 5 seconds of 20 ms updates, later updates are not recorded
+#define MOVE_SETTLE_BAND 2			// settled when staying within this distance of the target
+
+typedef struct {
+	unsigned int ms;			// ms since move start
+	int magnetAngle;			// raw sensor angle, -1 for servos without feedback
+	int currentPosition;		// measured or modelled position
+	float wantedPosition;
+	unsigned char writePosition;
+} moveTickType;
+
+typedef struct {
+	int startPosition;
+	int targetPosition;
+	unsigned long ticks;
+	float sumSquaredError;		// of wantedPosition - currentPosition
+	float maxError;
+	float overshoot;			// max distance beyond the target in move direction, in positions
+	long settleMs;				// ms when the position stayed within MOVE_SETTLE_BAND, -1 if never
+	unsigned long saturatedTicks;	// updates with the PID output limited
+	unsigned long durationMs;	// ms of the last update
+} moveMetricsType;
+
+typedef struct {
+	bool recording;				// set by the move start, the move end is reported by the motion task
+	int servoId;
+	bool dumpTicks;				// send the recorded ticks with the metrics
+	int startPosition;
+	int targetPosition;
+	int numTicks;
+	unsigned long droppedTicks;	// updates beyond MOVE_RECORD_TICKS
+	unsigned long updates;		// updates with measured cpu time
+	unsigned long totalUpdateUs;
+	unsigned long maxUpdateUs;
+	moveTickType tick[MOVE_RECORD_TICKS];
+} moveRecordType;
+
+extern void moveMetricsStart(moveMetricsType *metrics, int startPosition, int targetPosition);
+
+extern void moveMetricsAdd(moveMetricsType *metrics, unsigned long ms, int currentPosition,
+	float wantedPosition, bool saturated);
+
+extern float moveMetricsRmsError(const moveMetricsType *metrics);
+
+extern void moveRecordStart(moveRecordType *record, int startPosition, int targetPosition);
+
+extern void moveRecordTick(moveRecordType *record, unsigned int ms, int magnetAngle, int currentPosition,
+	float wantedPosition, unsigned char writePosition);
+
+// cpu time of one update call
+extern void moveRecordUpdateTime(moveRecordType *record, unsigned long updateUs);
+
+// metrics of the recorded ticks
+extern void evalMoveMetrics(const moveRecordType *record, moveMetricsType *metrics);
+
+#endif
@@ -1,62 +1,190 @@
 
 #include <Arduino.h>
 #include "readMessages.h"
+#include "hostPort.h"
 
-char receivedChars[64];
-int numChars = 0;
-bool newData = false;
+char receivedChars[MESSAGE_BUFFER_SIZE];	// the line currently received
 byte ndx = 0;
+bool lineTruncated = false;
+
+// sequence number <command>#<seq> at the end of the line currently received, followed while receiving
+// so it survives the truncation of an overlong line
+bool rxSeqMarker = false;	// '#' received, only digits since
+long rxSeq = 0;
+int rxSeqDigits = 0;
+
+// received lines waiting for execution, stop commands are put in front of the other lines
+typedef struct {
+	char chars[MESSAGE_BUFFER_SIZE];
+	unsigned long rxMicros;		// micros when the end marker of the line was received
+	long seq;					// sequence number of the line, -1 for none
+	bool truncated;
+	bool superseded;			// move request received before a stop of the servo
+} queuedLineType;
+
+#define LINE_QUEUE_SIZE (COMMAND_QUEUE_LINES + COMMAND_STOP_SLOTS)
+
+queuedLineType lineQueue[LINE_QUEUE_SIZE];
+int queueHead = 0;		// index of the next line to execute
+int queuedLines = 0;
+int queuedStops = 0;	// stop commands at the head of the queue
+
+// a complete line in receivedChars without room in the queue, the reading pauses until it is queued
+bool lineHeld = false;
+unsigned long heldRxMicros;
+
+long commandSeq = -1;
+unsigned long commandRxMicros;
+bool commandTruncated = false;
+bool commandSuperseded = false;
 
 bool log_r0 = false;
 
-// fill buffer with message
-// when newData flag is set to true, data is processed in inmoovArduino
+// stop servo (2) and stop all servos (3) bypass the other queued commands
+bool isStopCommand(const char *line) {
+	return (line[0] == '2' || line[0] == '3')
+		&& (line[1] == ',' || line[1] == '#' || line[1] == '\0');
+}
+
+// a move request queued before a stop command must not be executed after the stop
+// stop all (3) supersedes all queued moves (1), joint group moves (g) and autotune requests (a),
+// stop servo (2) the moves of its pin
+bool isSupersededBy(const char *line, const char *stopLine) {
+	if (stopLine[0] == '3') {
+		return line[0] == '1' || line[0] == 'g' || line[0] == 'a';
+	}
+	return line[0] == '1' && line[1] == ',' && atoi(&line[2]) == atoi(&stopLine[2]);
+}
+
+void queueLine(unsigned long rxMicros) {
+
+	int slot;
+	if (isStopCommand(receivedChars)) {
+		for (int i = queuedStops; i < queuedLines; i++) {
+			queuedLineType *line = &lineQueue[(queueHead + i) % LINE_QUEUE_SIZE];
+			if (isSupersededBy(line->chars, receivedChars)) {
+				line->superseded = true;
+			}
+		}
+
+		// behind the already queued stops but before any other command
+		slot = (queueHead + queuedStops) % LINE_QUEUE_SIZE;
+		for (int i = queuedLines; i > queuedStops; i--) {
+			lineQueue[(queueHead + i) % LINE_QUEUE_SIZE] = lineQueue[(queueHead + i - 1) % LINE_QUEUE_SIZE];
+		}
+		queuedStops++;
+	} else {
+		slot = (queueHead + queuedLines) % LINE_QUEUE_SIZE;
+	}
+	strcpy(lineQueue[slot].chars, receivedChars);
+	lineQueue[slot].rxMicros = rxMicros;
+	lineQueue[slot].seq = rxSeqMarker && rxSeqDigits > 0 ? rxSeq : -1;
+	lineQueue[slot].truncated = lineTruncated;
+	lineQueue[slot].superseded = false;
+	queuedLines++;
+}
 
-void recvWithEndMarker() {
+// the stop slots keep room for stop commands when the other lines have filled the queue
+bool hasQueueRoom(const char *line) {
+	if (queuedLines == LINE_QUEUE_SIZE) {
+		return false;
+	}
+	return isStopCommand(line) || queuedLines - queuedStops < COMMAND_QUEUE_LINES;
+}
+
+void queueReceivedLine(unsigned long rxMicros) {
+	queueLine(rxMicros);
+	ndx = 0;
+	lineTruncated = false;
+	rxSeqMarker = false;
+}
+
+// move the received bytes into the line queue
+// a line without room in the queue is held and the following bytes stay in the receive buffer of the port
+void receiveCommands() {
 	char rc;
 
-	while (Serial.available() > 0 && newData == false) {
-		rc = Serial.read();
-		
+	if (lineHeld) {
+		if (!hasQueueRoom(receivedChars)) {
+			return;
+		}
+		queueReceivedLine(heldRxMicros);
+		lineHeld = false;
+	}
+
+	while (hostPort->available() > 0) {
+		rc = hostPort->read();
+
 		if (rc == 0) continue;		// do not know why I get zero values ???
 
 		if (rc != '\n') {
+			if (rc == '#') {
+				rxSeqMarker = true;
+				rxSeq = 0;
+				rxSeqDigits = 0;
+			} else if (rxSeqMarker && rc >= '0' && rc <= '9' && rxSeq <= (2147483647L - (rc - '0')) / 10) {
+				rxSeq = rxSeq * 10 + (rc - '0');
+				rxSeqDigits++;
+			} else {
+				rxSeqMarker = false;	// not the trailing sequence number
+			}
 			receivedChars[ndx] = rc;
 			ndx++;
-			if (ndx >= 60) {
-				ndx = 59;
+			if (ndx >= MESSAGE_BUFFER_SIZE - 4) {
+				ndx = MESSAGE_BUFFER_SIZE - 5;
+				lineTruncated = true;
 			}
-			numChars = ndx;
 		}
 		else {
 			receivedChars[ndx] = '\0'; // terminate the string
-			ndx = 0;
-			newData = true;
+			if (!hasQueueRoom(receivedChars)) {
+				lineHeld = true;
+				heldRxMicros = micros();
+				return;
+			}
+			queueReceivedLine(micros());
 		}
 	}
 }
 
+bool isStopCommandQueued() {
+	return queuedStops > 0;
+}
 
 
 int checkCommand() {
 
-	if (Serial.available() > 0) {
-		recvWithEndMarker();
-		//standalone: SerialMonitor, select Line Feed and send command, 
-		// e.g. 1,1,200,2000 for go forward 2000 mm with speed 200
-	}
+	receiveCommands();
+	//standalone: SerialMonitor, select Line Feed and send command,
+	// e.g. 1,1,200,2000 for go forward 2000 mm with speed 200
 
-	if (newData) {
+	if (queuedLines > 0) {
+
+		queuedLineType *line = &lineQueue[queueHead];
+		queueHead = (queueHead + 1) % LINE_QUEUE_SIZE;
+		queuedLines--;
+		if (queuedStops > 0) {
+			queuedStops--;
+		}
+
+		// optional sequence number of the host: <command>#<seq>, removed before parsing
+		// the number was taken while receiving, the marker of a truncated line might be lost
+		commandSeq = line->seq;
+		char *seqMarker = strrchr(line->chars, '#');
+		if (seqMarker != NULL) {
+			*seqMarker = '\0';
+		}
+		commandRxMicros = line->rxMicros;
+		commandTruncated = line->truncated;
+		commandSuperseded = line->superseded;
 
-		char mode = receivedChars[0];
-		strncpy(msgCopyForParsing, receivedChars, numChars);
-		msgCopyForParsing[numChars] = '\n';
+		char mode = line->chars[0];
+		strcpy(msgCopyForParsing, line->chars);
 		if (log_r0) {
-			Serial.print("r00 received chars: "); Serial.print(receivedChars);
-			Serial.print(", numChars: "), Serial.print(numChars); Serial.println();
-			Serial.print("r01 msgCopyForParsing: "); Serial.print(msgCopyForParsing); Serial.println();
+			hostPort->print("r00 received chars: "); hostPort->print(line->chars);
+			hostPort->print(", queued lines: "), hostPort->print(queuedLines); hostPort->println();
+			hostPort->print("r01 msgCopyForParsing: "); hostPort->print(msgCopyForParsing); hostPort->println();
 		}
-		newData = false;
 
 		return mode;
 	}
@@ -8,7 +8,29 @@
 
 #endif
 
+#define MESSAGE_BUFFER_SIZE 100		// max length of a received command line including terminator
+#define COMMAND_QUEUE_LINES 16		// received lines waiting for execution
+#define COMMAND_STOP_SLOTS 4		// additional queue slots only used by stop commands
+
 extern bool verbose;
-extern char msgCopyForParsing[64];
+extern char msgCopyForParsing[MESSAGE_BUFFER_SIZE];
+
+// the sequence number, receive time and truncation of the last command returned by checkCommand
+// commandSeq is -1 for commands without sequence number
+extern long commandSeq;
+extern unsigned long commandRxMicros;
+extern bool commandTruncated;
+extern bool commandSuperseded;		// a move request received before a stop of its servo, not to be executed
+
+// receive available bytes into the line queue, can be called during waits
+// with COMMAND_QUEUE_LINES waiting one more line is read: a stop goes into a stop slot, any other line
+// is held and the reading pauses until the queue has room for it
+void receiveCommands();
+
+// a stop command (2 or 3) is waiting, it is returned by the next checkCommand
+// stop commands are returned before the other queued lines, move requests received before
+// the stop are marked with commandSuperseded
+bool isStopCommandQueued();
 
+// return the mode of the next queued command line and copy it to msgCopyForParsing, 'x' for none
 int checkCommand();
@@ -0,0 +1,118 @@
+#include <Arduino.h>
+#include "scheduler.h"
+#include "hostPort.h"
+
+unsigned long schedulerIdleUs = 0;		// time of scheduler passes without a due task
+unsigned long schedulerIdlePasses = 0;
+unsigned long schedulerStartUs = micros();	// start of the statistics period
+
+
+// rank of a due task, the lowest rank runs first
+// priority 0 tasks keep the servo timing and always go first. A task a full period past its deadline
+// ages: it competes with the other late tasks by deadline ahead of all tasks on time, so a busy high
+// priority task (commands under sustained host traffic) can not starve the low priority tasks.
+static int schedulingRank(const taskType *task, unsigned long now) {
+	if (task->priority == 0) {
+		return 0;
+	}
+	if (task->periodMs > 0 && (long)(now - task->nextRunMillis) >= (long)task->periodMs) {
+		return 1;
+	}
+	return 1 + task->priority;
+}
+
+void runScheduler(taskType *taskList, int numTasks) {
+
+	unsigned long passStartUs = micros();
+	unsigned long now = millis();
+
+	// find the most urgent due task
+	int taskIndex = -1;
+	int taskRank = 0;
+	for (int t = 0; t < numTasks; t++) {
+		if ((long)(now - taskList[t].nextRunMillis) < 0) {
+			continue;		// not due yet
+		}
+		int rank = schedulingRank(&taskList[t], now);
+		if (taskIndex == -1
+			|| rank < taskRank
+			|| (rank == taskRank
+				&& (long)(taskList[t].nextRunMillis - taskList[taskIndex].nextRunMillis) < 0)) {
+			taskIndex = t;
+			taskRank = rank;
+		}
+	}
+
+	if (taskIndex == -1) {
+		schedulerIdlePasses += 1;
+		schedulerIdleUs += micros() - passStartUs;
+		return;
+	}
+
+	taskType *task = &taskList[taskIndex];
+
+	// next deadline, do not try to catch up on missed periods
+	if ((long)(now - task->nextRunMillis) >= (long)task->periodMs && task->periodMs > 0) {
+		task->lateRuns += 1;
+		task->nextRunMillis = now + task->periodMs;
+	} else {
+		task->nextRunMillis += task->periodMs;
+	}
+
+	unsigned long taskStartUs = micros();
+	task->taskFunction();
+	unsigned long taskUs = micros() - taskStartUs;
+
+	task->runs += 1;
+	task->totalUs += taskUs;
+	if (taskUs > task->maxUs) {
+		task->maxUs = taskUs;
+	}
+	if (taskUs > task->budgetUs) {
+		task->overruns += 1;
+	}
+}
+
+
+void reportTaskStats(taskType *taskList, int numTasks, bool resetStats) {
+
+	for (int t = 0; t < numTasks; t++) {
+		hostPort->print("i80 task "); hostPort->print(taskList[t].taskName);
+		hostPort->print(", runs: "); hostPort->print(taskList[t].runs);
+		hostPort->print(", overruns: "); hostPort->print(taskList[t].overruns);
+		hostPort->print(", late: "); hostPort->print(taskList[t].lateRuns);
+		hostPort->print(", maxUs: "); hostPort->print(taskList[t].maxUs);
+		hostPort->print(", avgUs: ");
+		if (taskList[t].runs > 0) {
+			hostPort->print(taskList[t].totalUs / taskList[t].runs);
+		} else {
+			hostPort->print(0);
+		}
+		hostPort->println();
+	}
+
+	unsigned long periodUs = micros() - schedulerStartUs;
+	hostPort->print("i81 scheduler idle us: "); hostPort->print(schedulerIdleUs);
+	hostPort->print(", periodUs: "); hostPort->print(periodUs);
+	hostPort->print(", idle %: ");
+	if (periodUs > 0) {
+		hostPort->print(100.0 * schedulerIdleUs / periodUs);
+	} else {
+		hostPort->print(0);
+	}
+	hostPort->print(", idle passes: "); hostPort->print(schedulerIdlePasses);
+	hostPort->println();
+
+	if (resetStats) {
+		for (int t = 0; t < numTasks; t++) {
+			taskList[t].runs = 0;
+			taskList[t].overruns = 0;
+			taskList[t].lateRuns = 0;
+			taskList[t].maxUs = 0;
+			taskList[t].totalUs = 0;
+		}
+		schedulerIdleUs = 0;
+		schedulerIdlePasses = 0;
+		schedulerStartUs = micros();
+	}
+}
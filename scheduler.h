@@ -0,0 +1,37 @@
+
+#ifndef scheduler_h
+#define scheduler_h
+
+#include "Arduino.h"
+
+typedef void (*taskFunctionType)();
+
+// cooperative tasks, run from loop() by runScheduler
+typedef struct {
+	char taskName[16];
+	taskFunctionType taskFunction;
+	unsigned int periodMs;		// the task is due every periodMs
+	byte priority;				// 0 is the highest priority
+	unsigned long budgetUs;		// expected max run time, longer runs are counted as overrun
+
+	// runtime data
+	unsigned long nextRunMillis;	// deadline of the next run
+	unsigned long runs;
+	unsigned long overruns;		// runs longer than budgetUs
+	unsigned long lateRuns;		// runs started a full period after their deadline
+	unsigned long maxUs;		// longest run
+	unsigned long totalUs;		// sum of all run times
+} taskType;
+
+extern unsigned long schedulerIdleUs;
+extern unsigned long schedulerIdlePasses;	// scheduler passes without a due task
+extern unsigned long schedulerStartUs;
+
+// run the most urgent due task: highest priority first, earliest deadline within the same priority
+// tasks a full period past their deadline go before the tasks on time, except priority 0
+extern void runScheduler(taskType *taskList, int numTasks);
+
+// send the task statistics and the idle time, optionally reset the counters
+extern void reportTaskStats(taskType *taskList, int numTasks, bool resetStats);
+
+#endif
@@ -10,6 +10,10 @@ char version[10] = "v2.50";		// use PID control for feedback servos
  This is software that runs on an arduino mega.
  For other boards you might need to adjust the number of servos that can be handled
 
+ skeletonControl is connected over the programming port (115200 baud) or the native usb port of the Due.
+ Which one is used is set with HOST_PORT_SELECTION in hostPort.h, by default the native usb port is used
+ when the host opens it within 1.5 s after boot, the programming port otherwise.
+
  It is using the arduino servo library to control the servos, making it easy to understand and modify
  and does not limit number of servos to PWM ports.
 
@@ -18,8 +22,8 @@ char version[10] = "v2.50";		// use PID control for feedback servos
  this range.
 
  All move requests need to be timed in milliseconds and the servo increments are devided into 20 ms sub steps
- The "standard" inmoovServoControl software expects servo definitions including maximum move speed.
- inmoovServoControl will increase requested move times if given move time is below the servo spec
+ With maxSpeed/maxAccel given in the servo assign the requested move time is increased if it is below the
+ servo spec and the effective duration is reported back. A duration of 0 requests the fastest safe move.
 
  It is expected that the controlling application maintains persistance of last position for each servo.
 
@@ -67,18 +71,26 @@ char version[10] = "v2.50";		// use PID control for feedback servos
  =======================================================================================================
 
  Accepted commands:
- servoAssign:  0,<servoId>,<pin>,<minPosition>,<maxPosition>,<restPosition>,<autoDetachMs>,<inverted><lastPos>
-	servoId: unique servoId per Arduino from inmoovServoControl.servoList
+ servoAssign:  0,<servoName>,<pin>,<minPosition>,<maxPosition>,<restPosition>,<autoDetachMs>,<inverted>,<lastPos>,<servoPowerPin>[,<maxSpeed>,<maxAccel>]
+	servoName: name of the servo for logs
 	minPosition: a value between 0 and 180, degrees to position calculation has to be done by caller
 	maxPosition: a value between 0 and 180, minPosition has to be lower than maxPosition
 	autoDetachMs: after target reached this is the wait time until detach of the servo, 0 for never detach
 	inverted: before servo.write() position will be subtracted from 180 making the servo move opposite
+	maxSpeed: optional, max positions per second, 0 for no limit
+	maxAccel: optional, max positions per second^2, 0 for no limit
+		moves requested faster than the limits allow are stretched (trapezoidal speed profile with maxAccel)
+		verbose servos report the stretched duration with i07
 
  servoMoveTo:  1,<servoId>,<position>,<duration>
 	servoId: unique servoId per Arduino from inmoovServoControl.servoList
 	position: a value between 0 and 180, degrees to position calculation done in inmoovServoControl
 		the code checks for requests < minPosition, > maxPosition and limits value accordingly
 	duration: ms for the move. servos move in 20 ms steps from current position to target position
+		a request for a servo that is still moving does not stop it, the running move is blended from its
+		current planned position and velocity into the new target (no stop status, verbose servos log w03)
+		the blend duration is stretched until its peak speed and acceleration fit maxSpeed/maxAccel (i07),
+		it is not shaped by the input shaper
 
 stop servo: 2,<servoId>
 	servoId: unique servoId per Arduino from inmoovServoControl.servoList
@@ -104,6 +116,247 @@ change log level for servo: 7,<servoId>,<newState>
 		sets the verbose flag of a servo
 			setting the verbose flag to true may impact the timing
 
+servo feedback definitions: 8,<pin>,<i2cMultiplexerAddress>,<i2cMultiplexerChannel>,<feedbackMagnetOffset>,<feedbackInverted>,<degPerPos>,<kp>,<ki>,<kd>[,<kv>,<integralLimit>,<outputLimit>,<maxMagnetSpeed>]
+	kp, ki, kd: PID gains, the PID runs every 20 ms and ki/kd are based on this update period
+		the derivative part is taken from the measured position
+	kv: optional velocity feedforward, factor for the planned position change per update period
+	integralLimit: optional max integral part in positions (anti-windup)
+	outputLimit: optional max correction of the wanted position in positions
+	maxMagnetSpeed: optional max sensor rotation in degrees per second, default 4500, 0 for no limit
+	the sensor angle is unwrapped by the shortest change between two reads, any number of turns
+	in both directions. Changes faster than maxMagnetSpeed are rejected as read faults (w06),
+	after 3 rejected reads in a row the new angle is accepted. The absolute angle is kept across
+	moves and shared with the idle monitoring, the definitions reset it. The count of rejected
+	reads is reported with the idle monitoring (o,<pin>).
+
+servo current estimate: 9,<pin>,<startCurrentMa>,<runCurrentMa>,<startPhaseMs>
+	startCurrentMa: estimated current in the first startPhaseMs of a move (close to stall current)
+	runCurrentMa: estimated current for the rest of the move
+
+power group current budget: b,<powerPin>,<budgetMa>
+	budgetMa: max estimated current of all moving servos in the power group, 0 for no limit
+		a move request that would exceed the budget is queued until servos in the group
+		have passed their start phase. Queued requests are started in order of arrival.
+
+position model: m,<pin>,<lagMs>,<maxSpeed>
+	for servos without feedback sensor the physical position is modelled as first order lag
+	with time constant lagMs followed by a slew limit of maxSpeed positions per second (0: not used).
+	The modelled position is reported in the status messages, "target reached" and the autoDetach
+	time are based on the modelled arrival instead of the last position written to the servo.
+	After a stop the model keeps following the last written position, the stop status and later
+	status requests and moves take the modelled position.
+
+define joint group: d,<groupName>,<pin>,..<pin>
+	groupName: up to 19 characters, an existing group with this name is replaced
+		up to 8 groups with up to 8 assigned servos each
+
+joint group move: g,<groupName>,<duration>,<position member 1>,..<position member n>
+	duration: min duration of the move, 0 for the fastest move the members' motion limits allow
+		all members move with one common duration: the longest of the requested duration and the
+		min durations of the members (maxSpeed/maxAccel of servo assign), so they arrive together.
+		For members still moving the stretched duration of their blend is taken (servoMoveTo).
+		Instead of the target reached status of each member one i90 event is sent for the group.
+		It counts the members stopped (stop command, max duration) or blocked (e10) on the way,
+		the group has only reached its target with both counts 0.
+		Members queued by the power group current budget start and arrive later.
+
+stall detection: k,<pin>,<windowTicks>,<errorLimit>,<velocityPercent>
+	for feedback servos, an update counts as stalled when the joint is at least errorLimit positions
+	behind the wanted position and moves slower than velocityPercent of the planned speed or does not
+	move with a saturated PID output. After windowTicks stalled updates (20 ms each) the servo is stopped
+	and detached, e10 is sent and the status byte has the blocked bit (0x40) set.
+	windowTicks 0 disables the detection. Defaults: 10, 5, 25
+
+PID autotune: a,<pin>,<relayAmplitude>,<cycles>[,<experiment>]
+	relayAmplitude: the servo is switched between its current position +/- relayAmplitude
+		(moved into the min/max range if needed) whenever the measured position crosses the center
+	cycles: number of measured oscillation periods
+		before the relay oscillation the write position is ramped up slowly to find the deadband
+		the result (i85) reports ultimate gain and period, suggested kp/ki/kd (Ziegler-Nichols),
+		the lag between relay switch and joint reversal and the deadband. The values are not applied,
+		send them with the feedback definitions (8) if they are fine.
+		failure reasons (e85): 1 out of min/max, 2 no motion, 3 no oscillation, 4 timeout
+	experiment: 0 (default) relay feedback for the PID values, 1 backlash sweep
+		the sweep ramps the write position slowly up, down, up and up again (max relayAmplitude each)
+		and holds it after each ramp until the joint has settled. The result (i85) reports the
+		backlash (write change minus settled joint change over the reversal ramps), the deadband
+		(continuation ramp) and the ramp offsets. The deadband includes the overrun of the ramp
+		through the servo lag, the backlash the part of the servo deadband the horn stops short
+		of the write position, send them (or a bit less) with the slack compensation (j).
+
+motion programs: z,<program>,<action>[,<offset>,<hexBytes>]
+	2 programs of up to 256 bytes run on the board without the host (idle breathing, blinking, waving),
+	one after each other every 20 ms with at most 32 instructions per run, waits end the run.
+	action 0: clear, 1: load the hex bytes (2 hex digits per byte, anything else is rejected with e22)
+		at offset, offset must be the current length (lost lines are detected), 2: start, 3: stop,
+		4: report (i03)
+	instructions, see motionProgram.h: END, MOVE, MOVER, WAIT, WAITR, ARRIVE, SET, ADD, RAND, POS,
+		JMP, DJNZ, JLT, JGT (8 registers, loops, random values, wait for arrival, branches on the
+		measured position). host/mpasm assembles a program from the mnemonics into these commands.
+		The random values are seeded at boot from the noise of analog input A0.
+	moves are requested like command 1. Stop all (3) and the emergency stop end the programs.
+	an invalid instruction, register, jump target or servo stops the program (e22 with error and pc):
+		1 opcode, 2 instruction beyond the end, 3 register, 4 jump target, 5 servo or move rejected
+	example, wave pin 7 three times: z,0,0 / z,0,1,0,060003000107469001 / z,0,1,9,050701076E90010507 /
+		z,0,1,18,0B00040000 / z,0,2 (SET r0 3; MOVE 7,70,400; ARRIVE 7; MOVE 7,110,400; ARRIVE 7;
+		DJNZ r0 4; END)
+
+teach mode: w,<periodMs>,<pin>[,<pin>...]
+	detaches up to 8 feedback servos so the arm can be guided by hand and samples their sensors
+	every periodMs (5 and more) into a ring of 200 samples. w,0 ends the teach mode, the remaining
+	samples are sent before the end message. Move requests for the servos are rejected (e09).
+	the samples are streamed with one line per servo and block of up to 25 samples:
+	W<pin>,<ms>,<position>[,<delta>|,=<count>]...
+		ms: millis of the first sample, the next samples follow every periodMs, a gap in the sample
+		times starts a new line. position: first sample in tenths of a position, then the change to
+		the previous sample, =<count> for count samples without change
+	on the programming port up to 80 bytes are sent every 10 ms, a longer line alone, the lines of a
+	block continue in the next run. Samples lost with a full ring
+	are counted. Start and end (samples, dropped samples, lines, bytes) are reported with i09.
+
+calibration tables: u,<pin>,<table>[,<x>,<y>]
+	piecewise linear tables of up to 10 points, uploaded once with one point per line, a point with
+	an existing x replaces its value. Without the point the table is cleared. Between the points the
+	value is interpolated, outside the end segments are extended, tables with less than 2 points
+	are not used.
+	table 0: joint position (0..180 as in the move requests) -> value written to the servo,
+		0..180 degrees or the pulse width in us (544 and more). The table replaces the inversion.
+	table 1 (feedback servos): sensor angle in degrees -> joint position, replaces degPerPos and
+		the position reference (6 has no effect on the measured position). The angles of the table
+		must span less than a full turn, the first read selects the turn within the table.
+		The sensor angles of known positions can be taken from a move record (r, i87).
+	the table is reported after each change (i08)
+
+closed loop hold: n,<pin>,<holdMs>[,<kp>,<ki>,<deadband>,<periodMs>]
+	for feedback servos: after the arrival the measured position is kept on the target by a slow
+	PI loop, loaded joints do not sag until the autoDetach. The servo stays in the motion task and its
+	power group stays on during the hold. A new move, a stop or n,<pin>,0 ends the hold.
+	holdMs: 0 no hold (default), -1 until the next request, otherwise the hold time after the arrival
+	kp, ki: hold gains, ki per hold period (defaults 0.5, 0.1), integralLimit and outputLimit of
+		the feedback definitions apply
+	deadband: no correction while the joint is within this distance of the target (default 1)
+	periodMs: hold period, at least 20 (default 100)
+	while holding, a feedback status message is sent whenever the measured or the written position
+	changes: the ms field holds the ms since the last change of the hold correction, written position,
+	and the target as wanted position. The hold error is wanted position - position, there is no
+	separate field for it.
+	the values are reported (i29), the end of the hold with i13 (verbose)
+
+backlash and deadband compensation: j,<pin>,<backlash>,<deadband>
+	for feedback servos, in positions, 0 for no compensation
+	backlash: after a reversal of the error direction the write position leads by half the backlash
+		to take up the gear slack
+	deadband: for errors of at least one position the write position stays at least the deadband
+		(plus half the backlash) away from the joint, small corrections do not get lost in the servo
+	the values are reported (i28)
+
+idle monitoring: o,<pin>[,<driftThreshold>]
+	the sensors of idle feedback servos (no move request) are read in the background, one servo
+	every 100 ms with low priority. currentPosition follows joints moved by gravity or by hand,
+	a change of more than driftThreshold positions is reported with w05 and a status message.
+	driftThreshold: default 3, 0 disables the idle monitoring of the servo, without it the
+		current value is kept
+	i24 replies with the threshold and the sensor reads rejected since boot (magnetFaults, w06)
+
+gravity feedforward: f,<pin>[,<learnPercent>[,<ff0>,<ff1>,...,<ff7>]]
+	for feedback servos: position dependent correction in positions added to the PID output, for joints
+	with a load that depends on the pose (shoulder, omoplate, bicep). The 8 values are spread evenly
+	over min..max and interpolated in between, positive values move the written position up.
+	learnPercent: 0 keeps the table, otherwise this share of the PID integral part at the arrival
+		of a move is added to the table (needs ki > 0), each value is limited to +-outputLimit
+		(command 8). Read back the learned table with f,<pin>
+		and upload it with the values after a restart.
+	without the values the table is kept, with only the pin it is reported (i25)
+
+input shaper: v,<pin>,<shaperType>[,<frequencyHz>,<damping>]
+	suppresses the ringing of long and light limbs after fast moves, the planned position stream
+	of all following moves is shaped before it is written to the servo
+	shaperType: 0 off, 1 ZV (2 impulses, moves get longer by half a period of the oscillation),
+		2 ZVD (3 impulses, a full period longer, tolerates a less exact frequency)
+	frequencyHz, damping: natural frequency and damping ratio (0..<1) of the ringing, e.g. taken
+		from a move record (r) of a feedback joint. Compare the overshoot and settle time of the
+		move records with and without the shaper, then shorten the move durations.
+	the shaper impulses and the added move time are reported (i27)
+	a move blended into a new target while moving (1) is not shaped, it keeps the shaped velocity
+	of the interrupted move at the change and ends without the added time
+
+end of move record of feedback servos (not a command):
+	M<pin>,<endReason>,<durationMs>,<maxError>,<rmsError>,<overshoot>,<settleMs>,<saturatedTicks>,<ticks>
+	sent at the end of each move of a feedback servo, endReason 0: target reached, 1: stop command,
+	2: stalled (e10), 3: max duration exceeded. maxError/rmsError: wanted versus measured position
+	over the 20 ms updates, overshoot: positions beyond the target, settleMs: time when the position
+	stayed within 2 positions of the target (-1 if never), saturatedTicks: updates with the PID output
+	limited. Switched off with log_moveMetrics in Mai3Servo.cpp.
+
+record move: r,<pin>[,<dumpTicks>]
+	the next move of the servo is recorded per 20 ms update (up to 5 s): ms in move, AS5600 angle
+	(-1 without feedback), measured or modelled position, wanted position and written position.
+	At the end of the move i86 reports the RMS error of wanted versus measured position, the overshoot
+	beyond the target, the settle time (staying within 2 positions of the target, -1 if never) and the
+	average/max cpu time of the servo updates. dumpTicks: 1 to send the records as
+	i87 <ms>,<angle>,<position>,<wantedPosition>,<writePosition> before the i86 summary.
+
+simulated feedback: s,<pin>,<simulated>[,<refAngle>]
+	for feedback servos: 1 replaces the AS5600 with a simulated joint, 0 returns to the sensor
+	the simulated joint follows the written position with the position model of the servo
+	(m command, lag and max speed) and the sensor angle changes by degPerPos per position.
+	refAngle: sensor angle at the current position, default 350 to cross the sensor overflow
+	Used with the move record to compare control changes with repeatable numbers on a bare board.
+
+scheduler statistics: t,<reset>
+	reset: 1 to reset the counters after sending them
+		sends runs, overruns (runs longer than the task budget), late runs, max and average run time
+		per task of the task table and the scheduler idle time and idle passes
+
+command sequence numbers: <command>#<seq>
+	any command can be followed by #<seq>, seq: 0..2147483647 chosen by the host
+	a command with sequence number is acknowledged after its execution with
+		A<seq>,<rxMicros>,<execMicros>	rxMicros: board micros when the line was received,
+										execMicros: board micros when the execution started
+	or rejected with
+		N<seq>,<rxMicros>,<reason>		reason 1: line too long (not executed), 2: unknown command,
+										3: superseded by a stop command (not executed)
+	the sequence number is taken while the line is received, a line too long keeps it
+	the host can retransmit a command with the same sequence number when neither arrives in time
+
+stop commands: 2 and 3 are executed before the other received commands, also while the servo updates
+	and waits for the power up of a power group are running. Their latency from receive to all servos
+	stopped is part of the latency statistics (i96).
+	Move requests (1) of the stopped servo, with stop all also joint group moves (g) and autotune
+	requests (a), received before the stop but not executed yet are ignored (w04).
+	With 16 lines waiting for execution one more line is read: a stop takes one of 4 slots kept for
+	stops, any other line waits there and a stop behind it is read once a queued line has been executed.
+
+emergency stop input: e,<pin>
+	pin: input with internal pullup, pulled to ground the interrupt switches all power groups off,
+		all servos are then stopped and detached (e11). Move and autotune requests are rejected (e12)
+		while the input is low. -1 removes the emergency stop input.
+		The time from the interrupt to all servos stopped is part of the stop latency statistics (i96).
+
+traffic capture: c,<captureOn>
+	captureOn: 1 to copy all traffic of the host port to the programming port, 0 to stop
+		only possible with the host connected to the native usb port (e14 otherwise)
+		capture format, one record per line, micros of the board when the line was complete:
+			<micros> H <command line>			host -> board
+			<micros> B <text message>			board -> host
+			<micros> F <frame bytes as hex>		board -> host, binary status frame without terminator
+		A capture can be replayed by sending the H lines at their recorded time offsets and compared
+		with the recorded B/F records, host/replay does it with a host build of the firmware.
+		The programming port runs at 115200 baud, long captures with many moving servos need to be
+		taken at lower status rates.
+
+ping: p,<hostStamp>[,<rttUs>]
+	hostStamp: any unsigned number of the host, returned with P<hostStamp>,<boardMicros>
+	rttUs: optional round trip time the host measured with the previous ping, added to the board statistics
+
+latency statistics: q,<reset>
+	reset: 1 to reset the counters after sending them
+		sends the histograms of the command latency (receive of the line to end of execution, i93)
+		and of the reported ping round trip times (i94), the number of acks/nacks (i95)
+		and the stop latency of stop commands and the emergency stop (i96)
+		and the traffic counters and rates of the host port (i97)
+		histogram bins: <64 us, 64..127 us, 128..255 us, .. doubling .., >= 65536 us
+
 
 
 logs:
@@ -116,24 +369,55 @@ e02 no action, servo not attached
 e03 servo set verbose for unknown servo
 
 e04 maxPosition < minPosition
+e05 command line too long, ignored
 e06 moveTo received but servo is not attached
+e07 ping without host stamp
+e08 calibration table error
+e09 teach mode error
+e10 feedback servo blocked, stopped and detached
+e11 emergency stop
+e12 request rejected while emergency stop is active
+e13 emergency stop definition error
+e14 traffic capture not possible
+e15 idle monitoring definition error
+e16 gravity feedforward definition error
+e17 input shaper definition error
+e18 slack compensation definition error
+e19 hold definition error
 
 w01 requested position smaller than min
 w02 requested position greater than max
-w03 new move request while still in move 
+w03 new move request while still in move (blended into the new target, verbose)
+w04 move request superseded by a stop command
+w05 idle position drift of a feedback servo
+w06 magnet angle change too fast, sensor read rejected
 
 i01 request to move to current position
+i02 selected host port
+i03 motion program state
+i07 effective move duration with motion limits (only stretched moves of verbose servos)
+i08 calibration table
+i09 teach mode started / ended
 i10 request to move to new position
 i11 target reached
 i12 arrived time in the future
-i13 detach servo
+i13 detach servo / hold ended
 i14 set servo last position before powerup
 i15 partial steps
 i16 next planned position
+i18 position model parameters
+i19 stall detection parameters
 
 i20 new autoDetach value received 
 i21 servo stop received
 i22 stop all servos received
+i23 emergency stop pin
+i24 idle monitoring threshold and sensor read faults
+i25 gravity feedforward table
+i26 gravity feedforward learned (servo verbose)
+i27 input shaper impulses
+i28 backlash and deadband compensation
+i29 hold parameters
 
 i30 digital pin set to HIGH
 i31 digital pin set to LOW 
@@ -144,6 +428,34 @@ i41 powergroup ON/OFF
 i50 log of incoming messages
 i51 temporary logs for debugging
 
+i70 move queued by power group current budget
+i71 queued move started
+i72 move still queued (servo status request)
+i73 new current estimate or current budget
+
+i90 joint group target reached (with the number of stopped and blocked members)
+i91 joint group defined
+i92 joint group move
+e20 joint group definition error
+e21 joint group move error
+e22 motion program error
+
+i80 scheduler task statistics
+i81 scheduler idle time
+i84 autotune started / rejected (e84)
+i85 autotune or backlash sweep result / failure (e85)
+i86 move record metrics / record request error (e86)
+i87 move record tick
+i88 move record armed
+i89 simulated feedback on/off
+
+i93 command latency histogram
+i94 ping round trip time histogram
+i95 command acks/nacks
+i96 stop latency histogram
+i97 host port traffic statistics
+i98 traffic capture on/off
+
 i6x i2c logs
 
 // logs for servos with servoVerbose set
@@ -157,6 +469,9 @@ bool log_i50=true;
 bool log_i51=true;
 bool log_i52=true;	// feedback definitions
 bool log_i6x=false;	// feedback reads
+bool log_i71=true;	// start of queued moves
+bool log_i80=false;	// periodic scheduler statistics
+bool log_i90=true;	// joint group definitions and moves
 
 #include "Arduino.h"
 
@@ -171,11 +486,33 @@ bool log_i6x=false;	// feedback reads
 #include "readMessages.h"
 #include "writeMessages.h"
 #include "feedback.h"
+#include "currentBudget.h"
+#include "scheduler.h"
+#include "autoTune.h"
+#include "latencyStats.h"
+#include "moveRecord.h"
+#include "inputShaper.h"
+#include "calibration.h"
+#include "teachRecord.h"
+#include "motionProgram.h"
+#include "hostPort.h"
 
 bool verbose = false;
 
-const int NUMBER_OF_SERVOS = 20;		// max number of servos
+const int NUMBER_OF_SERVOS = 48;		// max number of servos
 Mai3Servo servoList[NUMBER_OF_SERVOS];
+servoConfigType servoConfigList[NUMBER_OF_SERVOS];	// definitions of the servos, referenced by servoList[].config
+int activeServoIds[NUMBER_OF_SERVOS];	// servos with a running or queued move request, only these are visited by the motion task
+int numActiveServos = 0;
+
+int eStopPin = -1;						// emergency stop input, -1 for none
+volatile bool eStopTriggered = false;
+volatile unsigned long eStopMicros;		// micros of the emergency stop interrupt
+autoTuneType autoTuneRun;				// one autotune experiment at a time
+moveRecordType moveRecordRun;			// one move record at a time
+teachRecordType teachRun;				// samples of the teach mode
+const int NUMBER_OF_MOTION_PROGRAMS = 2;
+motionProgramType motionPrograms[NUMBER_OF_MOTION_PROGRAMS];	// on-board motion programs
 int servoIdOfPinList[NUMBER_OF_SERVOS];	// list of servoId for assigned pin
 
 const int NUMBER_OF_POWER_PINS = 8;	// number of power sections
@@ -183,39 +520,61 @@ typedef struct {
 	int powerPin;
 	bool powerOn;
 	char powerGroupName[20];
+	int currentBudgetMa;	// max estimated current of the moving servos, 0 for no limit
 } powerGroupType;
 
 powerGroupType powerGroup[NUMBER_OF_POWER_PINS] = {
-	{14, false, "IN1-leftArm"},
-	{15, false, "IN2-leftHand"},
-	{16, false, "IN3-rightArm"},
-	{17, false, "IN4-rightHand"},
-	{18, false, "IN5-head"},
-	{19, false, "IN6-torso"},
-	{19, false, "unused"},
-	{19, false, "unused"}
+	{14, false, "IN1-leftArm", 0},
+	{15, false, "IN2-leftHand", 0},
+	{16, false, "IN3-rightArm", 0},
+	{17, false, "IN4-rightHand", 0},
+	{18, false, "IN5-head", 0},
+	{19, false, "IN6-torso", 0},
+	{19, false, "unused", 0},
+	{19, false, "unused", 0}
 };
 
 char mode = 'x';
+
+// command acknowledgements and link latency
+latencyHistogramType commandLatency;	// receive of the command line to end of its execution
+latencyHistogramType pingRtt;			// round trip times measured by the host with ping
+latencyHistogramType stopLatency;		// receive of a stop command or emergency stop interrupt to all servos stopped
+unsigned long commandAcks = 0;
+unsigned long commandNacks = 0;
 int ledToggle = 0;
 
-char msgCopyForParsing[64];
+char msgCopyForParsing[MESSAGE_BUFFER_SIZE];
 char msg[100];
 
 int arduinoId = 0;
 int assignedServos = 0;
 
-int highMillis;
-int lowMillis;
-unsigned long lastServoUpdateMillis = millis();
+unsigned long highMillis;
+unsigned long lowMillis;
 unsigned long ledToggleMillis = millis();
 
+// loop() runs the tasks of taskList with the cooperative scheduler
+const int NUMBER_OF_TASKS = 9;
+const int TEACH_SAMPLE_TASK = 6;				// index in taskList, the period is set by the teach command
+const unsigned int TEACH_IDLE_PERIOD_MS = 100;	// sample task period without teach mode
+const unsigned long COMMAND_SLICE_US = 2000;	// max time for draining received commands per run
+extern taskType taskList[NUMBER_OF_TASKS];
+
 // the setup function runs once when you press reset, power the board or open the serial connection
 void setup() {
 
-	Serial.begin(115200);
+	beginHostPort();
 	delay(400);
 
+	// RAND of the motion programs, the noise of the open analog input and the time the host took to
+	// open the port give another sequence after each boot
+	randomSeed(analogRead(0) ^ micros());
+
+	for (int i = 0; i < NUMBER_OF_SERVOS; i++) {
+		servoList[i].config = &servoConfigList[i];
+	}
+
 	// S0/S1 MUST BE THE FIRST MESSAGE SENT TO SKELETONCONTROL !!//
 	// check for arduino Id
 	// Arduino 0 (left) has a connection of Pin 50 with Ground
@@ -229,8 +588,9 @@ void setup() {
 		arduinoId = 1;
 	}	
 	// respond with either S0 or S1 as ready response
-	Serial.print("S"); Serial.print(arduinoId);
-	Serial.print(" skeletonControlArduino "); Serial.println(version);
+	hostPort->print("S"); hostPort->print(arduinoId);
+	hostPort->print(" skeletonControlArduino "); hostPort->println(version);
+	hostPort->print("i02 host port: "); hostPort->println(isHostPortUsb ? "native usb" : "programming port");
 
 
 	// check for connection with TCA9548 (i2c multiplexer)
@@ -240,9 +600,9 @@ void setup() {
 
 	Wire.beginTransmission(TCA9548_ADDRESS);
   	if (Wire.endTransmission()==0) {
-    	Serial.println("i60 TCA9548 ready");
+    	hostPort->println("i60 TCA9548 ready");
   	}  else { 
-    	Serial.println("i61 no response from TCA9548");
+    	hostPort->println("i61 no response from TCA9548");
   	}
 
 	// test reading AS5600 data on channel 0
@@ -257,7 +617,7 @@ void setup() {
 
 		// ATTENTION: relais board did not work with 6V power supply, connect board vcc to arduino due 5v!
 		digitalWrite(powerGroup[powerGroupIndex].powerPin, SERVO_POWER_OFF);		// should switch relais off (apply before setting pinmode!)
-		Serial.print("set power pin to OUTPUT: "); Serial.println(powerGroup[powerGroupIndex].powerPin);
+		hostPort->print("set power pin to OUTPUT: "); hostPort->println(powerGroup[powerGroupIndex].powerPin);
 		pinMode(powerGroup[powerGroupIndex].powerPin, OUTPUT);
 	}
 	delay(500);
@@ -276,10 +636,10 @@ void setup() {
 		// set each powergroup on for 1 sec in setup
 		for (int powerGroupIndex = 0; powerGroupIndex < NUMBER_OF_POWER_PINS; powerGroupIndex++) {
 
-			Serial.print("i40 powerPin ON:  "); Serial.println(powerGroup[powerGroupIndex].powerPin);
+			hostPort->print("i40 powerPin ON:  "); hostPort->println(powerGroup[powerGroupIndex].powerPin);
 			digitalWrite(powerGroup[powerGroupIndex].powerPin, SERVO_POWER_ON);		// test power on
 			delay(2000);
-			Serial.print("i40 powerPin OFF: "); Serial.println(powerGroup[powerGroupIndex].powerPin);
+			hostPort->print("i40 powerPin OFF: "); hostPort->println(powerGroup[powerGroupIndex].powerPin);
 			digitalWrite(powerGroup[powerGroupIndex].powerPin, SERVO_POWER_OFF);	// test power off
 			powerGroup[powerGroupIndex].powerOn = false;		
 		}
@@ -291,7 +651,7 @@ void setup() {
 // as commands are given for a pin a translation list pin -> servoId is used
 int servoIdOfPin(int pin) {
 	int servoId = -1;
-	for (int i = 0; i < NUMBER_OF_SERVOS; i++) {
+	for (int i = 0; i < assignedServos; i++) {
 		if (servoIdOfPinList[i] == pin) {
 			return i;
 		}
@@ -299,6 +659,65 @@ int servoIdOfPin(int pin) {
 	return servoId;
 }
 
+// emergency stop input, active low, the interrupt switches all power groups off
+// stopping and detaching the servos is done in the next pollStopCommands
+void emergencyStopISR() {
+	for (int powerGroupIndex = 0; powerGroupIndex < NUMBER_OF_POWER_PINS; powerGroupIndex++) {
+		digitalWrite(powerGroup[powerGroupIndex].powerPin, SERVO_POWER_OFF);
+	}
+	if (!eStopTriggered) {
+		eStopMicros = micros();
+		eStopTriggered = true;
+	}
+}
+
+bool isEmergencyStopActive() {
+	return eStopPin >= 0 && digitalRead(eStopPin) == LOW;
+}
+
+// stop all and the emergency stop end the motion programs, they would start new moves
+void stopMotionPrograms() {
+	for (int p = 0; p < NUMBER_OF_MOTION_PROGRAMS; p++) {
+		if (motionPrograms[p].state != PROGRAM_IDLE && motionPrograms[p].state != PROGRAM_ENDED
+			&& motionPrograms[p].state != PROGRAM_FAILED) {
+			motionProgramStop(&motionPrograms[p]);
+			hostPort->print("i03 motion program stopped: "); hostPort->print(p); hostPort->println();
+		}
+	}
+}
+
+void handleEmergencyStop() {
+
+	stopMotionPrograms();
+
+	for (int i = 0; i < assignedServos; i++) {
+		servoList[i].stopServo();
+		servoList[i].detachServo(true);
+	}
+	for (int powerGroupIndex = 0; powerGroupIndex < NUMBER_OF_POWER_PINS; powerGroupIndex++) {
+		powerGroup[powerGroupIndex].powerOn = false;
+	}
+
+	noInterrupts();
+	unsigned long latencyUs = micros() - eStopMicros;
+	eStopTriggered = false;
+	interrupts();
+
+	addLatencySample(&stopLatency, latencyUs);
+	hostPort->print("e11 emergency stop, all servos stopped and detached, latency us: "); hostPort->print(latencyUs);
+	hostPort->println();
+}
+
+// add the servo to the list of servos updated by the motion task
+void markServoActive(int servoId) {
+	for (int a = 0; a < numActiveServos; a++) {
+		if (activeServoIds[a] == servoId) {
+			return;
+		}
+	}
+	activeServoIds[numActiveServos++] = servoId;
+}
+
 // any move request for a servo has to check for current servo group power
 // if the servo group power is currently off, all servos in the group
 // need to be set to their "currentPosition" and  need to be attached
@@ -313,17 +732,17 @@ void powerUpServoGroup(int servoId) {
 			// check servo's powerGroup state
 			if (powerGroup[powerGroupIndex].powerOn) {
 				if (servoList[servoId].thisServoVerbose) {
-					Serial.print("power already on for power group "); Serial.print(powerGroup[powerGroupIndex].powerGroupName);
-					Serial.print(" by "); Serial.print(servoList[servoId].servoName);
-					Serial.println();
+					hostPort->print("power already on for power group "); hostPort->print(powerGroup[powerGroupIndex].powerGroupName);
+					hostPort->print(" by "); hostPort->print(servoList[servoId].config->servoName);
+					hostPort->println();
 				}
 			} else {
 
 				// activate power relais
 				if (servoList[servoId].thisServoVerbose) {
-					Serial.print("i51 powerUpServoGroup for servo: ");Serial.print(servoList[servoId].servoName);
-					Serial.print(", powerGroup: "); Serial.print(powerGroup[powerGroupIndex].powerGroupName);
-					Serial.println();
+					hostPort->print("i51 powerUpServoGroup for servo: ");hostPort->print(servoList[servoId].config->servoName);
+					hostPort->print(", powerGroup: "); hostPort->print(powerGroup[powerGroupIndex].powerGroupName);
+					hostPort->println();
 				}
 				pinMode(powerGroup[powerGroupIndex].powerPin, OUTPUT);
 				digitalWrite(powerGroup[powerGroupIndex].powerPin, SERVO_POWER_ON);
@@ -336,7 +755,11 @@ void powerUpServoGroup(int servoId) {
 					}
 				}
 
-				delay(50);
+				// wait for the servos to power up, keep receiving to detect stop commands
+				unsigned long powerUpMillis = millis();
+				while (millis() - powerUpMillis < 50) {
+					receiveCommands();
+				}
 			}
 		}
 	}
@@ -349,7 +772,7 @@ bool hasPowerGroupActiveMovements(int powerGroupIndex) {
 
 	for (int s = 0; s < assignedServos; s++) {
 		if (servoList[s].servoPowerPin == powerGroup[powerGroupIndex].powerPin) {
-			if (servoList[s].inMoveRequest) {
+			if (servoList[s].inMoveRequest || servoList[s].moveQueued) {
 				active = true;
 			};
 		}
@@ -358,6 +781,121 @@ bool hasPowerGroupActiveMovements(int powerGroupIndex) {
 }
 
 
+// power group of the servo, -1 if the servo power pin is not in the power group list
+int powerGroupIndexOfServo(int servoId) {
+	for (int powerGroupIndex=0; powerGroupIndex < NUMBER_OF_POWER_PINS; powerGroupIndex++) {
+		if (powerGroup[powerGroupIndex].powerPin == servoList[servoId].servoPowerPin) {
+			return powerGroupIndex;
+		}
+	}
+	return -1;
+}
+
+// sum of the estimated currents of the servos in the power group
+int estimatedGroupCurrentMa(int powerGroupIndex) {
+
+	int groupCurrentMa = 0;
+
+	for (int s = 0; s < assignedServos; s++) {
+		if (servoList[s].servoPowerPin == powerGroup[powerGroupIndex].powerPin) {
+			groupCurrentMa += servoList[s].estimatedCurrentMa();
+		}
+	}
+	return groupCurrentMa;
+}
+
+// collect the move requests of the servos and the power group currents for the admission logic
+// of currentBudget, the array index is the servoId
+// the queued counts of the groups are kept between the passes for the check of new requests
+queuedStartType queuedStarts[NUMBER_OF_SERVOS];
+groupAdmissionType groupAdmissions[NUMBER_OF_POWER_PINS];
+
+void collectQueuedStarts() {
+
+	for (int s = 0; s < assignedServos; s++) {
+		queuedStarts[s].queued = servoList[s].moveQueued;
+		queuedStarts[s].groupIndex = powerGroupIndexOfServo(s);
+		queuedStarts[s].startCurrentMa = servoList[s].config->servoCurrent.startCurrentMa;
+		queuedStarts[s].queuedMillis = servoList[s].queuedMillis;
+	}
+	for (int powerGroupIndex = 0; powerGroupIndex < NUMBER_OF_POWER_PINS; powerGroupIndex++) {
+		groupAdmissions[powerGroupIndex].currentMa = estimatedGroupCurrentMa(powerGroupIndex);
+		groupAdmissions[powerGroupIndex].budgetMa = powerGroup[powerGroupIndex].currentBudgetMa;
+		groupAdmissions[powerGroupIndex].blocked = false;
+	}
+}
+
+// check the power group current budget and the queued requests of the group for a new move of the servo
+// with requests of the group waiting no current is estimated, without a budget neither
+bool isServoStartQueued(int servoId) {
+
+	queuedStartType *request = &queuedStarts[servoId];
+	request->queued = servoList[servoId].moveQueued;
+	request->groupIndex = powerGroupIndexOfServo(servoId);
+	request->startCurrentMa = servoList[servoId].config->servoCurrent.startCurrentMa;
+	if (request->groupIndex != -1) {
+		groupAdmissionType *group = &groupAdmissions[request->groupIndex];
+		group->budgetMa = powerGroup[request->groupIndex].currentBudgetMa;
+		group->currentMa = 0;
+		if (group->queued == 0 && group->budgetMa > 0) {
+			group->currentMa = estimatedGroupCurrentMa(request->groupIndex);
+		}
+	}
+	return isMoveStartQueued(request, groupAdmissions);
+}
+
+// queue the move request of the servo and count it in its power group
+void queueServoMove(int servoId, int position, int duration) {
+
+	if (!servoList[servoId].moveQueued && queuedStarts[servoId].groupIndex != -1) {
+		groupAdmissions[queuedStarts[servoId].groupIndex].queued++;
+	}
+	servoList[servoId].queueMove(position, duration);
+}
+
+// start queued moves in order of arrival as far as the current budgets allow
+// a request that does not fit blocks the younger requests of its power group
+void startQueuedMoves() {
+
+	// queued servos stay in the active list, the queued counts are taken from it
+	// this also drops the requests of queued servos that were stopped since the last pass
+	int numQueued = 0;
+	for (int powerGroupIndex = 0; powerGroupIndex < NUMBER_OF_POWER_PINS; powerGroupIndex++) {
+		groupAdmissions[powerGroupIndex].queued = 0;
+	}
+	for (int a = 0; a < numActiveServos; a++) {
+		int servoId = activeServoIds[a];
+		if (servoList[servoId].moveQueued) {
+			int powerGroupIndex = powerGroupIndexOfServo(servoId);
+			if (powerGroupIndex != -1) {
+				groupAdmissions[powerGroupIndex].queued++;
+			}
+			numQueued++;
+		}
+	}
+	if (numQueued == 0) {
+		return;
+	}
+
+	collectQueuedStarts();
+
+	int servoId;
+	while ((servoId = nextQueuedStart(queuedStarts, assignedServos, groupAdmissions)) != -1) {
+
+		admitQueuedStart(&queuedStarts[servoId], groupAdmissions);
+
+		Mai3Servo *servo = &servoList[servoId];
+		if (log_i71 || servo->thisServoVerbose) {
+			hostPort->print("i71 queued move started, "); hostPort->print(servo->config->servoName);
+			hostPort->print(", delay ms: "); hostPort->print(millis() - servo->queuedMillis);
+			hostPort->println();
+		}
+		servo->moveQueued = false;
+		servo->moveTo(servo->queuedPosition, servo->queuedDurationMs);
+		markServoActive(servoId);
+	}
+}
+
 // servo assign
 // 0,<servoName>,<pin>,<min>,<max>,<rest>,<autoDetachMs>,<inverted>,<lastPos>,<servoPowerPin>
 void servoAssign() {
@@ -366,7 +904,6 @@ void servoAssign() {
 	char servoName[20] = {0};
 
 	strtokIndx = strtok(msgCopyForParsing, ","); // first item
-	int cmd = atoi(strtokIndx);			// cmd for servo assign = 0
 
 	strtokIndx = strtok(NULL, ",");		// position for next list item
 	strcpy(servoName, strtokIndx);		// the servo Name
@@ -395,6 +932,18 @@ void servoAssign() {
 	strtokIndx = strtok(NULL, ",");		// position for next list item
 	int servoPowerPin = atoi(strtokIndx);    // the power pin the servo is attached to
 
+	// optional motion limits
+	int maxSpeed = 0;
+	int maxAccel = 0;
+	strtokIndx = strtok(NULL, ",");		// position for next list item
+	if (strtokIndx != NULL) {
+		maxSpeed = atoi(strtokIndx);		// max positions per second
+		strtokIndx = strtok(NULL, ",");
+	}
+	if (strtokIndx != NULL) {
+		maxAccel = atoi(strtokIndx);		// max positions per second^2
+	}
+
 	// check for pin already assigned
 	int servoId = servoIdOfPin(pin);
 
@@ -404,28 +953,31 @@ void servoAssign() {
 		assignedServos += 1;
 		servoIdOfPinList[servoId] = pin;
 		if (log_i51) {
-			Serial.print("i51 assigning servoId: "); Serial.print(servoId);
-			Serial.print(" to pin: "); Serial.print(pin);
-			Serial.println();
+			hostPort->print("i51 assigning servoId: "); hostPort->print(servoId);
+			hostPort->print(" to pin: "); hostPort->print(pin);
+			hostPort->println();
 		}
 	}
 
-	strcpy(servoList[servoId].servoName, servoName);
+	strcpy(servoList[servoId].config->servoName, servoName);
 	servoList[servoId].begin(pin, min, max, restPosition, autoDetachMs, inverted, lastPos, servoPowerPin);
+	servoList[servoId].setMotionLimits(maxSpeed, maxAccel);
 
 	//if (servoList[servoId].thisServoVerbose) {
 	if (log_i51) {
-		Serial.print("i51 servo begin, servoId: "); Serial.print(servoId);
-		Serial.print(" , servoName: "); Serial.print(servoName);
-		Serial.print(", pin: "); Serial.print(pin);
-		Serial.print(", min: "); Serial.print(min);
-		Serial.print(", max: "); Serial.print(max);
-		Serial.print(", restPos: "); Serial.print(restPosition);
-		Serial.print(", autoDetachMs: "); Serial.print(autoDetachMs);
-		Serial.print(", inverted: "); Serial.print(inverted);
-		Serial.print(", lastPos: "); Serial.print(lastPos);
-		Serial.print(", servoPowerPin: "); Serial.print(servoPowerPin);
-		Serial.println();
+		hostPort->print("i51 servo begin, servoId: "); hostPort->print(servoId);
+		hostPort->print(" , servoName: "); hostPort->print(servoName);
+		hostPort->print(", pin: "); hostPort->print(pin);
+		hostPort->print(", min: "); hostPort->print(min);
+		hostPort->print(", max: "); hostPort->print(max);
+		hostPort->print(", restPos: "); hostPort->print(restPosition);
+		hostPort->print(", autoDetachMs: "); hostPort->print(autoDetachMs);
+		hostPort->print(", inverted: "); hostPort->print(inverted);
+		hostPort->print(", lastPos: "); hostPort->print(lastPos);
+		hostPort->print(", servoPowerPin: "); hostPort->print(servoPowerPin);
+		hostPort->print(", maxSpeed: "); hostPort->print(maxSpeed);
+		hostPort->print(", maxAccel: "); hostPort->print(maxAccel);
+		hostPort->println();
 	}
 	servoList[servoId].detachServo(true);
 	byte status = buildStatusByte(true, false, true, autoDetachMs>0, verbose, true);
@@ -433,17 +985,14 @@ void servoAssign() {
 }
 
 // servo feedback definitions
-// 8,pin,{i2cMultiplexerAddress},{i2cMultiplexerChannel},"
-// speedACalcType, speedAFactor,speedAOffset
-// speedBCalcType,speedBFactor,speedBOffset
-// degreesFactor,servoSpeedRange
+// 8,<pin>,<i2cMultiplexerAddress>,<i2cMultiplexerChannel>,<feedbackMagnetOffset>,<feedbackInverted>,
+// <degPerPos>,<kp>,<ki>,<kd>[,<kv>,<integralLimit>,<outputLimit>,<maxMagnetSpeed>]
 
 void setFeedbackDefinitions() {
 
 	char * strtokIndx; // this is used by strtok() as an index
 
 	strtokIndx = strtok(msgCopyForParsing, ","); // first item
-	int cmd = atoi(strtokIndx);			// cmd for feedback definitions = 8
 
 	strtokIndx = strtok(NULL, ",");		// position for next list item
 	int pin = atoi(strtokIndx);			// pin number for lookup of servoId
@@ -452,7 +1001,7 @@ void setFeedbackDefinitions() {
 
 	// check for servo known
 	if (servoId == -1) {
-		Serial.print("feedback definitions for unassigned servo, pin: "); Serial.print(pin); Serial.println();
+		hostPort->print("feedback definitions for unassigned servo, pin: "); hostPort->print(pin); hostPort->println();
 		return;
 	}
 	servoList[servoId].isFeedbackServo = true;
@@ -485,6 +1034,232 @@ void setFeedbackDefinitions() {
 	servoList[servoId].setFeedbackValues(i2cMultiplexerAddress, i2cMultiplexerChannel, 
 		feedbackMagnetOffset, feedbackInverted, degPerPos,
 		kp, ki, kd);
+
+	// optional: velocity feedforward and PID limits, keep the current values if not sent
+	float kv = servoList[servoId].config->kv;
+	float integralLimit = servoList[servoId].config->integralLimit;
+	float outputLimit = servoList[servoId].config->outputLimit;
+
+	strtokIndx = strtok(NULL, ",");				// position for next list item
+	if (strtokIndx != NULL) {
+		kv = atof(strtokIndx);			// velocity feedforward
+		strtokIndx = strtok(NULL, ",");
+	}
+	if (strtokIndx != NULL) {
+		integralLimit = atof(strtokIndx);	// max integral part in positions
+		strtokIndx = strtok(NULL, ",");
+	}
+	if (strtokIndx != NULL) {
+		outputLimit = atof(strtokIndx);		// max PID correction in positions
+		strtokIndx = strtok(NULL, ",");
+	}
+	servoList[servoId].setPidLimits(kv, integralLimit, outputLimit);
+
+	// optional: bound of the sensor rotation speed, keep the current value if not sent
+	if (strtokIndx != NULL) {
+		servoList[servoId].config->maxMagnetSpeed = atoi(strtokIndx);	// degrees per second, 0 for no limit
+	}
+
+	if (log_i52) {
+		hostPort->print("i52 feedback definitions, "); hostPort->print(servoList[servoId].config->servoName);
+		hostPort->print(", kp: "); hostPort->print(kp);
+		hostPort->print(", ki: "); hostPort->print(ki);
+		hostPort->print(", kd: "); hostPort->print(kd);
+		hostPort->print(", kv: "); hostPort->print(kv);
+		hostPort->print(", iLimit: "); hostPort->print(integralLimit);
+		hostPort->print(", outLimit: "); hostPort->print(outputLimit);
+		hostPort->print(", maxMagnetSpeed: "); hostPort->print(servoList[servoId].config->maxMagnetSpeed);
+		hostPort->println();
+	}
+}
+
+
+// joint groups, members of a group move arrive together
+const int NUMBER_OF_JOINT_GROUPS = 8;
+const int MAX_JOINT_GROUP_MEMBERS = 8;
+typedef struct {
+	char jointGroupName[20];
+	int numMembers;						// 0 for an unused entry
+	int memberPin[MAX_JOINT_GROUP_MEMBERS];
+	bool inGroupMove;
+	unsigned long groupMoveMillis;		// start of the group move
+	int groupDurationMs;				// common duration of the group move
+} jointGroupType;
+
+jointGroupType jointGroup[NUMBER_OF_JOINT_GROUPS];
+
+void requestServoMove(int servoId, int position, int duration);
+
+
+int jointGroupIndexOfName(char *name) {
+	for (int g = 0; g < NUMBER_OF_JOINT_GROUPS; g++) {
+		if (jointGroup[g].numMembers > 0 && strcmp(jointGroup[g].jointGroupName, name) == 0) {
+			return g;
+		}
+	}
+	return -1;
+}
+
+
+// define a joint group, an existing group with the same name is replaced
+// d,<groupName>,<pin>,..<pin>
+void defineJointGroup() {
+
+	char * strtokIndx; // this is used by strtok() as an index
+
+	strtokIndx = strtok(msgCopyForParsing, ","); // first item, command code
+	strtokIndx = strtok(NULL, ",");		// next item
+	if (strtokIndx == NULL || strlen(strtokIndx) >= 20) {
+		hostPort->println("e20 joint group name missing or too long");
+		return;
+	}
+
+	int g = jointGroupIndexOfName(strtokIndx);
+	if (g == -1) {
+		// find a free entry
+		for (int i = 0; i < NUMBER_OF_JOINT_GROUPS && g == -1; i++) {
+			if (jointGroup[i].numMembers == 0) {
+				g = i;
+			}
+		}
+	}
+	if (g == -1) {
+		hostPort->print("e20 no free joint group for "); hostPort->print(strtokIndx); hostPort->println();
+		return;
+	}
+	strcpy(jointGroup[g].jointGroupName, strtokIndx);
+
+	int numMembers = 0;
+	strtokIndx = strtok(NULL, ",");		// first pin
+	while (strtokIndx != NULL && numMembers < MAX_JOINT_GROUP_MEMBERS) {
+		int pin = atoi(strtokIndx);
+		if (servoIdOfPin(pin) == -1) {
+			hostPort->print("e20 joint group member not assigned, pin: "); hostPort->print(pin); hostPort->println();
+		} else {
+			jointGroup[g].memberPin[numMembers] = pin;
+			numMembers += 1;
+		}
+		strtokIndx = strtok(NULL, ",");	// next pin
+	}
+	jointGroup[g].numMembers = numMembers;
+	jointGroup[g].inGroupMove = false;
+
+	if (log_i90) {
+		hostPort->print("i91 joint group defined: "); hostPort->print(jointGroup[g].jointGroupName);
+		hostPort->print(", members: "); hostPort->print(numMembers);
+		hostPort->println();
+	}
+}
+
+
+// move all members of a joint group with one common duration
+// the duration is the longest of the requested duration and the min durations of the members
+// g,<groupName>,<duration>,<position member 1>,..<position member n>
+void jointGroupMoveTo() {
+
+	char * strtokIndx; // this is used by strtok() as an index
+
+	strtokIndx = strtok(msgCopyForParsing, ","); // first item, command code
+	strtokIndx = strtok(NULL, ",");		// next item
+	int g = -1;
+	if (strtokIndx != NULL) {
+		g = jointGroupIndexOfName(strtokIndx);
+	}
+	if (g == -1) {
+		hostPort->println("e21 move request for unknown joint group");
+		return;
+	}
+
+	strtokIndx = strtok(NULL, ",");		// next item
+	int duration = strtokIndx == NULL ? 0 : atoi(strtokIndx);	// requested duration, 0 for fastest
+
+	int servoIds[MAX_JOINT_GROUP_MEMBERS];
+	int positions[MAX_JOINT_GROUP_MEMBERS];
+	for (int m = 0; m < jointGroup[g].numMembers; m++) {
+		strtokIndx = strtok(NULL, ",");		// next member position
+		if (strtokIndx == NULL) {
+			hostPort->print("e21 missing member positions for joint group "); hostPort->print(jointGroup[g].jointGroupName); hostPort->println();
+			return;
+		}
+		servoIds[m] = servoIdOfPin(jointGroup[g].memberPin[m]);
+		positions[m] = atoi(strtokIndx);
+		servoList[servoIds[m]].followPositionModel();
+	}
+
+	// common duration within the motion limits of all members, moving members blend into their target
+	// the blend limits do not grow steadily with the duration, repeat until no member stretches it further
+	for (int pass = 0; pass < 10; pass++) {
+		int groupDuration = duration;
+		for (int m = 0; m < jointGroup[g].numMembers; m++) {
+			int memberDuration = servoList[servoIds[m]].effectiveDurationMs(positions[m], duration);
+			if (memberDuration > groupDuration) {
+				groupDuration = memberDuration;
+			}
+		}
+		if (groupDuration == duration) {
+			break;
+		}
+		duration = groupDuration;
+	}
+
+	jointGroup[g].inGroupMove = true;
+	jointGroup[g].groupMoveMillis = millis();
+	jointGroup[g].groupDurationMs = duration;
+
+	if (log_i90) {
+		hostPort->print("i92 joint group move "); hostPort->print(jointGroup[g].jointGroupName);
+		hostPort->print(", dur: "); hostPort->print(duration);
+		hostPort->println();
+	}
+
+	for (int m = 0; m < jointGroup[g].numMembers; m++) {
+		servoList[servoIds[m]].inJointGroupMove = true;
+		requestServoMove(servoIds[m], positions[m], duration);
+	}
+}
+
+
+// one event per joint group when all members have ended their move
+void checkJointGroupArrivals() {
+
+	for (int g = 0; g < NUMBER_OF_JOINT_GROUPS; g++) {
+		if (!jointGroup[g].inGroupMove) {
+			continue;
+		}
+
+		bool arrived = true;
+		for (int m = 0; m < jointGroup[g].numMembers; m++) {
+			Mai3Servo *servo = &servoList[servoIdOfPin(jointGroup[g].memberPin[m])];
+			if (servo->inJointGroupMove && (servo->moving || servo->moveQueued)) {
+				arrived = false;
+			}
+		}
+		if (!arrived) {
+			continue;
+		}
+
+		// members stopped or blocked on the way have not reached their target
+		int stopped = 0;
+		int blocked = 0;
+		jointGroup[g].inGroupMove = false;
+		for (int m = 0; m < jointGroup[g].numMembers; m++) {
+			Mai3Servo *servo = &servoList[servoIdOfPin(jointGroup[g].memberPin[m])];
+			if (servo->inJointGroupMove && servo->moveEnd != MOVE_END_REACHED) {
+				if (servo->moveEnd == MOVE_END_STALLED) {
+					blocked += 1;
+				} else {
+					stopped += 1;
+				}
+			}
+			servo->inJointGroupMove = false;
+		}
+		hostPort->print("i90 joint group target reached "); hostPort->print(jointGroup[g].jointGroupName);
+		hostPort->print(", dur: "); hostPort->print(jointGroup[g].groupDurationMs);
+		hostPort->print(", ms: "); hostPort->print(millis() - jointGroup[g].groupMoveMillis);
+		hostPort->print(", stopped: "); hostPort->print(stopped);
+		hostPort->print(", blocked: "); hostPort->print(blocked);
+		hostPort->println();
+	}
 }
 
 
@@ -495,7 +1270,6 @@ void servoMoveTo() {
 	char * strtokIndx;					// this is used by strtok() as an index
 
 	strtokIndx = strtok(msgCopyForParsing, ","); // first item
-	int cmd = atoi(strtokIndx);			// command moveTo = 1
 
 	strtokIndx = strtok(NULL, ",");		// position for next list item
 	int pin = atoi(strtokIndx);    		// pin for move
@@ -510,30 +1284,58 @@ void servoMoveTo() {
 
 	// check for servo known
 	if (servoId == -1) {
-		Serial.print("move request for unassigned servo, pin: "); Serial.print(pin); Serial.println();
+		hostPort->print("move request for unassigned servo, pin: "); hostPort->print(pin); hostPort->println();
 		return;
 	}
 
 	if (log_i10) {
-		Serial.print("i10 "); Serial.print(servoList[servoId].servoName); 
-		Serial.print(", servoMoveTo, pin: "); Serial.print(pin);
-		Serial.print(", pos: "); Serial.print(position);
-		Serial.print(", dur: "); Serial.print(duration);
-		Serial.println();
+		hostPort->print("i10 "); hostPort->print(servoList[servoId].config->servoName); 
+		hostPort->print(", servoMoveTo, pin: "); hostPort->print(pin);
+		hostPort->print(", pos: "); hostPort->print(position);
+		hostPort->print(", dur: "); hostPort->print(duration);
+		hostPort->println();
 	}
+	servoList[servoId].inJointGroupMove = false;
+	requestServoMove(servoId, position, duration);
+}
+
+
+// start a move of a servo, used by single and joint group moves
+void requestServoMove(int servoId, int position, int duration) {
+
+	if (isEmergencyStopActive()) {
+		hostPort->print("e12 move rejected, emergency stop active, "); hostPort->print(servoList[servoId].config->servoName);
+		hostPort->println();
+		return;
+	}
+
 	powerUpServoGroup(servoId);
-	
+
+	// a running move blends into the new target, no stop and no new start in the current budget
+	if (servoList[servoId].isBlendPossible()) {
+		servoList[servoId].retarget(position, duration);
+		return;
+	}
+
 	// check for servo already in move and if so stop it first
 	if (servoList[servoId].moving) {
 		servoList[servoId].stopServo();
 		if (servoList[servoId].thisServoVerbose) {
-			Serial.print("w03 new moveTo position request while still moving, stop current move ");
-			Serial.print(servoList[servoId].servoName);
-			Serial.println();
+			hostPort->print("w03 new moveTo position request while still moving, stop current move ");
+			hostPort->print(servoList[servoId].config->servoName);
+			hostPort->println();
 		}
 	}
 
+	// respect the current budget of the power group, requests are started in order of arrival
+	if (isServoStartQueued(servoId)) {
+		queueServoMove(servoId, position, duration);
+		markServoActive(servoId);		// the motion task starts it from the active list
+		return;
+	}
+
 	servoList[servoId].moveTo(position, duration);
+	markServoActive(servoId);
 }
 
 // 
@@ -542,7 +1344,6 @@ void servoStopCmd() {
 	char * strtokIndx; // this is used by strtok() as an index
 
 	strtokIndx = strtok(msgCopyForParsing, ","); // first item
-	int cmd = atoi(strtokIndx);     	// command id
 
 	strtokIndx = strtok(NULL, ",");		// next list item
 	int pin = atoi(strtokIndx);     	// pin number
@@ -550,23 +1351,24 @@ void servoStopCmd() {
 	int servoId = servoIdOfPin(pin);
 
 	if (servoId == -1) {
-		Serial.print("stop request for unassigned servo, pin: "); Serial.print(pin); Serial.println();
+		hostPort->print("stop request for unassigned servo, pin: "); hostPort->print(pin); hostPort->println();
 		return;
 	}
 	servoList[servoId].stopServo();
 
 	if (verbose) {
-		Serial.print("stopServo, servoId: "); Serial.print(servoId);
-		Serial.print(", pin: "); Serial.print(pin);
-		Serial.print(", "); Serial.print(servoList[servoId].servoName);
-		Serial.println();
+		hostPort->print("stopServo, servoId: "); hostPort->print(servoId);
+		hostPort->print(", pin: "); hostPort->print(pin);
+		hostPort->print(", "); hostPort->print(servoList[servoId].config->servoName);
+		hostPort->println();
 	}
 }
 
 
 void servoStopAllCmd() {
 
-	Serial.println("i22 servo stop all received");
+	hostPort->println("i22 servo stop all received");
+	stopMotionPrograms();
 
 	// stop all servos
 	for (int i = 0; i < assignedServos; i++) {
@@ -580,7 +1382,6 @@ void reportServoStatus() {
 	char * strtokIndx; // this is used by strtok() as an index
 
 	strtokIndx = strtok(msgCopyForParsing, ","); // first item
-	int cmd = atoi(strtokIndx);			// cmd
 
 	strtokIndx = strtok(NULL, ",");		// next item
 	int pin = atoi(strtokIndx);     // pin
@@ -588,10 +1389,11 @@ void reportServoStatus() {
 	int servoId = servoIdOfPin(pin);
 
 	if (servoId == -1) {
-		Serial.print("report servo request for unassigned servo, pin: "); Serial.print(pin); Serial.println();
+		hostPort->print("report servo request for unassigned servo, pin: "); hostPort->print(pin); hostPort->println();
 		return;
 	}
 	
+	servoList[servoId].followPositionModel();
 	bool assigned = servoList[servoId].assigned; 
 	bool isMoving = servoList[servoId].moving;
 	bool attached = servoList[servoId].attached();
@@ -601,24 +1403,30 @@ void reportServoStatus() {
 	byte currentPosition = servoList[servoId].currentPosition;
 
 	if (verbose) {
-		Serial.print("servoStatus, servoId: "); Serial.print(servoId);
-		Serial.print(", position: "); Serial.print(currentPosition);
-		Serial.print(", assigned: "); Serial.print(assigned);
-		Serial.print(", isMoving: "); Serial.print(isMoving);
-		Serial.print(", attached: "); Serial.print(attached);
-		Serial.println();
-	}
-	byte status = buildStatusByte(assigned, isMoving, attached, autoDetachMs>0, thisServoVerbose, false);
+		hostPort->print("servoStatus, servoId: "); hostPort->print(servoId);
+		hostPort->print(", position: "); hostPort->print(currentPosition);
+		hostPort->print(", assigned: "); hostPort->print(assigned);
+		hostPort->print(", isMoving: "); hostPort->print(isMoving);
+		hostPort->print(", attached: "); hostPort->print(attached);
+		hostPort->println();
+	}
+	byte status = buildStatusByte(assigned, isMoving, attached, autoDetachMs>0, thisServoVerbose, false, servoList[servoId].servoBlocked);
 	if (servoList[servoId].isFeedbackServo) {
 		int ms = millis() - servoList[servoId].startMillis;
 		sendFeedbackStatus(pin, status, 
 			servoList[servoId].currentPosition, 
 			ms, 
 			servoList[servoId].servoWritePosition, 
-			servoList[servoId].plannedPosition);
+			servoList[servoId].wantedPosition);
 	} else {
 		sendServoStatus(pin, status, servoList[servoId].currentPosition);
 	}
+
+	if (servoList[servoId].moveQueued) {
+		hostPort->print("i72 "); hostPort->print(servoList[servoId].config->servoName);
+		hostPort->print(" move queued, waiting ms: "); hostPort->print(millis() - servoList[servoId].queuedMillis);
+		hostPort->println();
+	}
 }
 
 
@@ -627,7 +1435,6 @@ void setAutoDetach() {
 	char * strtokIndx; // this is used by strtok() as an index
 
 	strtokIndx = strtok(msgCopyForParsing, ","); // first item
-	int cmd = atoi(strtokIndx);     	// command id
 
 	strtokIndx = strtok(NULL, ",");		// next list element
 	int pin = atoi(strtokIndx);     	// pin
@@ -638,7 +1445,7 @@ void setAutoDetach() {
 
 	int servoId = servoIdOfPin(pin);
 	if (servoId == -1) {
-		Serial.print("setAutoDetach request for unassigned servo, pin: "); Serial.print(pin); Serial.println();
+		hostPort->print("setAutoDetach request for unassigned servo, pin: "); hostPort->print(pin); hostPort->println();
 		return;
 	}
 
@@ -648,9 +1455,9 @@ void setAutoDetach() {
 		servoList[servoId].autoDetachMs = newMs;
 
 		if (verbose) {
-			Serial.print("i20 new setAutoDetach value: "); Serial.print(newMs);
-			Serial.print(" for "); Serial.print(servoList[servoId].servoName);
-			Serial.println();
+			hostPort->print("i20 new setAutoDetach value: "); hostPort->print(newMs);
+			hostPort->print(" for "); hostPort->print(servoList[servoId].config->servoName);
+			hostPort->println();
 		}
 	}
 }
@@ -663,7 +1470,6 @@ void setPosition() {
 	char * strtokIndx; // this is used by strtok() as an index
 
 	strtokIndx = strtok(msgCopyForParsing, ","); // first item
-	int cmd = atoi(strtokIndx);			// convert this part to an integer
 
 	strtokIndx = strtok(NULL, ",");		// next list item
 	int pin = atoi(strtokIndx);     	// convert this part to an integer
@@ -673,11 +1479,11 @@ void setPosition() {
 
 	int servoId = servoIdOfPin(pin);
 	if (servoId == -1) {
-		Serial.print("move request for unassigned servo, pin: "); Serial.print(pin); Serial.println();
+		hostPort->print("move request for unassigned servo, pin: "); hostPort->print(pin); hostPort->println();
 		return;
 	}
 
-	servoList[servoId].currentPosition = newPos;
+	servoList[servoId].setCurrentPosition(newPos);
 }
 
 
@@ -686,7 +1492,6 @@ void setVerbose() {
 	char * strtokIndx; // this is used by strtok() as an index
 
 	strtokIndx = strtok(msgCopyForParsing, ","); // first item
-	int cmd = atoi(strtokIndx);			// cmd
 
 	strtokIndx = strtok(NULL, ",");		// next item
 	int pin = atoi(strtokIndx);     	// pin
@@ -696,7 +1501,7 @@ void setVerbose() {
 
 	int servoId = servoIdOfPin(pin);
 	if (servoId == -1) {
-		Serial.print("e04 set verbose request for unassigned servo, pin: "); Serial.print(pin); Serial.println();
+		hostPort->print("e04 set verbose request for unassigned servo, pin: "); hostPort->print(pin); hostPort->println();
 		return;
 	}
 
@@ -708,118 +1513,1029 @@ void setVerbose() {
 	}
 }
 
-// "h,<pin number>,..<pin number>"
-void pinHigh() {
+// servo current estimate
+// 9,<pin>,<startCurrentMa>,<runCurrentMa>,<startPhaseMs>
+void setServoCurrent() {
 
 	char * strtokIndx; // this is used by strtok() as an index
 
 	strtokIndx = strtok(msgCopyForParsing, ","); // first item
-	strtokIndx = strtok(NULL, ",");				 // command code h
-
-	while (strtokIndx != NULL) {				// for each pin in the list
-		int digitalPin = atoi(strtokIndx);      // pin number
-		
-		pinMode(digitalPin, OUTPUT);
-		digitalWrite(digitalPin, HIGH);
-		Serial.print("i30 digital pin set to HIGH: "); Serial.print(digitalPin); Serial.println();
 
-		strtokIndx = strtok(NULL, ",");		// next item
-	}
-}
+	strtokIndx = strtok(NULL, ",");		// next item
+	int pin = atoi(strtokIndx);     	// pin
 
-// "l,<pin number>,..<pin number>"
-void pinLow() {
+	strtokIndx = strtok(NULL, ",");		// next item
+	int startCurrentMa = atoi(strtokIndx);	// current while starting the move
 
-	char * strtokIndx; // this is used by strtok() as an index
+	strtokIndx = strtok(NULL, ",");		// next item
+	int runCurrentMa = atoi(strtokIndx);	// current for the rest of the move
 
-	strtokIndx = strtok(msgCopyForParsing, ","); // first item, command code
-	strtokIndx = strtok(NULL, ",");		// first item after command
+	strtokIndx = strtok(NULL, ",");		// next item
+	int startPhaseMs = atoi(strtokIndx);	// duration of the start phase
 
-	while (strtokIndx != NULL) {		// list of pins to set low
-		int digitalPin = atoi(strtokIndx);     // convert this part to an integer
+	int servoId = servoIdOfPin(pin);
+	if (servoId == -1) {
+		hostPort->print("servo current request for unassigned servo, pin: "); hostPort->print(pin); hostPort->println();
+		return;
+	}
 
-		Serial.print("i31 digital pin set to LOW: "); Serial.print(digitalPin); Serial.println();
-		pinMode(digitalPin, OUTPUT);
-		digitalWrite(digitalPin, LOW);
+	servoList[servoId].config->servoCurrent.startCurrentMa = startCurrentMa;
+	servoList[servoId].config->servoCurrent.runCurrentMa = runCurrentMa;
+	servoList[servoId].config->servoCurrent.startPhaseMs = startPhaseMs;
 
-		strtokIndx = strtok(NULL, ",");		// next item
+	if (verbose) {
+		hostPort->print("i73 servo current, "); hostPort->print(servoList[servoId].config->servoName);
+		hostPort->print(", startMa: "); hostPort->print(startCurrentMa);
+		hostPort->print(", runMa: "); hostPort->print(runCurrentMa);
+		hostPort->print(", startMs: "); hostPort->print(startPhaseMs);
+		hostPort->println();
 	}
 }
 
+// power group current budget
+// b,<powerPin>,<budgetMa>
+void setPowerGroupBudget() {
 
+	char * strtokIndx; // this is used by strtok() as an index
 
-// the loop function runs over and over again until power down or reset
-void loop() {
+	strtokIndx = strtok(msgCopyForParsing, ","); // first item, command code
+	strtokIndx = strtok(NULL, ",");		// next item
+	int powerPin = atoi(strtokIndx);	// power pin of the group
 
-	// show running mode and arduinoId with led
-	if (millis() - ledToggleMillis < highMillis) {
-		digitalWrite(LED_BUILTIN, HIGH);
-	}
-	else {
-		digitalWrite(LED_BUILTIN, LOW);
-	}
-	if ((millis() - ledToggleMillis) > (highMillis + lowMillis)) {
-		ledToggleMillis = millis();
-	}
+	strtokIndx = strtok(NULL, ",");		// next item
+	int budgetMa = atoi(strtokIndx);	// current budget, 0 for no limit
 
-	/////////////////////////////////////////////////////////////////////
-	// for currently moving servos request the next incremental position
-	/////////////////////////////////////////////////////////////////////
-	// update servos max 50 times per second
-	if ((millis() - lastServoUpdateMillis) >= 20) {
-		for (int i = 0; i < assignedServos; i++) {
-			if (servoList[i].inMoveRequest) {
-				servoList[i].update();
+	bool found = false;
+	for (int powerGroupIndex = 0; powerGroupIndex < NUMBER_OF_POWER_PINS; powerGroupIndex++) {
+		if (powerGroup[powerGroupIndex].powerPin == powerPin) {
+			powerGroup[powerGroupIndex].currentBudgetMa = budgetMa;
+			found = true;
+			if (verbose) {
+				hostPort->print("i73 current budget, "); hostPort->print(powerGroup[powerGroupIndex].powerGroupName);
+				hostPort->print(", budgetMa: "); hostPort->print(budgetMa);
+				hostPort->println();
 			}
 		}
-		lastServoUpdateMillis = millis();
 	}
-
-	/////////////////////////////////////////////////////////////////////
-	// for currently activated power groups check for possible power off
-	/////////////////////////////////////////////////////////////////////
-	for (int powerGroupIndex=0; powerGroupIndex < NUMBER_OF_POWER_PINS; powerGroupIndex++) {
-		if (powerGroup[powerGroupIndex].powerOn) {
-			if (!hasPowerGroupActiveMovements(powerGroupIndex)) {
-				digitalWrite(powerGroup[powerGroupIndex].powerPin, SERVO_POWER_OFF);
-				powerGroup[powerGroupIndex].powerOn = false;
-				if (log_i41) {
-					Serial.print("i41, servo group powered off "); Serial.print(powerGroup[powerGroupIndex].powerGroupName); Serial.println();
-				}
-
-				// detach servos in this power group
-				for (int s = 0; s < assignedServos; s++) {
-					if (servoList[s].servoPowerPin == powerGroup[powerGroupIndex].powerPin) {
-						servoList[s].detachServo(true);		// force detach
-					}
-				}
-			}
-		}
+	if (!found) {
+		hostPort->print("current budget for unknown power pin: "); hostPort->print(powerPin); hostPort->println();
 	}
+}
 
-	///////////////////////////////////////////////
-	// check for new requests over serial
-	//////////////////////////////////////////////
-	mode = checkCommand();
-
-	if (log_i50 && mode != 'x') {
-		Serial.print("i50 ");
-		Serial.print(msgCopyForParsing);
-		Serial.println();
-	}
+// position model of a servo without feedback
+// m,<pin>,<lagMs>,<maxSpeed>
+void setPositionModel() {
 
-	switch (mode) {
+	char * strtokIndx; // this is used by strtok() as an index
+
+	strtokIndx = strtok(msgCopyForParsing, ","); // first item, command code
+	strtokIndx = strtok(NULL, ",");		// next item
+	int pin = atoi(strtokIndx);			// pin
+
+	strtokIndx = strtok(NULL, ",");		// next item
+	int lagMs = atoi(strtokIndx);		// first order lag time constant
+
+	strtokIndx = strtok(NULL, ",");		// next item
+	int maxSpeed = atoi(strtokIndx);	// slew limit in positions per second
+
+	int servoId = servoIdOfPin(pin);
+	if (servoId == -1) {
+		hostPort->print("position model request for unassigned servo, pin: "); hostPort->print(pin); hostPort->println();
+		return;
+	}
+
+	servoList[servoId].setPositionModel(lagMs, maxSpeed);
+
+	if (verbose) {
+		hostPort->print("i18 position model, "); hostPort->print(servoList[servoId].config->servoName);
+		hostPort->print(", lagMs: "); hostPort->print(lagMs);
+		hostPort->print(", maxSpeed: "); hostPort->print(maxSpeed);
+		hostPort->println();
+	}
+}
+
+// stall detection of a feedback servo
+// k,<pin>,<windowTicks>,<errorLimit>,<velocityPercent>
+void setStallDetection() {
+
+	char * strtokIndx; // this is used by strtok() as an index
+
+	strtokIndx = strtok(msgCopyForParsing, ","); // first item, command code
+	strtokIndx = strtok(NULL, ",");		// next item
+	int pin = atoi(strtokIndx);			// pin
+
+	strtokIndx = strtok(NULL, ",");		// next item
+	int windowTicks = atoi(strtokIndx);	// stalled updates before stop, 0 disables
+
+	strtokIndx = strtok(NULL, ",");		// next item
+	int errorLimit = atoi(strtokIndx);	// min position error of a stalled update
+
+	strtokIndx = strtok(NULL, ",");		// next item
+	int velocityPercent = atoi(strtokIndx);	// measured versus planned speed
+
+	int servoId = servoIdOfPin(pin);
+	if (servoId == -1) {
+		hostPort->print("stall detection request for unassigned servo, pin: "); hostPort->print(pin); hostPort->println();
+		return;
+	}
+
+	servoList[servoId].setStallDetection(windowTicks, errorLimit, velocityPercent);
+
+	if (verbose) {
+		hostPort->print("i19 stall detection, "); hostPort->print(servoList[servoId].config->servoName);
+		hostPort->print(", windowTicks: "); hostPort->print(windowTicks);
+		hostPort->print(", errorLimit: "); hostPort->print(errorLimit);
+		hostPort->print(", velocityPercent: "); hostPort->print(velocityPercent);
+		hostPort->println();
+	}
+}
+
+// PID autotune of a feedback servo
+// a,<pin>,<relayAmplitude>,<cycles>
+void servoAutoTune() {
+
+	char * strtokIndx; // this is used by strtok() as an index
+
+	strtokIndx = strtok(msgCopyForParsing, ","); // first item, command code
+	strtokIndx = strtok(NULL, ",");		// next item
+	int pin = atoi(strtokIndx);			// pin
+
+	strtokIndx = strtok(NULL, ",");		// next item
+	int relayAmplitude = atoi(strtokIndx);	// relay step around the current position
+
+	strtokIndx = strtok(NULL, ",");		// next item
+	int cycles = atoi(strtokIndx);		// measured oscillation periods
+
+	strtokIndx = strtok(NULL, ",");		// next item
+	int experiment = strtokIndx != NULL ? atoi(strtokIndx) : AUTOTUNE_RELAY_FEEDBACK;
+
+	int servoId = servoIdOfPin(pin);
+	if (servoId == -1) {
+		hostPort->print("autotune request for unassigned servo, pin: "); hostPort->print(pin); hostPort->println();
+		return;
+	}
+	if (!servoList[servoId].isFeedbackServo) {
+		hostPort->print("e84 autotune request for servo without feedback, "); hostPort->print(servoList[servoId].config->servoName); hostPort->println();
+		return;
+	}
+	if (servoList[servoId].inMoveRequest || servoList[servoId].moveQueued) {
+		hostPort->print("e84 autotune request for moving servo, "); hostPort->print(servoList[servoId].config->servoName); hostPort->println();
+		return;
+	}
+	for (int s = 0; s < assignedServos; s++) {
+		if (servoList[s].autoTune != NULL) {
+			hostPort->print("e84 autotune already running for "); hostPort->print(servoList[s].config->servoName); hostPort->println();
+			return;
+		}
+	}
+	if (relayAmplitude < 1) {
+		relayAmplitude = 5;
+	}
+	if (cycles < 1) {
+		cycles = 3;
+	}
+	if (experiment != AUTOTUNE_BACKLASH_SWEEP) {
+		experiment = AUTOTUNE_RELAY_FEEDBACK;
+	}
+
+	if (isEmergencyStopActive()) {
+		hostPort->print("e12 autotune rejected, emergency stop active, "); hostPort->print(servoList[servoId].config->servoName);
+		hostPort->println();
+		return;
+	}
+
+	powerUpServoGroup(servoId);
+	servoList[servoId].startAutoTune(&autoTuneRun, experiment, relayAmplitude, cycles);
+	markServoActive(servoId);
+}
+
+// send scheduler statistics
+// t,<reset>
+void schedulerStats() {
+
+	char * strtokIndx; // this is used by strtok() as an index
+
+	strtokIndx = strtok(msgCopyForParsing, ","); // first item, command code
+	strtokIndx = strtok(NULL, ",");		// next item
+	bool resetStats = strtokIndx != NULL && atoi(strtokIndx) != 0;
+
+	reportTaskStats(taskList, NUMBER_OF_TASKS, resetStats);
+}
+
+// o,<pin>[,<driftThreshold>]
+void setIdleMonitoring() {
+
+	char * strtokIndx; // this is used by strtok() as an index
+
+	strtokIndx = strtok(msgCopyForParsing, ","); // first item, command code
+	strtokIndx = strtok(NULL, ",");		// next item
+	int pin = strtokIndx != NULL ? atoi(strtokIndx) : -1;
+
+	strtokIndx = strtok(NULL, ",");		// next item, without it the threshold is only reported
+
+	int servoId = servoIdOfPin(pin);
+	if (servoId == -1) {
+		hostPort->print("e15 idle monitoring for unassigned servo, pin: "); hostPort->print(pin); hostPort->println();
+		return;
+	}
+	if (strtokIndx != NULL) {
+		servoList[servoId].config->driftThreshold = atoi(strtokIndx);
+	}
+
+	hostPort->print("i24 idle monitoring, "); hostPort->print(servoList[servoId].config->servoName);
+	hostPort->print(", driftThreshold: "); hostPort->print(servoList[servoId].config->driftThreshold);
+	hostPort->print(", magnetFaults: "); hostPort->print(servoList[servoId].magnetFaults);
+	hostPort->println();
+}
+
+// f,<pin>[,<learnPercent>[,<ff0>,...,<ff7>]]
+// position dependent feedforward of a feedback servo, without values the table is reported only
+void setGravityFeedforward() {
+
+	char * strtokIndx; // this is used by strtok() as an index
+
+	strtokIndx = strtok(msgCopyForParsing, ","); // first item, command code
+	strtokIndx = strtok(NULL, ",");		// next item
+	int pin = strtokIndx != NULL ? atoi(strtokIndx) : -1;
+
+	int servoId = servoIdOfPin(pin);
+	if (servoId == -1 || !servoList[servoId].isFeedbackServo) {
+		hostPort->print("e16 gravity feedforward needs an assigned feedback servo, pin: "); hostPort->print(pin); hostPort->println();
+		return;
+	}
+	servoConfigType *config = servoList[servoId].config;
+
+	strtokIndx = strtok(NULL, ",");		// next item
+	if (strtokIndx != NULL) {
+		int learnPercent = atoi(strtokIndx);
+
+		// the table is replaced only when all bins are given
+		float values[GRAVITY_BINS];
+		int numValues = 0;
+		while (numValues < GRAVITY_BINS && (strtokIndx = strtok(NULL, ",")) != NULL) {
+			values[numValues++] = atof(strtokIndx);
+		}
+		if (numValues > 0 && numValues < GRAVITY_BINS) {
+			hostPort->print("e16 gravity feedforward needs "); hostPort->print(GRAVITY_BINS);
+			hostPort->print(" values, received: "); hostPort->print(numValues); hostPort->println();
+			return;
+		}
+		config->gravityLearnPercent = constrain(learnPercent, 0, 100);
+		if (numValues == GRAVITY_BINS) {
+			for (int i = 0; i < GRAVITY_BINS; i++) {
+				config->gravityFf[i] = values[i];
+			}
+		}
+	}
+
+	hostPort->print("i25 gravity feedforward, "); hostPort->print(config->servoName);
+	hostPort->print(", learnPercent: "); hostPort->print(config->gravityLearnPercent);
+	hostPort->print(", table:");
+	for (int i = 0; i < GRAVITY_BINS; i++) {
+		hostPort->print(" "); hostPort->print(config->gravityFf[i]);
+	}
+	hostPort->println();
+}
+
+// servo access of the motion programs
+bool programMoveServo(int pin, int position, int durationMs) {
+	int servoId = servoIdOfPin(pin);
+	if (servoId == -1 || servoList[servoId].teaching || isEmergencyStopActive()) {
+		return false;
+	}
+	servoList[servoId].inJointGroupMove = false;
+	requestServoMove(servoId, position, durationMs);
+	return true;
+}
+
+int programServoPosition(int pin) {
+	int servoId = servoIdOfPin(pin);
+	if (servoId == -1) {
+		return -1;
+	}
+	servoList[servoId].followPositionModel();
+	return servoList[servoId].currentPosition;
+}
+
+int programServoMoving(int pin) {
+	int servoId = servoIdOfPin(pin);
+	if (servoId == -1) {
+		return -1;
+	}
+	return servoList[servoId].moving || servoList[servoId].moveQueued;
+}
+
+long programRandom(long max) {
+	return random(max);
+}
+
+const motionProgramHostType programHost = {programMoveServo, programServoPosition, programServoMoving, programRandom};
+
+void reportMotionProgram(int p) {
+	motionProgramType *prog = &motionPrograms[p];
+	if (prog->state == PROGRAM_FAILED) {
+		hostPort->print("e22 motion program failed: "); hostPort->print(p);
+		hostPort->print(", error: "); hostPort->print(prog->error);
+		hostPort->print(", pc: "); hostPort->print(prog->errorPc);
+		hostPort->println();
+		return;
+	}
+	hostPort->print("i03 motion program: "); hostPort->print(p);
+	hostPort->print(", state: "); hostPort->print(prog->state);
+	hostPort->print(", length: "); hostPort->print(prog->length);
+	hostPort->print(", pc: "); hostPort->print(prog->pc);
+	hostPort->print(", instructions: "); hostPort->print(prog->instructions);
+	hostPort->println();
+}
+
+// z,<program>,<action>[,<offset>,<hexBytes>]
+// action 0: clear, 1: load the bytes at offset (the current length), 2: start, 3: stop, 4: report
+void motionProgramCmd() {
+
+	char * strtokIndx; // this is used by strtok() as an index
+
+	strtokIndx = strtok(msgCopyForParsing, ","); // first item, command code
+	strtokIndx = strtok(NULL, ",");		// next item
+	int p = strtokIndx != NULL ? atoi(strtokIndx) : -1;
+
+	strtokIndx = strtok(NULL, ",");		// next item
+	int action = strtokIndx != NULL ? atoi(strtokIndx) : 4;
+
+	if (p < 0 || p >= NUMBER_OF_MOTION_PROGRAMS) {
+		hostPort->print("e22 invalid motion program: "); hostPort->print(p); hostPort->println();
+		return;
+	}
+	motionProgramType *prog = &motionPrograms[p];
+	bool running = prog->state == PROGRAM_RUNNING || prog->state == PROGRAM_WAITING || prog->state == PROGRAM_ARRIVING;
+
+	switch (action) {
+
+	case 0:
+	case 1: {
+		if (running) {
+			hostPort->print("e22 motion program is running: "); hostPort->print(p); hostPort->println();
+			return;
+		}
+		if (action == 0) {
+			motionProgramClear(prog);
+			break;
+		}
+		strtokIndx = strtok(NULL, ",");		// next item
+		int offset = strtokIndx != NULL ? atoi(strtokIndx) : -1;
+		strtokIndx = strtok(NULL, ",");		// next item
+		if (offset != prog->length || strtokIndx == NULL) {
+			// a lost or repeated line, the host has to upload the program again
+			hostPort->print("e22 motion program load out of sequence, offset: "); hostPort->print(offset);
+			hostPort->print(", length: "); hostPort->print(prog->length); hostPort->println();
+			return;
+		}
+		unsigned char bytes[MESSAGE_BUFFER_SIZE / 2];
+		int numBytes = motionProgramParseHex(strtokIndx, bytes, sizeof(bytes));
+		if (numBytes < 0) {
+			hostPort->print("e22 motion program load, invalid hex bytes: "); hostPort->print(strtokIndx); hostPort->println();
+			return;
+		}
+		if (!motionProgramLoad(prog, bytes, numBytes)) {
+			hostPort->print("e22 motion program too long, max: "); hostPort->print(MOTION_PROGRAM_SIZE); hostPort->println();
+			return;
+		}
+		break;
+	}
+
+	case 2:
+		if (isEmergencyStopActive()) {
+			hostPort->print("e12 motion program rejected, emergency stop active: "); hostPort->print(p); hostPort->println();
+			return;
+		}
+		motionProgramStart(prog);
+		break;
+
+	case 3:
+		motionProgramStop(prog);
+		break;
+	}
+	reportMotionProgram(p);
+}
+
+// w,<periodMs>,<pin>[,<pin>...]
+// teach mode, detach the servos and sample their sensors every periodMs, w,0 ends the teach mode
+void teachMode() {
+
+	char * strtokIndx; // this is used by strtok() as an index
+
+	strtokIndx = strtok(msgCopyForParsing, ","); // first item, command code
+	strtokIndx = strtok(NULL, ",");		// next item
+	int periodMs = strtokIndx != NULL ? atoi(strtokIndx) : 0;
+
+	if (periodMs == 0) {
+		if (teachRun.active) {
+			teachRun.active = false;
+			teachRun.stopping = true;		// the stream task sends the rest and the end message
+			for (int s = 0; s < teachRun.numServos; s++) {
+				servoList[teachRun.servoId[s]].teaching = false;
+			}
+			taskList[TEACH_SAMPLE_TASK].periodMs = TEACH_IDLE_PERIOD_MS;
+		}
+		return;
+	}
+	if (teachRun.active || teachRun.stopping) {
+		hostPort->println("e09 teach mode already running");
+		return;
+	}
+	if (periodMs < 5) {
+		hostPort->print("e09 teach period too short: "); hostPort->print(periodMs); hostPort->println();
+		return;
+	}
+
+	int numServos = 0;
+	while ((strtokIndx = strtok(NULL, ",")) != NULL) {
+		int pin = atoi(strtokIndx);
+		int servoId = servoIdOfPin(pin);
+		if (servoId == -1 || !servoList[servoId].isFeedbackServo) {
+			hostPort->print("e09 teach mode needs assigned feedback servos, pin: "); hostPort->print(pin); hostPort->println();
+			return;
+		}
+		if (servoList[servoId].inMoveRequest || servoList[servoId].moveQueued) {
+			hostPort->print("e09 teach mode request for moving servo, "); hostPort->print(servoList[servoId].config->servoName); hostPort->println();
+			return;
+		}
+		if (numServos >= TEACH_MAX_SERVOS) {
+			hostPort->print("e09 teach mode for more than "); hostPort->print(TEACH_MAX_SERVOS); hostPort->println(" servos");
+			return;
+		}
+		teachRun.servoId[numServos] = servoId;
+		teachRun.pin[numServos] = pin;
+		numServos++;
+	}
+	if (numServos == 0) {
+		hostPort->println("e09 teach mode without servos");
+		return;
+	}
+
+	// detached servos can be guided by hand
+	teachRun.numServos = numServos;
+	for (int s = 0; s < numServos; s++) {
+		servoList[teachRun.servoId[s]].detachServo(true);
+		servoList[teachRun.servoId[s]].teaching = true;
+	}
+	teachStart(&teachRun, periodMs);
+	taskList[TEACH_SAMPLE_TASK].periodMs = periodMs;
+	taskList[TEACH_SAMPLE_TASK].nextRunMillis = millis();
+
+	hostPort->print("i09 teach mode started, periodMs: "); hostPort->print(periodMs);
+	hostPort->print(", servos: "); hostPort->print(numServos);
+	hostPort->println();
+}
+
+// u,<pin>,<table>[,<x>,<y>]
+// one point of a calibration table per line, without the point the table is cleared
+void setCalibrationPoint() {
+
+	char * strtokIndx; // this is used by strtok() as an index
+
+	strtokIndx = strtok(msgCopyForParsing, ","); // first item, command code
+	strtokIndx = strtok(NULL, ",");		// next item
+	int pin = strtokIndx != NULL ? atoi(strtokIndx) : -1;
+
+	strtokIndx = strtok(NULL, ",");		// next item
+	int table = strtokIndx != NULL ? atoi(strtokIndx) : -1;
+
+	int servoId = servoIdOfPin(pin);
+	if (servoId == -1) {
+		hostPort->print("e08 calibration for unassigned servo, pin: "); hostPort->print(pin); hostPort->println();
+		return;
+	}
+	Mai3Servo *servo = &servoList[servoId];
+	if (table != 0 && !(table == 1 && servo->isFeedbackServo)) {
+		hostPort->print("e08 invalid calibration table: "); hostPort->print(table);
+		hostPort->print(", "); hostPort->print(servo->config->servoName); hostPort->println();
+		return;
+	}
+	if (servo->inMoveRequest) {
+		hostPort->print("e08 calibration change for moving servo, "); hostPort->print(servo->config->servoName); hostPort->println();
+		return;
+	}
+
+	strtokIndx = strtok(NULL, ",");		// next item
+	if (strtokIndx == NULL) {
+		servo->clearCalibration(table);
+	} else {
+		int x = atoi(strtokIndx);
+		strtokIndx = strtok(NULL, ",");		// next item
+		if (strtokIndx == NULL) {
+			hostPort->print("e08 calibration point without value, "); hostPort->print(servo->config->servoName); hostPort->println();
+			return;
+		}
+		int y = atoi(strtokIndx);
+		if (!servo->setCalibrationPoint(table, x, y)) {
+			hostPort->print("e08 calibration table full, "); hostPort->print(servo->config->servoName); hostPort->println();
+			return;
+		}
+	}
+
+	calibrationTableType *points = table == 1 ? &servo->config->sensorTable : &servo->config->writeTable;
+	hostPort->print("i08 calibration, "); hostPort->print(servo->config->servoName);
+	hostPort->print(", table: "); hostPort->print(table);
+	hostPort->print(", points:");
+	for (int i = 0; i < points->numPoints; i++) {
+		hostPort->print(" "); hostPort->print(points->x[i]);
+		hostPort->print("/"); hostPort->print(points->y[i]);
+	}
+	hostPort->println();
+}
+
+// n,<pin>,<holdMs>[,<kp>,<ki>,<deadband>,<periodMs>]
+void setHold() {
+
+	char * strtokIndx; // this is used by strtok() as an index
+
+	strtokIndx = strtok(msgCopyForParsing, ","); // first item, command code
+	strtokIndx = strtok(NULL, ",");		// next item
+	int pin = strtokIndx != NULL ? atoi(strtokIndx) : -1;
+
+	int servoId = servoIdOfPin(pin);
+	if (servoId == -1 || !servoList[servoId].isFeedbackServo) {
+		hostPort->print("e19 hold needs an assigned feedback servo, pin: "); hostPort->print(pin); hostPort->println();
+		return;
+	}
+	servoConfigType *config = servoList[servoId].config;
+
+	strtokIndx = strtok(NULL, ",");		// next item
+	int holdMs = strtokIndx != NULL ? atoi(strtokIndx) : 0;
+
+	// optional values, not given ones are kept
+	strtokIndx = strtok(NULL, ",");		// next item
+	float kp = strtokIndx != NULL ? atof(strtokIndx) : config->holdKp;
+
+	strtokIndx = strtok(NULL, ",");		// next item
+	float ki = strtokIndx != NULL ? atof(strtokIndx) : config->holdKi;
+
+	strtokIndx = strtok(NULL, ",");		// next item
+	float deadband = strtokIndx != NULL ? atof(strtokIndx) : config->holdDeadband;
+
+	strtokIndx = strtok(NULL, ",");		// next item
+	int periodMs = strtokIndx != NULL ? atoi(strtokIndx) : config->holdPeriodMs;
+
+	if (holdMs < -1 || kp < 0 || ki < 0 || deadband < 0 || periodMs < 20) {
+		hostPort->print("e19 invalid hold parameters, "); hostPort->print(config->servoName); hostPort->println();
+		return;
+	}
+	servoList[servoId].setHold(holdMs, kp, ki, deadband, periodMs);
+
+	// a running hold ends now when switched off
+	if (holdMs == 0 && servoList[servoId].holding) {
+		servoList[servoId].endHold();
+	}
+
+	hostPort->print("i29 hold, "); hostPort->print(config->servoName);
+	hostPort->print(", holdMs: "); hostPort->print(holdMs);
+	hostPort->print(", kp: "); hostPort->print(kp);
+	hostPort->print(", ki: "); hostPort->print(ki);
+	hostPort->print(", deadband: "); hostPort->print(deadband);
+	hostPort->print(", periodMs: "); hostPort->print(periodMs);
+	hostPort->println();
+}
+
+// j,<pin>,<backlash>,<deadband>
+void setSlackCompensation() {
+
+	char * strtokIndx; // this is used by strtok() as an index
+
+	strtokIndx = strtok(msgCopyForParsing, ","); // first item, command code
+	strtokIndx = strtok(NULL, ",");		// next item
+	int pin = strtokIndx != NULL ? atoi(strtokIndx) : -1;
+
+	strtokIndx = strtok(NULL, ",");		// next item
+	float backlash = strtokIndx != NULL ? atof(strtokIndx) : 0;
+
+	strtokIndx = strtok(NULL, ",");		// next item
+	float deadband = strtokIndx != NULL ? atof(strtokIndx) : 0;
+
+	int servoId = servoIdOfPin(pin);
+	if (servoId == -1 || !servoList[servoId].isFeedbackServo) {
+		hostPort->print("e18 slack compensation needs an assigned feedback servo, pin: "); hostPort->print(pin); hostPort->println();
+		return;
+	}
+	if (backlash < 0 || deadband < 0) {
+		hostPort->print("e18 negative backlash or deadband, "); hostPort->print(servoList[servoId].config->servoName); hostPort->println();
+		return;
+	}
+	servoList[servoId].setSlackCompensation(backlash, deadband);
+
+	hostPort->print("i28 slack compensation, "); hostPort->print(servoList[servoId].config->servoName);
+	hostPort->print(", backlash: "); hostPort->print(backlash);
+	hostPort->print(", deadband: "); hostPort->print(deadband);
+	hostPort->println();
+}
+
+// v,<pin>,<shaperType>[,<frequencyHz>,<damping>]
+// input shaper of the planned moves, type 0 off, 1 ZV, 2 ZVD
+void setInputShaper() {
+
+	char * strtokIndx; // this is used by strtok() as an index
+
+	strtokIndx = strtok(msgCopyForParsing, ","); // first item, command code
+	strtokIndx = strtok(NULL, ",");		// next item
+	int pin = strtokIndx != NULL ? atoi(strtokIndx) : -1;
+
+	strtokIndx = strtok(NULL, ",");		// next item
+	int shaperType = strtokIndx != NULL ? atoi(strtokIndx) : SHAPER_NONE;
+
+	strtokIndx = strtok(NULL, ",");		// next item
+	float frequencyHz = strtokIndx != NULL ? atof(strtokIndx) : 0;
+
+	strtokIndx = strtok(NULL, ",");		// next item
+	float damping = strtokIndx != NULL ? atof(strtokIndx) : 0;
+
+	int servoId = servoIdOfPin(pin);
+	if (servoId == -1) {
+		hostPort->print("e17 input shaper for unassigned servo, pin: "); hostPort->print(pin); hostPort->println();
+		return;
+	}
+	if (servoList[servoId].moving) {
+		hostPort->print("e17 input shaper change for moving servo, "); hostPort->print(servoList[servoId].config->servoName); hostPort->println();
+		return;
+	}
+	inputShaperType *shaper = &servoList[servoId].config->shaper;
+	if (!inputShaperSetup(shaper, shaperType, frequencyHz, damping)) {
+		hostPort->print("e17 invalid input shaper, type: "); hostPort->print(shaperType);
+		hostPort->print(", frequencyHz: "); hostPort->print(frequencyHz);
+		hostPort->print(", damping: "); hostPort->print(damping);
+		hostPort->println();
+		return;
+	}
+
+	hostPort->print("i27 input shaper, "); hostPort->print(servoList[servoId].config->servoName);
+	hostPort->print(", type: "); hostPort->print(shaper->type);
+	hostPort->print(", impulses:");
+	for (int i = 0; i < shaper->numImpulses; i++) {
+		hostPort->print(" "); hostPort->print(shaper->impulseMs[i]);
+		hostPort->print("ms/"); hostPort->print(shaper->amplitude[i], 3);
+	}
+	hostPort->print(", delayMs: "); hostPort->print(inputShaperDelayMs(shaper));
+	hostPort->println();
+}
+
+// r,<pin>[,<dumpTicks>]
+// record the next move of the servo, a running record of another servo is dropped
+void recordMove() {
+
+	char * strtokIndx; // this is used by strtok() as an index
+
+	strtokIndx = strtok(msgCopyForParsing, ","); // first item, command code
+	strtokIndx = strtok(NULL, ",");		// next item
+	int pin = strtokIndx != NULL ? atoi(strtokIndx) : -1;
+
+	strtokIndx = strtok(NULL, ",");		// optional dump of the recorded ticks
+	bool dumpTicks = strtokIndx != NULL && atoi(strtokIndx) != 0;
+
+	int servoId = servoIdOfPin(pin);
+	if (servoId == -1) {
+		hostPort->print("e86 move record for unassigned servo, pin: "); hostPort->print(pin); hostPort->println();
+		return;
+	}
+
+	for (int s = 0; s < assignedServos; s++) {
+		servoList[s].moveRecord = NULL;
+	}
+	moveRecordRun.recording = false;
+	moveRecordRun.servoId = servoId;
+	moveRecordRun.dumpTicks = dumpTicks;
+	servoList[servoId].moveRecord = &moveRecordRun;
+
+	hostPort->print("i88 next move recorded, "); hostPort->print(servoList[servoId].config->servoName);
+	hostPort->println();
+}
+
+// s,<pin>,<simulated>[,<refAngle>]
+// replace the feedback sensor of the servo with the simulated joint
+void simulateFeedback() {
+
+	char * strtokIndx; // this is used by strtok() as an index
+
+	strtokIndx = strtok(msgCopyForParsing, ","); // first item, command code
+	strtokIndx = strtok(NULL, ",");		// next item
+	int pin = strtokIndx != NULL ? atoi(strtokIndx) : -1;
+
+	strtokIndx = strtok(NULL, ",");		// next item
+	bool simulated = strtokIndx != NULL && atoi(strtokIndx) != 0;
+
+	strtokIndx = strtok(NULL, ",");		// optional magnet angle at the current position
+	int refAngle = strtokIndx != NULL ? atoi(strtokIndx) : 350;	// close to the overflow of the sensor
+
+	int servoId = servoIdOfPin(pin);
+	if (servoId == -1 || !servoList[servoId].isFeedbackServo) {
+		hostPort->print("e86 simulated feedback needs an assigned feedback servo, pin: "); hostPort->print(pin); hostPort->println();
+		return;
+	}
+	if (servoList[servoId].moving) {
+		hostPort->print("e86 simulated feedback request for moving servo, "); hostPort->print(servoList[servoId].config->servoName); hostPort->println();
+		return;
+	}
+
+	servoList[servoId].setSimulatedFeedback(simulated, refAngle);
+
+	hostPort->print("i89 simulated feedback, "); hostPort->print(servoList[servoId].config->servoName);
+	hostPort->print(", simulated: "); hostPort->print(simulated);
+	hostPort->print(", refAngle: "); hostPort->print(refAngle);
+	hostPort->println();
+}
+
+// e,<pin>
+// use pin as emergency stop input (active low, internal pullup), -1 to remove
+void setEmergencyStopPin() {
+
+	char * strtokIndx; // this is used by strtok() as an index
+
+	strtokIndx = strtok(msgCopyForParsing, ","); // first item, command code
+	strtokIndx = strtok(NULL, ",");		// next item
+	if (strtokIndx == NULL) {
+		hostPort->println("e13 emergency stop pin missing");
+		return;
+	}
+	int pin = atoi(strtokIndx);
+
+	if (eStopPin >= 0) {
+		detachInterrupt(digitalPinToInterrupt(eStopPin));
+	}
+	eStopPin = pin;
+	if (eStopPin >= 0) {
+		pinMode(eStopPin, INPUT_PULLUP);
+		attachInterrupt(digitalPinToInterrupt(eStopPin), emergencyStopISR, FALLING);
+		if (isEmergencyStopActive()) {
+			emergencyStopISR();
+		}
+	}
+	hostPort->print("i23 emergency stop pin: "); hostPort->print(eStopPin);
+	hostPort->println();
+}
+
+// p,<hostStamp>[,<rttUs>]
+// reply immediately with the host stamp and the board micros, the host can report the
+// round trip time measured with the previous ping for the board statistics
+void ping() {
+
+	char * strtokIndx; // this is used by strtok() as an index
+
+	strtokIndx = strtok(msgCopyForParsing, ","); // first item, command code
+	strtokIndx = strtok(NULL, ",");		// next item
+	if (strtokIndx == NULL) {
+		hostPort->println("e07 ping without host stamp");
+		return;
+	}
+	unsigned long hostStamp = strtoul(strtokIndx, NULL, 10);
+
+	strtokIndx = strtok(NULL, ",");		// optional round trip time of the previous ping
+	if (strtokIndx != NULL) {
+		addLatencySample(&pingRtt, strtoul(strtokIndx, NULL, 10));
+	}
+
+	hostPort->print("P"); hostPort->print(hostStamp);
+	hostPort->print(","); hostPort->print(micros());
+	hostPort->println();
+}
+
+// q,<reset>
+void latencyStats() {
+
+	char * strtokIndx; // this is used by strtok() as an index
+
+	strtokIndx = strtok(msgCopyForParsing, ","); // first item, command code
+	strtokIndx = strtok(NULL, ",");		// next item
+	bool resetStats = strtokIndx != NULL && atoi(strtokIndx) != 0;
+
+	reportLatencyHistogram("i93", "command latency", &commandLatency, resetStats);
+	reportLatencyHistogram("i94", "ping rtt", &pingRtt, resetStats);
+	reportLatencyHistogram("i96", "stop latency", &stopLatency, resetStats);
+	hostPort->print("i95 acks: "); hostPort->print(commandAcks);
+	hostPort->print(", nacks: "); hostPort->print(commandNacks);
+	hostPort->println();
+	reportTrafficStats(resetStats);
+	if (resetStats) {
+		commandAcks = 0;
+		commandNacks = 0;
+	}
+}
+
+// c,<captureOn>
+void trafficCapture() {
+
+	char * strtokIndx; // this is used by strtok() as an index
+
+	strtokIndx = strtok(msgCopyForParsing, ","); // first item, command code
+	strtokIndx = strtok(NULL, ",");		// next item
+	bool captureOn = strtokIndx != NULL && atoi(strtokIndx) != 0;
+
+	if (!setTrafficCapture(captureOn)) {
+		hostPort->println("e14 traffic capture needs the host on the native usb port");
+		return;
+	}
+	hostPort->print("i98 traffic capture: "); hostPort->print(captureOn);
+	hostPort->println();
+}
+
+// acknowledge a command sent with a sequence number
+// A<seq>,<rxMicros>,<execMicros>	accepted, execMicros is the start of the execution
+// N<seq>,<rxMicros>,<reason>		rejected, reason 1: line too long, 2: unknown command, 3: superseded by stop
+void sendCommandAck(unsigned long execMicros) {
+	if (commandSeq < 0) {
+		return;
+	}
+	commandAcks++;
+	hostPort->print("A"); hostPort->print(commandSeq);
+	hostPort->print(","); hostPort->print(commandRxMicros);
+	hostPort->print(","); hostPort->print(execMicros);
+	hostPort->println();
+}
+
+void sendCommandNack(int reason) {
+	if (commandSeq < 0) {
+		return;
+	}
+	commandNacks++;
+	hostPort->print("N"); hostPort->print(commandSeq);
+	hostPort->print(","); hostPort->print(commandRxMicros);
+	hostPort->print(","); hostPort->print(reason);
+	hostPort->println();
+}
+
+// "h,<pin number>,..<pin number>"
+void pinHigh() {
+
+	char * strtokIndx; // this is used by strtok() as an index
+
+	strtokIndx = strtok(msgCopyForParsing, ","); // first item
+	strtokIndx = strtok(NULL, ",");				 // command code h
+
+	while (strtokIndx != NULL) {				// for each pin in the list
+		int digitalPin = atoi(strtokIndx);      // pin number
+		
+		pinMode(digitalPin, OUTPUT);
+		digitalWrite(digitalPin, HIGH);
+		hostPort->print("i30 digital pin set to HIGH: "); hostPort->print(digitalPin); hostPort->println();
+
+		strtokIndx = strtok(NULL, ",");		// next item
+	}
+}
+
+// "l,<pin number>,..<pin number>"
+void pinLow() {
+
+	char * strtokIndx; // this is used by strtok() as an index
+
+	strtokIndx = strtok(msgCopyForParsing, ","); // first item, command code
+	strtokIndx = strtok(NULL, ",");		// first item after command
+
+	while (strtokIndx != NULL) {		// list of pins to set low
+		int digitalPin = atoi(strtokIndx);     // convert this part to an integer
+
+		hostPort->print("i31 digital pin set to LOW: "); hostPort->print(digitalPin); hostPort->println();
+		pinMode(digitalPin, OUTPUT);
+		digitalWrite(digitalPin, LOW);
+
+		strtokIndx = strtok(NULL, ",");		// next item
+	}
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+// tasks run by the scheduler
+/////////////////////////////////////////////////////////////////////
+
+// send the metrics of the recorded move when the move has ended
+void checkMoveRecord() {
+
+	Mai3Servo *servo = &servoList[moveRecordRun.servoId];
+	if (servo->moveRecord == NULL || !servo->moveRecord->recording || servo->moving) {
+		return;
+	}
+
+	moveMetricsType metrics;
+	evalMoveMetrics(servo->moveRecord, &metrics);
+
+	if (servo->moveRecord->dumpTicks) {
+		for (int t = 0; t < servo->moveRecord->numTicks; t++) {
+			moveTickType *tick = &servo->moveRecord->tick[t];
+			hostPort->print("i87 "); hostPort->print(tick->ms);
+			hostPort->print(","); hostPort->print(tick->magnetAngle);
+			hostPort->print(","); hostPort->print(tick->currentPosition);
+			hostPort->print(","); hostPort->print(tick->wantedPosition);
+			hostPort->print(","); hostPort->print(tick->writePosition);
+			hostPort->println();
+		}
+	}
+	hostPort->print("i86 move record, "); hostPort->print(servo->config->servoName);
+	hostPort->print(", start: "); hostPort->print(servo->moveRecord->startPosition);
+	hostPort->print(", target: "); hostPort->print(servo->moveRecord->targetPosition);
+	hostPort->print(", ticks: "); hostPort->print(servo->moveRecord->numTicks);
+	hostPort->print(", dropped: "); hostPort->print(servo->moveRecord->droppedTicks);
+	hostPort->print(", rmsError: "); hostPort->print(moveMetricsRmsError(&metrics));
+	hostPort->print(", maxError: "); hostPort->print(metrics.maxError);
+	hostPort->print(", overshoot: "); hostPort->print(metrics.overshoot);
+	hostPort->print(", settleMs: "); hostPort->print(metrics.settleMs);
+	hostPort->print(", avgUpdateUs: ");
+	if (servo->moveRecord->updates > 0) {
+		hostPort->print(servo->moveRecord->totalUpdateUs / servo->moveRecord->updates);
+	} else {
+		hostPort->print(0);
+	}
+	hostPort->print(", maxUpdateUs: "); hostPort->print(servo->moveRecord->maxUpdateUs);
+	hostPort->println();
+
+	servo->moveRecord->recording = false;
+	servo->moveRecord = NULL;
+}
+
+void pollStopCommands();
+
+void motionTask() {
+	startQueuedMoves();
+
+	// update the servos with a move request, servos done with their move leave the list
+	int numStillActive = 0;
+	for (int a = 0; a < numActiveServos; a++) {
+		int servoId = activeServoIds[a];
+		if (servoList[servoId].inMoveRequest) {
+			unsigned long updateStartUs = micros();
+			servoList[servoId].update();
+			if (servoList[servoId].moveRecord != NULL) {
+				moveRecordUpdateTime(servoList[servoId].moveRecord, micros() - updateStartUs);
+			}
+		}
+		pollStopCommands();		// feedback reads of many servos take a while
+		if (servoList[servoId].inMoveRequest || servoList[servoId].moveQueued) {
+			activeServoIds[numStillActive++] = servoId;
+		}
+	}
+	numActiveServos = numStillActive;
+
+	// after the loop, a stop polled during the update of another servo might have taken the recorded
+	// servo out of the list
+	checkMoveRecord();
+	checkJointGroupArrivals();
+}
+
+// for currently activated power groups check for possible power off
+void powerGroupTask() {
+	for (int powerGroupIndex=0; powerGroupIndex < NUMBER_OF_POWER_PINS; powerGroupIndex++) {
+		if (powerGroup[powerGroupIndex].powerOn) {
+			if (!hasPowerGroupActiveMovements(powerGroupIndex)) {
+				digitalWrite(powerGroup[powerGroupIndex].powerPin, SERVO_POWER_OFF);
+				powerGroup[powerGroupIndex].powerOn = false;
+				if (log_i41) {
+					hostPort->print("i41, servo group powered off "); hostPort->print(powerGroup[powerGroupIndex].powerGroupName); hostPort->println();
+				}
+
+				// detach servos in this power group
+				for (int s = 0; s < assignedServos; s++) {
+					if (servoList[s].servoPowerPin == powerGroup[powerGroupIndex].powerPin) {
+						servoList[s].detachServo(true);		// force detach
+					}
+				}
+			}
+		}
+	}
+}
+
+// execute the command line returned by checkCommand
+void executeCommand() {
+
+	if (log_i50) {
+		hostPort->print("i50 ");
+		hostPort->print(msgCopyForParsing);
+		hostPort->println();
+	}
+
+	// a truncated line might have lost parameters, do not execute it
+	if (commandTruncated) {
+		hostPort->print("e05 command line too long, ignored: "); hostPort->print(msgCopyForParsing); hostPort->println();
+		sendCommandNack(1);
+		return;
+	}
+
+	// the stop command sent after this move request has already been executed
+	if (commandSuperseded) {
+		hostPort->print("w04 move request superseded by stop, ignored: "); hostPort->print(msgCopyForParsing); hostPort->println();
+		sendCommandNack(3);
+		return;
+	}
+
+	unsigned long execMicros = micros();
+	bool commandAccepted = true;
+
+	switch (mode) {
 
 	case 'x':
 		break;
 
 	case 'i':	// reply with ready message
-		Serial.println("depricated request for arduinoId received");
+		hostPort->println("depricated request for arduinoId received");
 		break;
 
 	case '0':	// assign <servo>,<pin>,<min>,<max>
 		servoAssign();
-		Serial.println("after servo assign");
+		hostPort->println("after servo assign");
 		break;
 
 	case '1':	// move to absolute <servo>,<position>,<duration>
@@ -854,6 +2570,94 @@ void loop() {
 		setFeedbackDefinitions();
 		break;
 
+	case '9':	// servo current estimate
+		setServoCurrent();
+		break;
+
+	case 'b':	// power group current budget
+		setPowerGroupBudget();
+		break;
+
+	case 'm':	// position model of servos without feedback
+		setPositionModel();
+		break;
+
+	case 'd':	// define joint group
+		defineJointGroup();
+		break;
+
+	case 'g':	// joint group move
+		jointGroupMoveTo();
+		break;
+
+	case 'k':	// stall detection of feedback servos
+		setStallDetection();
+		break;
+
+	case 'a':	// PID autotune
+		servoAutoTune();
+		break;
+
+	case 't':	// scheduler statistics
+		schedulerStats();
+		break;
+
+	case 'e':	// emergency stop input
+		setEmergencyStopPin();
+		break;
+
+	case 'o':	// idle position monitoring
+		setIdleMonitoring();
+		break;
+
+	case 'f':	// gravity feedforward
+		setGravityFeedforward();
+		break;
+
+	case 'z':	// motion program
+		motionProgramCmd();
+		break;
+
+	case 'w':	// teach mode
+		teachMode();
+		break;
+
+	case 'u':	// calibration table point
+		setCalibrationPoint();
+		break;
+
+	case 'n':	// closed loop hold after the arrival
+		setHold();
+		break;
+
+	case 'j':	// backlash and deadband compensation
+		setSlackCompensation();
+		break;
+
+	case 'v':	// input shaper
+		setInputShaper();
+		break;
+
+	case 'r':	// record next move
+		recordMove();
+		break;
+
+	case 's':	// simulated feedback sensor
+		simulateFeedback();
+		break;
+
+	case 'c':	// traffic capture
+		trafficCapture();
+		break;
+
+	case 'p':	// ping
+		ping();
+		break;
+
+	case 'q':	// command latency statistics
+		latencyStats();
+		break;
+
 	case 'h':	// set pins high
 		pinHigh();
 		break;
@@ -863,6 +2667,166 @@ void loop() {
 		break;
 
 	default:
-		Serial.print("unknown mode: <"); Serial.print(mode); Serial.println(">");
+		hostPort->print("unknown mode: <"); hostPort->print(mode); hostPort->println(">");
+		commandAccepted = false;
+	}
+
+	if (commandAccepted) {
+		sendCommandAck(execMicros);
+	} else {
+		sendCommandNack(2);
+	}
+	addLatencySample(&commandLatency, micros() - commandRxMicros);
+	if (mode == '2' || mode == '3') {
+		addLatencySample(&stopLatency, micros() - commandRxMicros);
+	}
+}
+
+// check for new requests over serial
+// drain the received commands until the time slice is used up, the rest is handled in the next run
+void commandTask() {
+
+	unsigned long startUs = micros();
+
+	while (micros() - startUs < COMMAND_SLICE_US) {
+
+		mode = checkCommand();
+		if (mode == 'x') {
+			return;
+		}
+		executeCommand();
+	}
+}
+
+// fast path for stop commands and the emergency stop input
+// runs before each scheduler pass and between the servo updates of the motion task
+void pollStopCommands() {
+
+	if (eStopTriggered) {
+		handleEmergencyStop();
+	}
+
+	receiveCommands();
+	while (isStopCommandQueued()) {
+		mode = checkCommand();
+		executeCommand();
+	}
+}
+
+// periodic scheduler statistics
+void telemetryTask() {
+	if (log_i80) {
+		reportTaskStats(taskList, NUMBER_OF_TASKS, false);
+	}
+}
+
+// read the sensor of one idle feedback servo per run, round robin over the assigned servos
+// with its low priority the sweep mostly uses time the motion and command tasks leave, aging in the
+// scheduler still runs it about once per period under sustained host traffic
+int sweepServoId = 0;
+
+void sensorSweepTask() {
+	for (int i = 0; i < assignedServos; i++) {
+		sweepServoId = (sweepServoId + 1) % assignedServos;
+		Mai3Servo *servo = &servoList[sweepServoId];
+		if (servo->isFeedbackServo && !servo->inMoveRequest && servo->autoTune == NULL && !servo->teaching
+			&& servo->config->driftThreshold > 0) {
+			servo->monitorIdlePosition();
+			return;
+		}
+	}
+}
+
+// run the motion programs, the end or failure of a program is reported
+void motionProgramTask() {
+	for (int p = 0; p < NUMBER_OF_MOTION_PROGRAMS; p++) {
+		int state = motionPrograms[p].state;
+		if (state != PROGRAM_RUNNING && state != PROGRAM_WAITING && state != PROGRAM_ARRIVING) {
+			continue;
+		}
+		state = motionProgramRun(&motionPrograms[p], &programHost, millis());
+		if (state == PROGRAM_ENDED || state == PROGRAM_FAILED) {
+			reportMotionProgram(p);
+		}
 	}
 }
+
+// teach mode: sample the sensors of the teach servos
+void teachSampleTask() {
+	if (!teachRun.active) {
+		return;
+	}
+	short values[TEACH_MAX_SERVOS];
+	for (int s = 0; s < teachRun.numServos; s++) {
+		values[s] = round(servoList[teachRun.servoId[s]].readSensorPosition() * 10);
+	}
+	teachAddTick(&teachRun, millis(), values);
+}
+
+// send the sampled positions, the bytes per run keep room for other messages on the programming port
+// the budget is checked per line, a block of lines continues in the next run
+const int TEACH_STREAM_BYTES_SERIAL = 80;		// per 10 ms run, 115200 baud send about 115 bytes
+const int TEACH_STREAM_BYTES_USB = 2000;
+
+void teachStreamTask() {
+	if (!teachRun.active && !teachRun.stopping) {
+		return;
+	}
+	int runBudget = isHostPortUsb ? TEACH_STREAM_BYTES_USB : TEACH_STREAM_BYTES_SERIAL;
+	int byteBudget = runBudget;
+	char line[TEACH_LINE_SIZE];
+
+	int len;
+	while ((len = teachNextLine(&teachRun, teachRun.stopping, line, TEACH_LINE_SIZE)) > 0) {
+		// a line longer than the whole budget is sent alone in a run
+		if (len + 1 > byteBudget && byteBudget < runBudget) {
+			break;
+		}
+		hostPort->println(line);
+		teachLineSent(&teachRun, len);
+		byteBudget -= len + 1;
+	}
+
+	if (teachRun.stopping && teachRun.count == 0) {
+		teachRun.stopping = false;
+		hostPort->print("i09 teach mode ended, samples: "); hostPort->print(teachRun.ticks);
+		hostPort->print(", dropped: "); hostPort->print(teachRun.droppedTicks);
+		hostPort->print(", lines: "); hostPort->print(teachRun.lines);
+		hostPort->print(", bytes: "); hostPort->print(teachRun.bytes);
+		hostPort->println();
+	}
+}
+
+// show running mode and arduinoId with led
+void housekeepingTask() {
+	if (millis() - ledToggleMillis < highMillis) {
+		digitalWrite(LED_BUILTIN, HIGH);
+	}
+	else {
+		digitalWrite(LED_BUILTIN, LOW);
+	}
+	if ((millis() - ledToggleMillis) > (highMillis + lowMillis)) {
+		ledToggleMillis = millis();
+	}
+}
+
+// the task table, see scheduler
+// name, function, periodMs, priority, budgetUs, runtime data (nextRunMillis, runs, overruns, lateRuns, maxUs, totalUs)
+taskType taskList[NUMBER_OF_TASKS] = {
+	{"motion", motionTask, 20, 0, 8000, 0, 0, 0, 0, 0, 0},
+	{"commands", commandTask, 1, 1, COMMAND_SLICE_US + 1000, 0, 0, 0, 0, 0, 0},
+	{"powerGroups", powerGroupTask, 10, 2, 500, 0, 0, 0, 0, 0, 0},
+	{"telemetry", telemetryTask, 1000, 3, 5000, 0, 0, 0, 0, 0, 0},
+	{"housekeeping", housekeepingTask, 50, 4, 200, 0, 0, 0, 0, 0, 0},
+	{"sensorSweep", sensorSweepTask, 100, 4, 1500, 0, 0, 0, 0, 0, 0},
+	{"teachSample", teachSampleTask, TEACH_IDLE_PERIOD_MS, 0, 3000, 0, 0, 0, 0, 0, 0},
+	{"teachStream", teachStreamTask, 10, 3, 2000, 0, 0, 0, 0, 0, 0},
+	{"programs", motionProgramTask, 20, 2, 2000, 0, 0, 0, 0, 0, 0}
+};
+
+
+// the loop function runs over and over again until power down or reset
+void loop() {
+	pollStopCommands();
+	runScheduler(taskList, NUMBER_OF_TASKS);
+}
@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include "teachRecord.h"
+
+
+void teachStart(teachRecordType *rec, int periodMs) {
+	rec->active = true;
+	rec->stopping = false;
+	rec->periodMs = periodMs;
+	rec->head = 0;
+	rec->count = 0;
+	rec->blockTicks = 0;
+	rec->blockServo = 0;
+	rec->ticks = 0;
+	rec->droppedTicks = 0;
+	rec->lines = 0;
+	rec->bytes = 0;
+}
+
+
+bool teachAddTick(teachRecordType *rec, unsigned long ms, const short *values) {
+
+	if (rec->count >= TEACH_RING_TICKS) {
+		rec->droppedTicks++;
+		return false;
+	}
+	int slot = (rec->head + rec->count) % TEACH_RING_TICKS;
+	rec->tickMs[slot] = ms;
+	for (int s = 0; s < rec->numServos; s++) {
+		rec->value[slot][s] = values[s];
+	}
+	rec->count++;
+	rec->ticks++;
+	return true;
+}
+
+
+int teachLineTicks(const teachRecordType *rec, bool flush) {
+
+	// samples with regular times, the scheduler jitter stays within half a period
+	int numTicks = 1;
+	while (numTicks < rec->count && numTicks < TEACH_LINE_TICKS) {
+		unsigned long previousMs = rec->tickMs[(rec->head + numTicks - 1) % TEACH_RING_TICKS];
+		unsigned long ms = rec->tickMs[(rec->head + numTicks) % TEACH_RING_TICKS];
+		long offset = (long)(ms - previousMs) - rec->periodMs;
+		if (offset > rec->periodMs / 2 || offset < -rec->periodMs / 2) {
+			return numTicks;		// gap, the line ends before it
+		}
+		numTicks++;
+	}
+	if (rec->count == 0 || (numTicks < TEACH_LINE_TICKS && !flush)) {
+		return 0;
+	}
+	return numTicks;
+}
+
+
+int teachEncodeLine(const teachRecordType *rec, int servoIndex, int numTicks, char *line, int size) {
+
+	int len = snprintf(line, size, "W%d,%lu,%d", rec->pin[servoIndex], rec->tickMs[rec->head],
+		rec->value[rec->head][servoIndex]);
+
+	int previous = rec->value[rec->head][servoIndex];
+	int run = 0;		// samples without change not written yet
+	for (int t = 1; t <= numTicks && len < size; t++) {
+		int delta = 0;
+		if (t < numTicks) {
+			int value = rec->value[(rec->head + t) % TEACH_RING_TICKS][servoIndex];
+			delta = value - previous;
+			previous = value;
+			if (delta == 0) {
+				run++;
+				continue;
+			}
+		}
+		if (run == 1) {
+			len += snprintf(line + len, size - len, ",0");
+		} else if (run > 1) {
+			len += snprintf(line + len, size - len, ",=%d", run);
+		}
+		run = 0;
+		if (t < numTicks) {
+			len += snprintf(line + len, size - len, ",%d", delta);
+		}
+	}
+	if (len >= size) {
+		len = size - 1;
+	}
+	return len;
+}
+
+
+void teachConsume(teachRecordType *rec, int numTicks) {
+	rec->head = (rec->head + numTicks) % TEACH_RING_TICKS;
+	rec->count -= numTicks;
+}
+
+
+int teachNextLine(teachRecordType *rec, bool flush, char *line, int size) {
+
+	if (rec->blockTicks == 0) {
+		rec->blockTicks = teachLineTicks(rec, flush);
+		rec->blockServo = 0;
+		if (rec->blockTicks == 0) {
+			return 0;
+		}
+	}
+	return teachEncodeLine(rec, rec->blockServo, rec->blockTicks, line, size);
+}
+
+
+void teachLineSent(teachRecordType *rec, int length) {
+
+	rec->lines++;
+	rec->bytes += length + 1;
+	rec->blockServo++;
+	if (rec->blockServo >= rec->numServos) {
+		teachConsume(rec, rec->blockTicks);
+		rec->blockTicks = 0;
+		rec->blockServo = 0;
+	}
+}
@@ -0,0 +1,61 @@
+
+#ifndef teachRecord_h
+#define teachRecord_h
+
+// teach mode: the sensor positions of hand guided feedback servos are sampled at a fixed period
+// into a ring and streamed out as text lines, one line per servo and block of samples:
+//   W<pin>,<ms>,<position>[,<delta>|,=<count>]...
+// ms: millis of the first sample of the line, the next samples follow every sample period
+// position: first sample in tenths of a position, the next samples as change to the previous one,
+// =<count> for count samples without change. A gap in the sample times starts a new line.
+// the encoding, the ring and the block sending are tested with host/testTeachRecord.cpp
+
+#define TEACH_MAX_SERVOS 8
+#define TEACH_RING_TICKS 200		// samples of all servos kept until they are sent
+#define TEACH_LINE_TICKS 25			// max samples per line
+#define TEACH_LINE_SIZE 200
+
+typedef struct {
+	bool active;				// sampling
+	bool stopping;				// sampling stopped, sending the rest of the ring
+	int periodMs;
+	int numServos;
+	int servoId[TEACH_MAX_SERVOS];
+	int pin[TEACH_MAX_SERVOS];
+
+	unsigned long tickMs[TEACH_RING_TICKS];
+	short value[TEACH_RING_TICKS][TEACH_MAX_SERVOS];	// positions in tenths
+	int head;					// oldest sample not sent yet
+	int count;
+	int blockTicks;				// samples of the block of lines being sent, 0 between blocks
+	int blockServo;				// servo of the next line of the block
+
+	unsigned long ticks;		// sampled
+	unsigned long droppedTicks;	// lost with a full ring
+	unsigned long lines;
+	unsigned long bytes;
+} teachRecordType;
+
+extern void teachStart(teachRecordType *rec, int periodMs);
+
+// add the samples of all servos, false when the ring is full
+extern bool teachAddTick(teachRecordType *rec, unsigned long ms, const short *values);
+
+// samples for the next block of lines, 0 until a full line is available unless flush is set
+extern int teachLineTicks(const teachRecordType *rec, bool flush);
+
+// encode the line of servo servoIndex for the next numTicks samples, returns the length
+extern int teachEncodeLine(const teachRecordType *rec, int servoIndex, int numTicks, char *line, int size);
+
+// drop the sent samples from the ring
+extern void teachConsume(teachRecordType *rec, int numTicks);
+
+// encode the next line of the current block, a new block starts after the last line of a block
+// returns the length, 0 when no line is available. The same line is returned until teachLineSent,
+// so a line that does not fit into the output budget of a run can be sent in the next run.
+extern int teachNextLine(teachRecordType *rec, bool flush, char *line, int size);
+
+// count the line returned by teachNextLine as sent, the samples of a completed block are dropped
+extern void teachLineSent(teachRecordType *rec, int length);
+
+#endif
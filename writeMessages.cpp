@@ -4,10 +4,11 @@
 #include <Arduino.h>
 
 #include "writeMessages.h"
+#include "hostPort.h"
 
 byte statusMsg[10];
 
-byte buildStatusByte(bool isAssigned, bool isMoving, bool isAttached, bool isAutoDetach, bool isVerbose, bool hasTargetReached) {
+byte buildStatusByte(bool isAssigned, bool isMoving, bool isAttached, bool isAutoDetach, bool isVerbose, bool hasTargetReached, bool isBlocked) {
 	byte statusByte = 0x80;
 	if (isAssigned)       { statusByte = statusByte | 0x01; }
 	if (!hasTargetReached) {
@@ -17,6 +18,7 @@ byte buildStatusByte(bool isAssigned, bool isMoving, bool isAttached, bool isAut
 	if (isAutoDetach)     { statusByte = statusByte | 0x08; }
 	if (isVerbose)        { statusByte = statusByte | 0x10; }
 	if (hasTargetReached) { statusByte = statusByte | 0x20; }
+	if (isBlocked)        { statusByte = statusByte | 0x40; }
 	return statusByte;
 }
 
@@ -30,11 +32,10 @@ void sendServoStatus(byte pin, byte status, byte currentPosition) {
 	statusMsg[1] = status;
 	statusMsg[2] = 0x10 + currentPosition;		// add offset to position to avoid 0x0A as byte value
 
-	// send binary data bytewise
-	for (int i=0; i<3; i++) {
-		Serial.write(statusMsg[i]);
-	}
-	Serial.write(0x0A);		// newline as terminator
+	statusMsg[3] = 0x0A;		// newline as terminator
+
+	// send the message with one write, the native usb port sends a packet per write call
+	hostPort->write(statusMsg, 4);
 }
 
 
@@ -42,6 +43,8 @@ void sendFeedbackStatus(byte pin, byte status, byte currentPosition, int ms, byt
 
 	// in order to avoid sending termination value 0x0A add an offset of 4112 to int values
 	// and 0x10 to byte values
+	// the offset keeps the high byte of ms (0..FEEDBACK_STATUS_MAX_MS) above 0x0A, the low byte can be 0x0A,
+	// receivers take the frame by its fixed length of 8 bytes and not up to the first newline
 
 	int codedInt;
 
@@ -49,17 +52,16 @@ void sendFeedbackStatus(byte pin, byte status, byte currentPosition, int ms, byt
 	statusMsg[1] = status;
 	statusMsg[2] = 0x10 + currentPosition;		// add offset to position to avoid 0x0A as byte value
 
-	// ms since move start 
-	codedInt = ms + 4112;		// 4096 + 16
+	// ms since move start, limited to keep the high byte off 0x0A
+	codedInt = constrain(ms, 0, FEEDBACK_STATUS_MAX_MS) + 4112;		// 4096 + 16
 	statusMsg[3] = codedInt >> 8;
 	statusMsg[4] = codedInt & 0x00FF;
 
 	statusMsg[5] = 0x10 + servoWritePosition;
 	statusMsg[6] = 0x10 + wantedPosition;
 
-	// send binary data bytewise
-	for (int i=0; i<7; i++) {
-		Serial.write(statusMsg[i]);
-	}
-	Serial.write(0x0A);		// newline as terminator
+	statusMsg[7] = 0x0A;		// newline as terminator
+
+	// send the message with one write, the native usb port sends a packet per write call
+	hostPort->write(statusMsg, 8);
 }
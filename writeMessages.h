@@ -5,6 +5,7 @@
 #endif
 
 extern char msg[100];
-byte buildStatusByte(bool assigned, bool moving, bool attached, bool autoDetach, bool verbose, bool targetReached);
+byte buildStatusByte(bool assigned, bool moving, bool attached, bool autoDetach, bool verbose, bool targetReached, bool blocked = false);
 void sendServoStatus(byte pin, byte status, byte currentPosition);
+#define FEEDBACK_STATUS_MAX_MS 60000	// larger ms values of the feedback status are sent as this value
 void sendFeedbackStatus(byte pin, byte status, byte currentPosition, int ms, byte servoWritePosition, byte wantedPosition);